@@ -11,11 +11,10 @@
 #define PASS "pass1234"
 #define PORT "80"
 
-void processRequest(Route * route);
+void turnOn(ESP8266_HTTP & server, Route * route, char channel);
+void turnOff(ESP8266_HTTP & server, Route * route, char channel);
 
 ESP8266_HTTP server(RX_PIN, TX_PIN, RST_PIN);
-WifiMessage *msg = NULL;
-Route *route = NULL;
 byte code = 0;
 
 
@@ -30,9 +29,10 @@ void setup() {
         Serial.print(":");
         Serial.println(PORT);
 
-        // Every Route has unique ID - it is given by the sequence of registration
-        server.registerRoute(HTTP_Method::GET, "/on"); // ID == 1
-        server.registerRoute(HTTP_Method::GET, "/off"); // ID == 1
+        // Requests are passed to the handlers by update()
+        // HEAD and OPTIONS requests are answered automatically
+        server.registerRoute(HTTP_Method::GET, "/on", turnOn);
+        server.registerRoute(HTTP_Method::GET, "/off", turnOff);
     }
 
     pinMode(LED_BUILTIN, OUTPUT);
@@ -43,13 +43,13 @@ void setup() {
 void loop() {
     code = server.update();
     switch(code) {
+        case 5: // Request served by its handler
+            Serial.println("Request served!");
+            break;
         case 4: // Something was received
             Serial.println("Unexpected Message from ESP8266!");
             break;
-        case 3: // TCP Message
-            Serial.println("New Message!");
-            route = server.preprocessRequest();
-            processRequest(route);
+        case 3: // Request of route without handler - none in this sketch
             break;
         case 2: // Client disconnected
             Serial.println("Disconnected!");
@@ -66,34 +66,27 @@ void loop() {
     // Must be fast code
 }
 
-void processRequest(Route * route) {
-    if (route != NULL) {
-        // Message is HTTP request and the request is registered
-        msg = server.getWifiMessage();
-        switch(route->getID()) {
-            case 2:
-                Serial.println("GET /off HTTP Request.");
-                // Here update Arduino state ...
-                digitalWrite(LED_BUILTIN, LOW);
-
-                // Send response
-                server.send200();
-                server.send(msg->channel);
-                server.closeConnection(msg->channel);
-                break;
-            case 1:
-                Serial.println("GET /on HTTP Request.");
-                // Here update Arduino state ...
-                digitalWrite(LED_BUILTIN, HIGH);
-
-                // Send response
-                server.send200();
-                server.send(msg->channel);
-                server.closeConnection(msg->channel);
-                break;
-            case 0:
-            default:
-                break;
-        }
-    }
-}
\ No newline at end of file
+
+void turnOn(ESP8266_HTTP & server, Route * route, char channel) {
+    Serial.println("GET /on HTTP Request.");
+    // Not for HEAD request - it only asks for the header of the response
+    if (!server.isHeadOnly())
+        digitalWrite(LED_BUILTIN, HIGH);
+
+    // Send response
+    server.send200();
+    server.send(channel);
+    server.closeConnection(channel);
+}
+
+
+void turnOff(ESP8266_HTTP & server, Route * route, char channel) {
+    Serial.println("GET /off HTTP Request.");
+    if (!server.isHeadOnly())
+        digitalWrite(LED_BUILTIN, LOW);
+
+    // Send response
+    server.send200();
+    server.send(channel);
+    server.closeConnection(channel);
+}
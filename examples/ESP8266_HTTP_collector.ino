@@ -0,0 +1,69 @@
+/*
+ * Serves requests and posts readings of A0 to a collector on the LAN at the same time.
+ * Samples are posted in batches over one kept-alive connection.
+ * Collector stand-in: while true; do printf 'HTTP/1.1 204 No Content\r\n\r\n' | nc -l 8080; done
+ */
+#include "ESP8266_HTTP.h"
+#include "ESP8266_HTTPClient.h"
+
+#define RX_PIN  4  // Connect this pin to TX on the esp8266
+#define TX_PIN  6  // Connect this pin to RX on the esp8266
+#define RST_PIN 5
+
+#define SSID "ssid1234"
+#define PASS "pass1234"
+#define PORT "80"
+
+#define COLLECTOR_HOST "192.168.1.2"
+#define COLLECTOR_PORT "8080"
+
+#define SAMPLE_INTERVAL 1000 // ms
+
+void sendStatus(ESP8266_HTTP & server, Route * route, char channel);
+
+ESP8266_HTTP server(RX_PIN, TX_PIN, RST_PIN);
+ESP8266_HTTPClient collector(server, COLLECTOR_HOST, COLLECTOR_PORT, "/samples");
+unsigned long lastSample = 0;
+
+
+void setup() {
+    Serial.begin(9600);
+    while (!Serial);
+    Serial.println("Initialization...");
+
+    if (server.start(SSID, PASS, PORT) == 0) {
+        Serial.print("Server is running on ");
+        Serial.print(server.getIP());
+        Serial.print(":");
+        Serial.println(PORT);
+
+        server.registerRoute(HTTP_Method::GET, "/", sendStatus);
+    }
+}
+
+
+void loop() {
+    server.update();
+    // Posts the batch when CLIENT_FLUSH_INTERVAL passes
+    collector.update();
+
+    if (millis() - lastSample >= SAMPLE_INTERVAL) {
+        lastSample = millis();
+        // Full batch (CLIENT_BATCH_SIZE) is posted right away
+        if (!collector.addSample("a0", analogRead(A0)))
+            Serial.println("Sample dropped");
+    }
+}
+
+
+void sendStatus(ESP8266_HTTP & server, Route * route, char channel) {
+    // Body is delimited by closing the connection
+    server.sendln("HTTP/1.1 200 OK");
+    server.sendln("Connection: Closed");
+    server.sendln("Content-Type: text/plain");
+    server.sendln("");
+    server.send("Last status of " COLLECTOR_HOST ": ");
+    server.sendln(collector.lastStatus());
+    server.send(channel);
+    server.closeConnection(channel);
+}
@@ -0,0 +1,64 @@
+/*
+ * One handler, two encodings - JSON for browsers, CBOR for clients asking for it:
+ *   curl http://<IP>/state
+ *   curl -H "Accept: application/cbor" http://<IP>/state -o state.cbor
+ */
+#include "ESP8266_HTTP.h"
+#include "ESP8266_Encoder.h"
+
+#define RX_PIN  4  // Connect this pin to TX on the esp8266
+#define TX_PIN  6  // Connect this pin to RX on the esp8266
+#define RST_PIN 5
+
+#define SSID "ssid1234"
+#define PASS "pass1234"
+#define PORT "80"
+
+#define RELAY_PIN 7
+
+void sendState(ESP8266_HTTP & server, Route * route, char channel);
+
+ESP8266_HTTP server(RX_PIN, TX_PIN, RST_PIN);
+
+
+void setup() {
+    Serial.begin(9600);
+    while (!Serial);
+    Serial.println("Initialization...");
+    pinMode(RELAY_PIN, OUTPUT);
+
+    if (server.start(SSID, PASS, PORT) == 0) {
+        Serial.print("Server is running on ");
+        Serial.print(server.getIP());
+        Serial.print(":");
+        Serial.println(PORT);
+
+        server.registerRoute(HTTP_Method::GET, "/state", sendState);
+    }
+}
+
+
+void loop() {
+    if (server.update() == 5)
+        Serial.println("Request served!");
+}
+
+
+void sendState(ESP8266_HTTP & server, Route * route, char channel) {
+    // {"uptime":123,"relay":false,"inputs":[512,498]}
+    ESP8266_Encoder out(server);
+    out.beginObject();
+    out.key_P(PSTR("uptime"));
+    out.value((long)(millis() / 1000));
+    out.key_P(PSTR("relay"));
+    out.boolean(digitalRead(RELAY_PIN) == HIGH);
+    out.key_P(PSTR("inputs"));
+    out.beginArray();
+    out.value(analogRead(A0));
+    out.value(analogRead(A1));
+    out.endArray();
+    out.endObject();
+    if (!out.send(channel))
+        Serial.println("Response failed!");
+    server.closeConnection(channel);
+}
@@ -0,0 +1,62 @@
+/*
+ * Pushes the value of A0 to the browser by Server-Sent Events instead of polling.
+ */
+#include "ESP8266_HTTP.h"
+
+#define RX_PIN  4  // Connect this pin to TX on the esp8266
+#define TX_PIN  6  // Connect this pin to RX on the esp8266
+#define RST_PIN 5
+
+#define SSID "ssid1234"
+#define PASS "pass1234"
+#define PORT "80"
+
+#define SAMPLE_INTERVAL 1000 // ms
+
+const char PROGMEM_HTTP_PAGE[] PROGMEM = "HTTP/1.1 200 OK\r\nConnection: Closed\r\nContent-Type: text/html; charset=utf-8\r\nContent-Length: 128\r\n\r\n<html><body><h1 id=\"v\">-</h1><script>new EventSource(\"/events\").onmessage=function(e){v.innerText=e.data}</script></body></html>";
+
+void sendPage(ESP8266_HTTP & server, Route * route, char channel);
+
+ESP8266_HTTP server(RX_PIN, TX_PIN, RST_PIN);
+unsigned long lastSample = 0;
+int lastValue = -1;
+
+
+void setup() {
+    Serial.begin(9600);
+    while (!Serial);
+    Serial.println("Initialization...");
+
+    if (server.start(SSID, PASS, PORT) == 0) {
+        Serial.print("Server is running on ");
+        Serial.print(server.getIP());
+        Serial.print(":");
+        Serial.println(PORT);
+
+        server.registerRoute(HTTP_Method::GET, "/", sendPage);
+        // Connection of every GET /events request stays open
+        server.registerEventStream("/events");
+    }
+}
+
+
+void loop() {
+    server.update();
+
+    if (millis() - lastSample >= SAMPLE_INTERVAL) {
+        lastSample = millis();
+        int value = analogRead(A0);
+        // Only changes are sent - one small frame per subscriber
+        if (value != lastValue && server.subscribers("/events") > 0) {
+            char data[8];
+            itoa(value, data, 10);
+            server.publishEvent("/events", data);
+            lastValue = value;
+        }
+    }
+}
+
+
+void sendPage(ESP8266_HTTP & server, Route * route, char channel) {
+    server.streamResponse_PROGMEM(route, PROGMEM_HTTP_PAGE);
+}
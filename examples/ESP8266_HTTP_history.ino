@@ -0,0 +1,71 @@
+/*
+ * Keeps the last SAMPLE_STORE_CAPACITY readings of A0 and exports any time range of them:
+ *   curl "http://<IP>/history"                         - all samples as CSV
+ *   curl "http://<IP>/history?from=-300&step=60"       - last 5 minutes, mean per minute
+ *   curl "http://<IP>/history?format=bin" -o history.bin - 6 B per point (see ESP8266_SampleStore.h)
+ */
+#include "ESP8266_HTTP.h"
+#include "ESP8266_SampleStore.h"
+
+#if !ESP8266_TASKS
+#error "This example requires ESP8266_TASKS enabled in ESP8266_Config.h"
+#endif
+
+#define RX_PIN  4  // Connect this pin to TX on the esp8266
+#define TX_PIN  6  // Connect this pin to RX on the esp8266
+#define RST_PIN 5
+
+#define SSID "ssid1234"
+#define PASS "pass1234"
+#define PORT "80"
+
+#define SAMPLE_PERIOD 10 // s
+
+ESP8266_HTTP server(RX_PIN, TX_PIN, RST_PIN);
+ESP8266_SampleStore history(SAMPLE_PERIOD);
+unsigned long lastSample = 0;
+
+
+void setup() {
+    Serial.begin(9600);
+    while (!Serial);
+    Serial.println("Initialization...");
+
+    if (server.start(SSID, PASS, PORT) == 0) {
+        Serial.print("Server is running on ");
+        Serial.print(server.getIP());
+        Serial.print(":");
+        Serial.println(PORT);
+
+        // Exported in parts - other clients are served between them
+        history.registerExport(server, "/history");
+    }
+}
+
+
+void loop() {
+    if (server.update() == 5)
+        Serial.println("Request served!");
+
+    if (millis() - lastSample >= SAMPLE_PERIOD * 1000UL) {
+        lastSample = millis();
+        int value = analogRead(A0);
+        unsigned long start = micros();
+        history.append(value);
+        unsigned long cost = micros() - start;
+
+        Serial.print("Samples: ");
+        Serial.print(history.size());
+        Serial.print(", append: ");
+        Serial.print(cost);
+        Serial.print(" us");
+#if ESP8266_METRICS
+        // Throughput of the exports (and other responses) since the last sample
+        Serial.print(", sent: ");
+        Serial.print(server.sendBytesPerSecond());
+        Serial.print(" B/s");
+        server.resetMetrics();
+#endif
+        Serial.println();
+    }
+}
@@ -0,0 +1,64 @@
+/*
+ * Measures SRAM usage of the server - stack peak per route, free memory and heap.
+ * Set ESP8266_MEMORY to 1 in ESP8266_Config.h, then read the numbers:
+ *   curl http://<IP>/__mem
+ * or send any character over Serial.
+ */
+#include "ESP8266_HTTP.h"
+
+#if !ESP8266_MEMORY
+#error "This example requires ESP8266_MEMORY enabled in ESP8266_Config.h"
+#endif
+
+#define RX_PIN  4  // Connect this pin to TX on the esp8266
+#define TX_PIN  6  // Connect this pin to RX on the esp8266
+#define RST_PIN 5
+
+#define SSID "ssid1234"
+#define PASS "pass1234"
+#define PORT "80"
+
+void sendState(ESP8266_HTTP & server, Route * route, char channel);
+
+ESP8266_HTTP server(RX_PIN, TX_PIN, RST_PIN);
+
+
+void setup() {
+    Serial.begin(9600);
+    while (!Serial);
+    Serial.println("Initialization...");
+
+    if (server.start(SSID, PASS, PORT) == 0) {
+        Serial.print("Server is running on ");
+        Serial.print(server.getIP());
+        Serial.print(":");
+        Serial.println(PORT);
+
+        server.registerRoute(HTTP_Method::GET, "/state", sendState);
+        server.registerMemoryRoute();
+    }
+    // start() is not measured - only update() is
+    server.resetMemoryProfile();
+}
+
+
+void loop() {
+    server.update();
+
+    if (Serial.available()) {
+        while (Serial.available())
+            Serial.read();
+        server.printMemoryProfile(Serial);
+    }
+}
+
+
+void sendState(ESP8266_HTTP & server, Route * route, char channel) {
+    server.sendln("HTTP/1.1 200 OK");
+    server.sendln("Connection: Closed");
+    server.sendln("Content-Type: text/plain");
+    server.sendln("");
+    server.sendln(analogRead(A0));
+    server.send(channel);
+    server.closeConnection(channel);
+}
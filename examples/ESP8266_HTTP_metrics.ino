@@ -0,0 +1,93 @@
+/*
+ * Created by Jakub Svajka on 2021-02-15.
+ */
+#include "ESP8266_HTTP.h"
+
+#if !ESP8266_METRICS
+#error "This example requires ESP8266_METRICS enabled in ESP8266_Config.h"
+#endif
+
+#define RX_PIN  4  // Connect this pin to TX on the esp8266
+#define TX_PIN  6  // Connect this pin to RX on the esp8266
+#define RST_PIN 5
+
+#define SSID "ssid1234"
+#define PASS "pass1234"
+#define PORT "80"
+
+#define REPORT_INTERVAL 10000 // ms
+
+void processRequest(Route * route);
+void printMetrics();
+
+ESP8266_HTTP server(RX_PIN, TX_PIN, RST_PIN);
+WifiMessage *msg = NULL;
+Route *route = NULL;
+byte code = 0;
+unsigned long lastReport = 0;
+
+
+void setup() {
+    Serial.begin(9600);
+    while (!Serial);
+    Serial.println("Initialization...");
+
+    if (server.start(SSID, PASS, PORT) == 0) {
+        Serial.print("Server is running on ");
+        Serial.print(server.getIP());
+        Serial.print(":");
+        Serial.println(PORT);
+
+        // Every Route has unique ID - it is given by the sequence of registration
+        server.registerRoute(HTTP_Method::GET, "/"); // ID == 1
+    }
+    server.resetMetrics();
+}
+
+
+void loop() {
+    code = server.update();
+    if (code == 3) {
+        route = server.preprocessRequest();
+        processRequest(route);
+    }
+
+    if (millis() - lastReport >= REPORT_INTERVAL) {
+        lastReport = millis();
+        printMetrics();
+    }
+}
+
+void processRequest(Route * route) {
+    if (route != NULL) {
+        msg = server.getWifiMessage();
+        server.send200();
+        server.send(msg->channel);
+        server.closeConnection(msg->channel);
+    }
+}
+
+// Measure with any HTTP client, e.g.: while true; do curl -s http://<ip>/ > /dev/null; done
+void printMetrics() {
+    Metrics * m = server.getMetrics();
+    Serial.print("requests: ");
+    Serial.print(m->requests);
+    Serial.print(", req/min: ");
+    Serial.print(server.requestsPerMinute());
+    Serial.print(", p50: <");
+    Serial.print(server.latencyPercentile(50));
+    Serial.print(" ms, p99: <");
+    Serial.print(server.latencyPercentile(99));
+    Serial.print(" ms, busy/req: ");
+    Serial.print(server.busyMicrosPerRequest());
+    Serial.print(" us, rx: ");
+    Serial.print(m->bytesReceived);
+    Serial.print(" B, tx: ");
+    Serial.print(m->bytesSent);
+    Serial.print(" B (");
+    Serial.print(server.sendBytesPerSecond());
+    Serial.print(" B/s), peak rx buffer: ");
+    Serial.print(m->peakRxBufferSize);
+    Serial.print(" B, peak tx buffer: ");
+    Serial.println(m->peakTxBufferSize);
+}
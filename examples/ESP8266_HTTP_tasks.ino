@@ -0,0 +1,98 @@
+/*
+ * Resumable handlers: a slow sensor and a page sent in parts do not block other clients.
+ */
+#include "ESP8266_HTTP.h"
+
+#if !ESP8266_TASKS
+#error "This example requires ESP8266_TASKS enabled in ESP8266_Config.h"
+#endif
+
+#define RX_PIN  4  // Connect this pin to TX on the esp8266
+#define TX_PIN  6  // Connect this pin to RX on the esp8266
+#define RST_PIN 5
+
+#define SSID "ssid1234"
+#define PASS "pass1234"
+#define PORT "80"
+
+#define CONVERSION_TIME 750 // ms, e. g. DS18B20 at 12 bits
+
+const char PROGMEM_PAGE_HEADER[] PROGMEM = "HTTP/1.1 200 OK\r\nConnection: Closed\r\nContent-Type: text/html; charset=utf-8\r\n\r\n";
+const char PROGMEM_PAGE_START[] PROGMEM = "<html><body>";
+const char PROGMEM_PAGE_PART[] PROGMEM = "<p>Lorem ipsum dolor sit amet, consectetur adipiscing elit.</p>";
+const char PROGMEM_PAGE_FOOTER[] PROGMEM = "</body></html>";
+
+#define PAGE_PARTS 10
+
+// Context of the page task - survives yielding
+struct PageContext {
+    byte part;
+};
+
+byte readSensor(ESP8266_HTTP & server, HTTP_Task * task);
+byte sendPage(ESP8266_HTTP & server, HTTP_Task * task);
+
+ESP8266_HTTP server(RX_PIN, TX_PIN, RST_PIN);
+
+
+void setup() {
+    Serial.begin(9600);
+    while (!Serial);
+    Serial.println("Initialization...");
+
+    if (server.start(SSID, PASS, PORT) == 0) {
+        Serial.print("Server is running on ");
+        Serial.print(server.getIP());
+        Serial.print(":");
+        Serial.println(PORT);
+
+        server.registerTask(HTTP_Method::GET, "/sensor", readSensor);
+        server.registerTask(HTTP_Method::GET, "/page", sendPage);
+    }
+}
+
+
+void loop() {
+    // Running tasks take turns whenever nothing else happens
+    if (server.update() == 5)
+        Serial.println("Request served!");
+}
+
+
+byte readSensor(ESP8266_HTTP & server, HTTP_Task * task) {
+    TASK_BEGIN(task);
+    // Start the conversion here, then let other clients be served while it runs
+    TASK_SLEEP(task, CONVERSION_TIME);
+
+    server.sendln("HTTP/1.1 200 OK");
+    server.sendln("Connection: Closed");
+    server.sendln("Content-Type: text/plain");
+    server.sendln("");
+    // HEAD request gets the header only
+    if (!task->headOnly)
+        server.sendln(analogRead(A0));
+    server.send(task->channel);
+    server.closeConnection(task->channel);
+    TASK_END(task);
+}
+
+
+byte sendPage(ESP8266_HTTP & server, HTTP_Task * task) {
+    PageContext * page = TASK_CONTEXT(task, PageContext);
+    TASK_BEGIN(task);
+    // HEAD request gets the header only - the connection is closed when it is sent
+    server.stream_PROGMEM(task->channel, PROGMEM_PAGE_HEADER, task->route->getPriority(), task->headOnly);
+    if (!task->headOnly) {
+        TASK_WAIT_UNTIL(task, !server.isStreaming(task->channel));
+        server.stream_PROGMEM(task->channel, PROGMEM_PAGE_START, task->route->getPriority(), false);
+        // Wait for the send queue of the link instead of the whole page in Flash at once
+        for (page->part = 0; page->part < PAGE_PARTS; page->part++) {
+            TASK_WAIT_UNTIL(task, !server.isStreaming(task->channel));
+            server.stream_PROGMEM(task->channel, PROGMEM_PAGE_PART, task->route->getPriority(), false);
+        }
+        TASK_WAIT_UNTIL(task, !server.isStreaming(task->channel));
+        // Connection is closed when the footer is sent
+        server.stream_PROGMEM(task->channel, PROGMEM_PAGE_FOOTER, task->route->getPriority(), true);
+    }
+    TASK_END(task);
+}
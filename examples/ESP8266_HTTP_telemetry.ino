@@ -0,0 +1,54 @@
+/*
+ * Streams A0 and A1 at 50 Hz to a receiver on the LAN by UDP while the server keeps running.
+ * Receiver: python3 extras/telemetry_receiver.py --port 5005
+ */
+#include "ESP8266_HTTP.h"
+#include "ESP8266_Telemetry.h"
+
+#define RX_PIN  4  // Connect this pin to TX on the esp8266
+#define TX_PIN  6  // Connect this pin to RX on the esp8266
+#define RST_PIN 5
+
+#define SSID "ssid1234"
+#define PASS "pass1234"
+#define PORT "80"
+
+#define RECEIVER_HOST "192.168.1.2"
+#define RECEIVER_PORT "5005"
+
+#define SAMPLE_INTERVAL 20 // ms
+
+ESP8266_HTTP server(RX_PIN, TX_PIN, RST_PIN);
+ESP8266_Telemetry telemetry(server, RECEIVER_HOST, RECEIVER_PORT);
+unsigned long lastSample = 0;
+
+
+void setup() {
+    Serial.begin(9600);
+    while (!Serial);
+    Serial.println("Initialization...");
+
+    if (server.start(SSID, PASS, PORT) == 0) {
+        Serial.print("Server is running on ");
+        Serial.print(server.getIP());
+        Serial.print(":");
+        Serial.println(PORT);
+
+        if (!telemetry.begin())
+            Serial.println("Unable to open UDP link!");
+    }
+}
+
+
+void loop() {
+    server.update();
+    // Sends the datagram when TELEMETRY_FLUSH_INTERVAL passes
+    telemetry.update();
+
+    if (millis() - lastSample >= SAMPLE_INTERVAL) {
+        lastSample = millis();
+        // 5 bytes per record, one AT+CIPSEND per TELEMETRY_MTU bytes
+        telemetry.record(0, analogRead(A0));
+        telemetry.record(1, analogRead(A1));
+    }
+}
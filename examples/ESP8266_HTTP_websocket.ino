@@ -0,0 +1,64 @@
+/*
+ * Switches the LED from the browser over WebSocket. Every client sees the state right away.
+ */
+#include "ESP8266_HTTP.h"
+
+#if !ESP8266_WEBSOCKET
+#error "This example requires ESP8266_WEBSOCKET enabled in ESP8266_Config.h"
+#endif
+
+#define RX_PIN  4  // Connect this pin to TX on the esp8266
+#define TX_PIN  6  // Connect this pin to RX on the esp8266
+#define RST_PIN 5
+
+#define SSID "ssid1234"
+#define PASS "pass1234"
+#define PORT "80"
+
+const char PROGMEM_HTTP_PAGE[] PROGMEM = "HTTP/1.1 200 OK\r\nConnection: Closed\r\nContent-Type: text/html; charset=utf-8\r\nContent-Length: 234\r\n\r\n<html><body><h1 id=\"s\">-</h1><button onclick=\"w.send('on')\">On</button><button onclick=\"w.send('off')\">Off</button><script>w=new WebSocket(\"ws://\"+location.host+\"/ws\");w.onmessage=function(e){s.innerText=e.data}</script></body></html>";
+
+void sendPage(ESP8266_HTTP & server, Route * route, char channel);
+void control(ESP8266_HTTP & server, char channel, const char * data, size_t len);
+
+ESP8266_HTTP server(RX_PIN, TX_PIN, RST_PIN);
+
+
+void setup() {
+    Serial.begin(9600);
+    while (!Serial);
+    Serial.println("Initialization...");
+    pinMode(LED_BUILTIN, OUTPUT);
+
+    if (server.start(SSID, PASS, PORT) == 0) {
+        Serial.print("Server is running on ");
+        Serial.print(server.getIP());
+        Serial.print(":");
+        Serial.println(PORT);
+
+        server.registerRoute(HTTP_Method::GET, "/", sendPage);
+        // GET /ws is upgraded, the connection stays open
+        server.registerWebSocket("/ws", control);
+    }
+}
+
+
+void loop() {
+    server.update();
+}
+
+
+void sendPage(ESP8266_HTTP & server, Route * route, char channel) {
+    server.streamResponse_PROGMEM(route, PROGMEM_HTTP_PAGE);
+}
+
+
+void control(ESP8266_HTTP & server, char channel, const char * data, size_t len) {
+    if (len == 2 && strncmp(data, "on", 2) == 0)
+        digitalWrite(LED_BUILTIN, HIGH);
+    else if (len == 3 && strncmp(data, "off", 3) == 0)
+        digitalWrite(LED_BUILTIN, LOW);
+    else
+        return;
+    // Two bytes of frame header instead of a whole HTTP response
+    server.broadcastWebSocket("/ws", digitalRead(LED_BUILTIN) ? "on" : "off");
+}
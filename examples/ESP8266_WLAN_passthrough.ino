@@ -0,0 +1,79 @@
+/*
+ * Exports a log to a collector (e. g. "nc -l 5000") in pass-through mode
+ * and compares the throughput with responses sent by AT+CIPSEND.
+ */
+#include "ESP8266_WLAN.h"
+
+#if !ESP8266_PASSTHROUGH || !ESP8266_METRICS
+#error "This example requires ESP8266_PASSTHROUGH and ESP8266_METRICS enabled in ESP8266_Config.h"
+#endif
+
+#define RX_PIN  4  // Connect this pin to TX on the esp8266
+#define TX_PIN  6  // Connect this pin to RX on the esp8266
+#define RST_PIN 5
+
+#define SSID "ssid1234"
+#define PASS "pass1234"
+#define PORT "80"
+
+#define COLLECTOR_HOST "192.168.1.2"
+#define COLLECTOR_PORT "5000"
+#define EXPORT_INTERVAL 60000 // ms
+
+void exportLog();
+
+ESP8266_WLAN wifi(RX_PIN, TX_PIN, RST_PIN);
+WifiMessage *msg = NULL;
+unsigned long lastExport = 0;
+
+
+void setup() {
+    Serial.begin(9600);
+    while (!Serial);
+    Serial.println("Initialization...");
+
+    if (!wifi.init() || !wifi.connectToAP(SSID, PASS) || !wifi.createTCPServer(PORT)) {
+        Serial.println("Failed!");
+        while (1);
+    }
+    Serial.print("Server is running on ");
+    Serial.println(wifi.getIP());
+}
+
+
+void loop() {
+    if (wifi.update() == 3) {
+        msg = wifi.getWifiMessage();
+        wifi.sendln("Hello, World!");
+        wifi.send(msg->channel);
+        wifi.closeConnection(msg->channel);
+    }
+
+    if (millis() - lastExport >= EXPORT_INTERVAL) {
+        lastExport = millis();
+        exportLog();
+    }
+}
+
+
+void exportLog() {
+    // The server is stopped for the whole session
+    if (!wifi.beginPassThrough(COLLECTOR_HOST, COLLECTOR_PORT)) {
+        Serial.println("Collector is not available!");
+        return;
+    }
+    char line[24];
+    for (int i = 0; i < 100; i++) {
+        // Here read the log ...
+        sprintf(line, "%d;%d\r\n", i, analogRead(A0));
+        wifi.passThrough(line, strlen(line));
+    }
+    if (!wifi.endPassThrough())
+        Serial.println("Server was not restored!");
+
+    Serial.print("CIPSEND: ");
+    Serial.print(wifi.sendBytesPerSecond());
+    Serial.print(" B/s, pass-through: ");
+    Serial.print(wifi.passThroughBytesPerSecond());
+    Serial.println(" B/s");
+}
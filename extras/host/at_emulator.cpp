@@ -0,0 +1,630 @@
+#include "at_emulator.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LINE 256
+#define MAX_SEND 2048
+
+static const char BOOT_MESSAGE[] = "\r\n ets Jan  8 2013,rst cause:2, boot mode:(3,6)\r\n\r\nready\r\n";
+static const char VERSION[] = "AT version:1.7.4.0(May 11 2020 19:13:04)\r\n"
+        "SDK version:3.0.4(9532ceb)\r\n"
+        "compile time:May 27 2020 10:12:17\r\n";
+
+
+static bool startsWith(const std::string & line, const char * prefix) {
+    return line.compare(0, strlen(prefix), prefix) == 0;
+}
+
+
+static std::string number(unsigned long n) {
+    char buf[24];
+    snprintf(buf, sizeof(buf), "%lu", n);
+    return buf;
+}
+
+
+/**
+ * @brief Module as it leaves the factory, booted: station + Access Point mode,
+ * single connection, no Access Point saved.
+ */
+ATEmulator::ATEmulator(ATNetwork * network)
+    : _network(network)
+{
+    memset(&stats, 0, sizeof(stats));
+    _mode = 2;
+    _autoConnect = true;
+    _apAvailable = true;
+    _resetLow = false;
+    _lastReply = 0;
+    _port = 0;
+    for (int i = 0; i < AT_LINKS; i++)
+        _links[i].open = false;
+    clear();
+}
+
+
+// Volatile state - lost by reset
+void ATEmulator::clear() {
+    for (int i = 0; i < AT_LINKS; i++) {
+        if (_links[i].open)
+            _network->close(i);
+        _links[i].open = false;
+        _links[i].server = false;
+        _links[i].buffer.clear();
+    }
+    if (_port != 0)
+        _network->unlisten();
+    _port = 0;
+    _maxConn = AT_LINKS;
+    _echo = true;
+    _mux = false;
+    _passive = false;
+    _transparentMode = false;
+    _transparent = false;
+    _restartAt = 0;
+    _bootAt = 0;
+    _joinAt = 0;
+    _joinReply = false;
+    _joined = false;
+    _sendLink = -1;
+    _sendData.clear();
+    _line.clear();
+    _out.clear();
+    _replies.clear();
+    _deferred.clear();
+}
+
+
+void ATEmulator::boot(unsigned long long now) {
+    stats.resets++;
+    clear();
+    _bootAt = now + timing.boot;
+}
+
+
+void ATEmulator::input(uint8_t c, unsigned long long now) {
+    if (_resetLow || _bootAt != 0 || _restartAt != 0)
+        return;
+    if (_transparent) {
+        // Packed by pauses, see update()
+        _sendData += (char)c;
+        _packetAt = now;
+        if (_sendData.size() >= MAX_SEND) {
+            _network->send(0, _sendData.data(), _sendData.size());
+            _sendData.clear();
+        }
+        return;
+    }
+    if (_sendLink >= 0) {
+        _sendData += (char)c;
+        if (--_sendLeft == 0)
+            sendData(now);
+    }
+    else if (c == '\n') {
+        std::string line = _line;
+        _line.clear();
+        if (!line.empty() && line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
+        if (!line.empty())
+            command(line, now);
+    }
+    else if (_line.size() < MAX_LINE) {
+        _line += (char)c;
+    }
+    else {
+        // Garbage
+        _line.clear();
+    }
+    if (!busy())
+        flushDeferred(now);
+}
+
+
+void ATEmulator::update(unsigned long long now) {
+    if (_resetLow)
+        return;
+    if (_restartAt != 0 && now >= _restartAt) {
+        // OK of AT+RST goes out first
+        deliver(now);
+        boot(now);
+    }
+    if (_bootAt != 0 && now >= _bootAt) {
+        _bootAt = 0;
+        _lastReply = now;
+        reply(BOOT_MESSAGE, now, 0);
+        if (_autoConnect && !_savedSSID.empty() && _mode != 2) {
+            _ssid = _savedSSID;
+            _joinAt = now + timing.join;
+        }
+    }
+    if (_joinAt != 0 && now >= _joinAt) {
+        _joinAt = 0;
+        joined(now);
+    }
+    if (_transparent && !_sendData.empty() && now - _packetAt >= timing.packing) {
+        if (_sendData == "+++")
+            _transparent = false;
+        else
+            _network->send(0, _sendData.data(), _sendData.size());
+        _sendData.clear();
+    }
+    deliver(now);
+    if (!busy())
+        flushDeferred(now);
+    deliver(now);
+}
+
+
+// Moves replies due at now to the output
+void ATEmulator::deliver(unsigned long long now) {
+    while (!_replies.empty() && _replies.front().at <= now) {
+        _out += _replies.front().data;
+        _replies.pop_front();
+    }
+}
+
+
+unsigned long long ATEmulator::nextEvent() {
+    unsigned long long next = ~0ULL;
+    if (_resetLow)
+        return next;
+    if (!_replies.empty())
+        next = _replies.front().at;
+    if (_restartAt != 0 && _restartAt < next)
+        next = _restartAt;
+    if (_bootAt != 0 && _bootAt < next)
+        next = _bootAt;
+    if (_joinAt != 0 && _joinAt < next)
+        next = _joinAt;
+    if (_transparent && !_sendData.empty() && _packetAt + timing.packing < next)
+        next = _packetAt + timing.packing;
+    return next;
+}
+
+
+/**
+ * @brief Incoming connection to the server.
+ * @return Link of the connection, -1 when refused.
+ */
+int ATEmulator::accept(unsigned long long now) {
+    if (_port == 0 || !_joined || _bootAt != 0 || _resetLow)
+        return -1;
+    if (serverLinks() >= _maxConn)
+        return -1;
+    for (int i = 0; i < AT_LINKS; i++) {
+        if (!_links[i].open) {
+            _links[i].open = true;
+            _links[i].server = true;
+            notify(number(i) + ",CONNECT\r\n", now);
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+// Data received by the link - one TCP segment
+void ATEmulator::received(int link, const char * data, size_t len, unsigned long long now) {
+    if (link < 0 || link >= AT_LINKS || !_links[link].open || len == 0)
+        return;
+    stats.received++;
+    std::string segment(data, len);
+    if (_transparent) {
+        reply(segment, now, 0);
+    }
+    else if (!_mux) {
+        notify("\r\n+IPD," + number(len) + ":" + segment, now);
+    }
+    else if (_passive) {
+        // Kept until AT+CIPRECVDATA
+        _links[link].buffer += segment;
+        notify("\r\n+IPD," + number(link) + "," + number(len) + "\r\n", now);
+    }
+    else {
+        notify("\r\n+IPD," + number(link) + "," + number(len) + ":" + segment, now);
+    }
+}
+
+
+// Connection closed by the peer
+void ATEmulator::closed(int link, unsigned long long now) {
+    if (link < 0 || link >= AT_LINKS || !_links[link].open)
+        return;
+    _links[link].open = false;
+    _links[link].buffer.clear();
+    if (_transparent) {
+        _transparent = false;
+        _sendData.clear();
+    }
+    notify(_mux ? number(link) + ",CLOSED\r\n" : std::string("CLOSED\r\n"), now);
+}
+
+
+void ATEmulator::setResetPin(bool high, unsigned long long now) {
+    if (!high) {
+        if (!_resetLow)
+            clear();
+        _resetLow = true;
+    }
+    else if (_resetLow) {
+        _resetLow = false;
+        boot(now);
+    }
+}
+
+
+void ATEmulator::loseAP(unsigned long long now) {
+    _apAvailable = false;
+    if (!_joined)
+        return;
+    _joined = false;
+    std::string message = "WIFI DISCONNECT\r\n";
+    for (int i = 0; i < AT_LINKS; i++) {
+        if (_links[i].open) {
+            closeLink(i);
+            message += number(i) + ",CLOSED\r\n";
+        }
+    }
+    notify(message, now);
+    // Auto connect keeps trying
+    if (_autoConnect && !_ssid.empty())
+        _joinAt = now + timing.join;
+}
+
+
+void ATEmulator::findAP(unsigned long long now) {
+    _apAvailable = true;
+}
+
+
+void ATEmulator::command(const std::string & line, unsigned long long now) {
+    stats.commands++;
+    if (_echo)
+        reply(line + "\r\r\n", now, 0);
+    // Messages of the network while the line was typed come before its result
+    flushDeferred(now);
+
+    if (line == "AT") {
+        ok(now);
+    }
+    else if (line == "ATE0" || line == "ATE1") {
+        _echo = (line[3] == '1');
+        ok(now);
+    }
+    else if (line == "AT+RST") {
+        ok(now);
+        _restartAt = _lastReply + 1000;
+    }
+    else if (line == "AT+GMR") {
+        reply(std::string(VERSION) + "\r\nOK\r\n", now, timing.reply);
+    }
+    else if (line == "AT+CWMODE?" || line == "AT+CWMODE_CUR?" || line == "AT+CWMODE_DEF?") {
+        reply("+CWMODE:" + number(_mode) + "\r\n\r\nOK\r\n", now, timing.reply);
+    }
+    else if (startsWith(line, "AT+CWMODE")) {
+        int mode = atoi(line.c_str() + line.find('=') + 1);
+        if (mode < 1 || mode > 3)
+            return error(NULL, now);
+        _mode = mode;
+        ok(now);
+    }
+    else if (line == "AT+CIPMUX?") {
+        reply("+CIPMUX:" + number(_mux) + "\r\n\r\nOK\r\n", now, timing.reply);
+    }
+    else if (startsWith(line, "AT+CIPMUX=")) {
+        bool mux = (line[10] == '1');
+        if (mux != _mux) {
+            for (int i = 0; i < AT_LINKS; i++) {
+                if (_links[i].open)
+                    return error("link is builded", now);
+            }
+            if (_port != 0 || _transparentMode)
+                return error(NULL, now);
+        }
+        _mux = mux;
+        ok(now);
+    }
+    else if (line == "AT+CWJAP?" || line == "AT+CWJAP_CUR?" || line == "AT+CWJAP_DEF?") {
+        if (_joined)
+            reply("+CWJAP:\"" + _ssid + "\",\"5c:cf:7f:aa:bb:cc\",6,-58\r\n\r\nOK\r\n", now, timing.reply);
+        else
+            reply("No AP\r\n\r\nOK\r\n", now, timing.reply);
+    }
+    else if (startsWith(line, "AT+CWJAP_DEF=")) {
+        join(line.substr(13), true, now);
+    }
+    else if (startsWith(line, "AT+CWJAP_CUR=")) {
+        join(line.substr(13), false, now);
+    }
+    else if (startsWith(line, "AT+CWJAP=")) {
+        join(line.substr(9), true, now);
+    }
+    else if (startsWith(line, "AT+CWAUTOCONN=")) {
+        _autoConnect = (line[14] == '1');
+        ok(now);
+    }
+    else if (line == "AT+CWQAP") {
+        ok(now);
+        if (_joined) {
+            loseAP(now);
+            _apAvailable = true;
+            _joinAt = 0;
+        }
+        _ssid.clear();
+    }
+    else if (line == "AT+CIFSR") {
+        std::string ip = _joined ? "192.168.1.50" : "0.0.0.0";
+        reply("+CIFSR:STAIP,\"" + ip + "\"\r\n+CIFSR:STAMAC,\"5c:cf:7f:00:00:01\"\r\n\r\nOK\r\n", now, timing.reply);
+    }
+    else if (line == "AT+CIPSTATUS") {
+        cipstatus(now);
+    }
+    else if (startsWith(line, "AT+CIPSERVERMAXCONN=")) {
+        int max = atoi(line.c_str() + 20);
+        if (max < 1 || max > AT_LINKS)
+            return error(NULL, now);
+        _maxConn = max;
+        ok(now);
+    }
+    else if (startsWith(line, "AT+CIPSERVER=")) {
+        if (line[13] == '0') {
+            if (_port != 0)
+                _network->unlisten();
+            _port = 0;
+            return ok(now);
+        }
+        size_t comma = line.find(',');
+        unsigned int port = (comma == std::string::npos) ? 333 : atoi(line.c_str() + comma + 1);
+        if (!_mux || port == 0)
+            return error(NULL, now);
+        if (_port == port)
+            return reply("no change\r\n\r\nOK\r\n", now, timing.reply);
+        if (_port != 0)
+            _network->unlisten();
+        _port = 0;
+        if (!_network->listen(port))
+            return error(NULL, now);
+        _port = port;
+        ok(now);
+    }
+    else if (startsWith(line, "AT+CIPSTART=")) {
+        cipstart(line.substr(12), now);
+    }
+    else if (startsWith(line, "AT+CIPCLOSE")) {
+        cipclose(line.substr(11), now);
+    }
+    else if (startsWith(line, "AT+CIPSEND")) {
+        cipsend(line.substr(10), now);
+    }
+    else if (startsWith(line, "AT+CIPMODE=")) {
+        bool transparent = (line[11] == '1');
+        if (transparent && (_mux || _port != 0))
+            return error(NULL, now);
+        _transparentMode = transparent;
+        ok(now);
+    }
+    else if (startsWith(line, "AT+CIPRECVMODE=")) {
+        _passive = (line[15] == '1');
+        ok(now);
+    }
+    else if (startsWith(line, "AT+CIPRECVDATA=")) {
+        ciprecvdata(line.substr(15), now);
+    }
+    else {
+        error(NULL, now);
+    }
+}
+
+
+// Reply after all previous replies, at least delay after now
+void ATEmulator::reply(const std::string & data, unsigned long long now, unsigned long delay) {
+    unsigned long long at = now + delay;
+    if (at < _lastReply)
+        at = _lastReply;
+    _lastReply = at;
+    Reply r = { at, data };
+    _replies.push_back(r);
+}
+
+
+void ATEmulator::error(const char * reason, unsigned long long now) {
+    stats.errors++;
+    std::string message = (reason != NULL) ? std::string(reason) + "\r\n" : std::string();
+    reply(message + "\r\nERROR\r\n", now, timing.reply);
+}
+
+
+/**
+ * @brief Unsolicited message - it is not interleaved with a command being received or answered.
+ */
+void ATEmulator::notify(const std::string & data, unsigned long long now) {
+    if (busy())
+        _deferred += data;
+    else
+        reply(data, now, 0);
+}
+
+
+void ATEmulator::flushDeferred(unsigned long long now) {
+    if (_deferred.empty())
+        return;
+    reply(_deferred, now, 0);
+    _deferred.clear();
+}
+
+
+bool ATEmulator::busy() {
+    return !_line.empty() || _sendLink >= 0 || _joinReply || _bootAt != 0 || _restartAt != 0;
+}
+
+
+// AT+CWJAP="ssid","pass" - answered when the join is done, see joined()
+void ATEmulator::join(const std::string & args, bool save, unsigned long long now) {
+    if (_mode == 2)
+        return error(NULL, now);
+    size_t start = args.find('"');
+    size_t end = (start == std::string::npos) ? start : args.find('"', start + 1);
+    if (end == std::string::npos || end == start + 1)
+        return reply("+CWJAP:1\r\n\r\nFAIL\r\n", now, timing.reply);
+    std::string message;
+    if (_joined) {
+        _joined = false;
+        message = "WIFI DISCONNECT\r\n";
+        for (int i = 0; i < AT_LINKS; i++) {
+            if (_links[i].open) {
+                closeLink(i);
+                message += number(i) + ",CLOSED\r\n";
+            }
+        }
+        reply(message, now, timing.reply);
+    }
+    _ssid = args.substr(start + 1, end - start - 1);
+    if (save)
+        _savedSSID = _ssid;
+    _joinAt = now + timing.join;
+    _joinReply = true;
+}
+
+
+void ATEmulator::joined(unsigned long long now) {
+    if (!_apAvailable) {
+        if (_joinReply) {
+            _joinReply = false;
+            reply("+CWJAP:3\r\n\r\nFAIL\r\n", now, 0);
+        }
+        else if (_autoConnect && !_ssid.empty()) {
+            _joinAt = now + timing.join;
+        }
+        return;
+    }
+    _joined = true;
+    reply(_joinReply ? "WIFI CONNECTED\r\nWIFI GOT IP\r\n\r\nOK\r\n" : "WIFI CONNECTED\r\nWIFI GOT IP\r\n", now, 0);
+    _joinReply = false;
+}
+
+
+// AT+CIPSTART=<link>,"TCP","host",port or "TCP","host",port in single connection mode
+void ATEmulator::cipstart(const std::string & args, unsigned long long now) {
+    int link = 0;
+    char type[8];
+    char host[64];
+    unsigned int port;
+    int n = _mux ? sscanf(args.c_str(), "%d,\"%7[^\"]\",\"%63[^\"]\",%u", &link, type, host, &port)
+                 : sscanf(args.c_str(), "\"%7[^\"]\",\"%63[^\"]\",%u", type, host, &port) + 1;
+    if (n != 4 || link < 0 || link >= AT_LINKS)
+        return error(NULL, now);
+    if (!_joined)
+        return error("no ip", now);
+    if (_links[link].open)
+        return error("ALREADY CONNECTED", now);
+    std::string prefix = _mux ? number(link) + "," : std::string();
+    if (!_network->open(link, strcmp(type, "UDP") == 0, host, port))
+        return error((prefix + "CLOSED").c_str(), now);
+    _links[link].open = true;
+    _links[link].server = false;
+    reply(prefix + "CONNECT\r\n\r\nOK\r\n", now, timing.reply);
+}
+
+
+// AT+CIPSEND=<link>,<len>, AT+CIPSEND=<len> or AT+CIPSEND (pass-through)
+void ATEmulator::cipsend(const std::string & args, unsigned long long now) {
+    if (args.empty()) {
+        if (_mux || !_transparentMode || !_links[0].open)
+            return error(NULL, now);
+        reply("\r\nOK\r\n\r\n>", now, timing.reply);
+        _transparent = true;
+        _sendData.clear();
+        return;
+    }
+    int link = 0;
+    int len = 0;
+    int n = _mux ? sscanf(args.c_str(), "=%d,%d", &link, &len) : sscanf(args.c_str(), "=%d", &len) + 1;
+    if (n != 2 || link < 0 || link >= AT_LINKS || len <= 0 || len > MAX_SEND)
+        return error(NULL, now);
+    if (!_links[link].open)
+        return error("link is not valid", now);
+    reply("\r\nOK\r\n> ", now, timing.reply);
+    _sendLink = link;
+    _sendLeft = len;
+    _sendData.clear();
+}
+
+
+// All data of AT+CIPSEND were received
+void ATEmulator::sendData(unsigned long long now) {
+    stats.sends++;
+    stats.sendBytes += _sendData.size();
+    if (_links[_sendLink].open)
+        _network->send(_sendLink, _sendData.data(), _sendData.size());
+    reply("\r\nRecv " + number(_sendData.size()) + " bytes\r\n", now, 0);
+    reply(_links[_sendLink].open ? "\r\nSEND OK\r\n" : "\r\nSEND FAIL\r\n", now, timing.send);
+    _sendLink = -1;
+    _sendData.clear();
+}
+
+
+void ATEmulator::cipclose(const std::string & args, unsigned long long now) {
+    int link = (args.size() > 1 && args[0] == '=') ? atoi(args.c_str() + 1) : 0;
+    if (_mux && link == AT_LINKS) {
+        // All links
+        std::string message;
+        for (int i = 0; i < AT_LINKS; i++) {
+            if (_links[i].open) {
+                closeLink(i);
+                message += number(i) + ",CLOSED\r\n";
+            }
+        }
+        return reply(message + "\r\nOK\r\n", now, timing.reply);
+    }
+    if (link < 0 || link >= AT_LINKS || !_links[link].open)
+        return error("UNLINK", now);
+    closeLink(link);
+    reply((_mux ? number(link) + "," : std::string()) + "CLOSED\r\n\r\nOK\r\n", now, timing.reply);
+}
+
+
+void ATEmulator::cipstatus(unsigned long long now) {
+    std::string links;
+    for (int i = 0; i < AT_LINKS; i++) {
+        if (_links[i].open) {
+            links += "+CIPSTATUS:" + number(i) + ",\"TCP\",\"192.168.1.2\",50000,"
+                    + number(_port) + "," + number(_links[i].server) + "\r\n";
+        }
+    }
+    char status = !_joined ? '5' : (links.empty() ? '2' : '3');
+    reply(std::string("STATUS:") + status + "\r\n" + links + "\r\nOK\r\n", now, timing.reply);
+}
+
+
+// AT+CIPRECVDATA=<link>,<len> - passive receive mode
+void ATEmulator::ciprecvdata(const std::string & args, unsigned long long now) {
+    int link = 0;
+    int len = 0;
+    if (sscanf(args.c_str(), "%d,%d", &link, &len) != 2 || link < 0 || link >= AT_LINKS || len <= 0)
+        return error(NULL, now);
+    std::string & buffer = _links[link].buffer;
+    if (!_passive || buffer.empty())
+        return error(NULL, now);
+    stats.pulls++;
+    size_t n = ((size_t)len < buffer.size()) ? len : buffer.size();
+    reply("+CIPRECVDATA," + number(n) + ":" + buffer.substr(0, n) + "\r\nOK\r\n", now, timing.reply);
+    buffer.erase(0, n);
+}
+
+
+void ATEmulator::closeLink(int link) {
+    _network->close(link);
+    _links[link].open = false;
+    _links[link].buffer.clear();
+}
+
+
+int ATEmulator::serverLinks() {
+    int count = 0;
+    for (int i = 0; i < AT_LINKS; i++) {
+        if (_links[i].open && _links[i].server)
+            count++;
+    }
+    return count;
+}
@@ -0,0 +1,151 @@
+/*
+ * Emulator of ESP8266 with AT firmware 1.x - the subset of AT commands used by the library.
+ * It knows nothing about time and transport: the owner feeds it with bytes of the board
+ * and events of the network, calls update() with the current time and takes its output.
+ * Pacing of the serial link is up to the owner (SimBoard, esp8266_emu).
+ */
+#ifndef AT_EMULATOR_H
+#define AT_EMULATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <string>
+
+#define AT_LINKS 5
+
+/**
+ * Network behind the emulator - connections of links are real sockets or simulated clients.
+ */
+class ATNetwork
+{
+public:
+    virtual ~ATNetwork() {}
+    // AT+CIPSERVER - accept() of the emulator is called for incoming connections
+    virtual bool listen(unsigned int port) = 0;
+    virtual void unlisten() = 0;
+    // AT+CIPSTART, false when the connection is refused
+    virtual bool open(int link, bool udp, const char * host, unsigned int port) = 0;
+    // Data of AT+CIPSEND (or of pass-through mode, link 0)
+    virtual void send(int link, const char * data, size_t len) = 0;
+    // AT+CIPCLOSE, reset of the module
+    virtual void close(int link) = 0;
+};
+
+// Timing of the module, microseconds
+struct ATTiming {
+    unsigned long reply = 300;     // end of command line to its reply
+    unsigned long send = 2000;     // last byte of AT+CIPSEND data to SEND OK
+    unsigned long join = 1500000;  // AT+CWJAP to WIFI GOT IP
+    unsigned long boot = 300000;   // reset to ready
+    unsigned long packing = 20000; // pause which ends a packet of pass-through mode
+};
+
+struct ATStats {
+    unsigned long commands;
+    unsigned long sends;       // AT+CIPSEND
+    unsigned long sendBytes;
+    unsigned long received;    // +IPD frames and notices
+    unsigned long pulls;       // AT+CIPRECVDATA
+    unsigned long errors;      // ERROR replies
+    unsigned long resets;
+};
+
+
+class ATEmulator
+{
+public:
+    ATEmulator(ATNetwork * network);
+
+    // Byte written by the board at time now
+    void input(uint8_t c, unsigned long long now);
+    // Runs timers due at now, moves due replies to output()
+    void update(unsigned long long now);
+    // Time of the next timer, ~0 when none
+    unsigned long long nextEvent();
+    // Bytes for the board - the owner erases what it has sent
+    std::string & output() { return _out; }
+
+    // Events of the network
+    int accept(unsigned long long now);
+    void received(int link, const char * data, size_t len, unsigned long long now);
+    void closed(int link, unsigned long long now);
+
+    // Reset pin - the module is held in reset while low
+    void setResetPin(bool high, unsigned long long now);
+    // Access Point goes away / comes back
+    void loseAP(unsigned long long now);
+    void findAP(unsigned long long now);
+
+    bool isPassive() { return _passive; }
+    size_t buffered(int link) { return _links[link].buffer.size(); }
+    ATTiming timing;
+    ATStats stats;
+private:
+    struct Link {
+        bool open;
+        bool server; // accepted by AT+CIPSERVER
+        std::string buffer; // passive mode
+    };
+    struct Reply {
+        unsigned long long at;
+        std::string data;
+    };
+
+    void clear();
+    void boot(unsigned long long now);
+    void command(const std::string & line, unsigned long long now);
+    void deliver(unsigned long long now);
+    void reply(const std::string & data, unsigned long long now, unsigned long delay);
+    void ok(unsigned long long now) { reply("\r\nOK\r\n", now, timing.reply); }
+    void error(const char * reason, unsigned long long now);
+    void notify(const std::string & data, unsigned long long now);
+    void flushDeferred(unsigned long long now);
+    bool busy();
+    void join(const std::string & args, bool save, unsigned long long now);
+    void joined(unsigned long long now);
+    void cipstart(const std::string & args, unsigned long long now);
+    void cipsend(const std::string & args, unsigned long long now);
+    void cipclose(const std::string & args, unsigned long long now);
+    void cipstatus(unsigned long long now);
+    void ciprecvdata(const std::string & args, unsigned long long now);
+    void sendData(unsigned long long now);
+    void closeLink(int link);
+    int serverLinks();
+
+    ATNetwork * _network;
+    std::string _line;
+    std::string _out;
+    std::deque<Reply> _replies;
+    std::string _deferred; // unsolicited messages held while a command is in progress
+    unsigned long long _lastReply;
+
+    // Configuration
+    bool _echo;
+    int _mode;       // CWMODE, saved
+    bool _mux;
+    bool _passive;   // CIPRECVMODE
+    bool _transparentMode; // CIPMODE
+    bool _autoConnect;
+    std::string _savedSSID;
+    unsigned int _port; // 0 - no server
+    int _maxConn;
+
+    // State
+    bool _resetLow;
+    unsigned long long _restartAt; // AT+RST answered, restart at
+    unsigned long long _bootAt;    // 0 - booted
+    unsigned long long _joinAt;    // 0 - not joining
+    bool _joinReply;               // AT+CWJAP waits for the join
+    bool _apAvailable;
+    bool _joined;
+    std::string _ssid;
+    Link _links[AT_LINKS];
+    int _sendLink;                 // -1 - no AT+CIPSEND in progress
+    size_t _sendLeft;
+    std::string _sendData;
+    bool _transparent;             // pass-through session running
+    unsigned long long _packetAt;  // last byte of pass-through data
+};
+
+#endif
@@ -0,0 +1,196 @@
+/*
+ * Benchmark of the request path against the simulated ESP8266 (see sim.h).
+ *
+ *     ./build/bench [-b baud] [-n requests] [-p] [scenario ...]
+ *
+ * Scenarios: get, 404, large, concurrent, mixed (all by default). -p switches to passive receive mode.
+ * mixed - one client downloads /big (PRIORITY_LOW), two call /api (PRIORITY_HIGH); latency is
+ * reported per class as well. build/bench_budget2048 is the same with SEND_BUDGET=2048.
+ * build/bench_memory is built with ESP8266_MEMORY and prints the memory profile after each scenario.
+ * req/s and latency are in virtual time - serial link, replies of ESP8266 and waiting of the library.
+ * CPU is time of the host process per request - compare builds, not boards.
+ * SIM_TRACE=1 prints the serial traffic to stderr.
+ */
+#include "sim.h"
+#include "ESP8266_HTTP.h"
+#include <unistd.h>
+
+#if !ESP8266_METRICS
+#error "The benchmark requires ESP8266_METRICS enabled"
+#endif
+
+#define RX_PIN  4
+#define TX_PIN  6
+#define RST_PIN 5
+
+#define DEADLINE 600000000ULL // us of virtual time per scenario
+
+const char PROGMEM_PAGE[] PROGMEM = "HTTP/1.1 200 OK\r\nConnection: Closed\r\nContent-Type: text/html\r\n\r\n"
+        "<html><body><h1>ESP8266</h1><p>Hello from the host build.</p></body></html>";
+
+// 2 KB body - 32 lines of 64 bytes
+#define LINE "The quick brown fox jumps over the lazy dog - 0123456789abcdef\r\n"
+#define LINES4 LINE LINE LINE LINE
+#define LINES32 LINES4 LINES4 LINES4 LINES4 LINES4 LINES4 LINES4 LINES4
+const char PROGMEM_BIG[] PROGMEM = "HTTP/1.1 200 OK\r\nConnection: Closed\r\nContent-Type: text/plain\r\n"
+        "Content-Length: 2048\r\n\r\n" LINES32;
+
+const char PROGMEM_API[] PROGMEM = "HTTP/1.1 200 OK\r\nConnection: Closed\r\nContent-Type: application/json\r\n\r\n"
+        "{\"state\":1}";
+
+#define CLASS_API 0
+#define CLASS_BULK 1
+#define API_THINK 500000 // us between requests of an API client
+
+#define REQUEST(path) "GET " path " HTTP/1.1\r\nHost: esp8266\r\nUser-Agent: bench\r\nAccept: */*\r\n\r\n"
+
+struct Scenario {
+    const char * name;
+    void (*load)(SimBoard & board);
+    const char * classes[SIM_CLASSES]; // names of latency classes reported separately
+};
+
+
+static void sendPage(ESP8266_HTTP & server, Route * route, char channel) {
+    server.send_PROGMEM(PROGMEM_PAGE);
+    server.send(channel);
+    server.closeConnection(channel);
+}
+
+
+static void sendBig(ESP8266_HTTP & server, Route * route, char channel) {
+    server.streamResponse_PROGMEM(route, PROGMEM_BIG);
+}
+
+
+static void sendApi(ESP8266_HTTP & server, Route * route, char channel) {
+    server.streamResponse_PROGMEM(route, PROGMEM_API);
+}
+
+
+static void loadGet(SimBoard & board) {
+    board.addClient(REQUEST("/"), 200);
+}
+
+
+static void load404(SimBoard & board) {
+    board.addClient(REQUEST("/missing"), 404);
+}
+
+
+static void loadLarge(SimBoard & board) {
+    board.addClient(REQUEST("/big"), 200, 0, 0, strlen_P(PROGMEM_BIG));
+}
+
+
+static void loadConcurrent(SimBoard & board) {
+    for (byte i = 0; i < MAX_CONNECTIONS; i++)
+        board.addClient(REQUEST("/"), 200);
+}
+
+
+static void loadMixed(SimBoard & board) {
+    board.addClient(REQUEST("/big"), 200, CLASS_BULK, 0, strlen_P(PROGMEM_BIG));
+    for (byte i = 1; i < MAX_CONNECTIONS; i++)
+        board.addClient(REQUEST("/api"), 200, CLASS_API, API_THINK);
+}
+
+
+static const Scenario scenarios[] = {
+    { "get", loadGet, { NULL } },
+    { "404", load404, { NULL } },
+    { "large", loadLarge, { NULL } },
+    { "concurrent", loadConcurrent, { NULL } },
+    { "mixed", loadMixed, { "api", "bulk" } },
+};
+#define SCENARIOS (sizeof(scenarios) / sizeof(scenarios[0]))
+
+
+static bool run(const Scenario & scenario, long baud, unsigned long requests, bool passive) {
+    SimBoard board;
+    if (getenv("SIM_TRACE") != NULL)
+        board.trace = stderr;
+    host_attach(&board);
+    board.setResetPin(RST_PIN);
+    ESP8266_HTTP * server = new ESP8266_HTTP(RX_PIN, TX_PIN, RST_PIN, baud);
+    server->setPassiveMode(passive);
+    byte error = server->start("bench", "password", "80");
+    if (error != 0) {
+        fprintf(stderr, "%s: start() failed (%d)\n", scenario.name, error);
+        delete server;
+        host_attach(NULL);
+        return false;
+    }
+    server->registerRoute(GET, "/", sendPage);
+    server->registerRoute(GET, "/big", sendBig, PRIORITY_LOW);
+    server->registerRoute(GET, "/api", sendApi, PRIORITY_HIGH);
+
+    server->resetMetrics();
+#if ESP8266_MEMORY
+    server->resetMemoryProfile();
+#endif
+    board.resetCounters();
+    scenario.load(board);
+    board.setBudget(requests);
+    unsigned long long start = board.now();
+    unsigned long long cpu = host_cpu_micros();
+    while (!board.done() && board.now() - start < DEADLINE)
+        server->update();
+    cpu = host_cpu_micros() - cpu;
+    double seconds = (board.now() - start) / 1e6;
+
+    Metrics * m = server->getMetrics();
+    std::vector<unsigned long> all;
+    for (int i = 0; i < SIM_CLASSES; i++)
+        all.insert(all.end(), board.latency[i].begin(), board.latency[i].end());
+    unsigned long served = board.served;
+    printf("%-11s %7ld %5lu %7.1f %8.1f %8.1f %9llu %9lu %7u %7u %6u %8lu %6lu\n",
+            scenario.name, baud, served, served / seconds,
+            SimBoard::percentile(all, 50) / 1000.0, SimBoard::percentile(all, 99) / 1000.0,
+            served ? cpu / served : 0ULL, server->busyMicrosPerRequest(),
+            (unsigned int)m->peakRxBufferSize, (unsigned int)m->peakTxBufferSize, (unsigned int)board.peakRx,
+            board.overruns, board.failed + board.timeouts);
+    for (int i = 0; i < SIM_CLASSES && scenario.classes[i] != NULL; i++) {
+        std::vector<unsigned long> & latency = board.latency[i];
+        printf("  %-9s %7s %5u %7.1f %8.1f %8.1f\n", scenario.classes[i], "", (unsigned int)latency.size(),
+                latency.size() / seconds, SimBoard::percentile(latency, 50) / 1000.0,
+                SimBoard::percentile(latency, 99) / 1000.0);
+    }
+#if ESP8266_MEMORY
+    server->printMemoryProfile(Serial);
+#endif
+    delete server;
+    host_attach(NULL);
+    return board.failed + board.timeouts == 0;
+}
+
+
+int main(int argc, char ** argv) {
+    long baud = 9600;
+    unsigned long requests = 100;
+    bool passive = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "b:n:p")) != -1) {
+        switch (opt) {
+            case 'b': baud = atol(optarg); break;
+            case 'n': requests = atol(optarg); break;
+            case 'p': passive = true; break;
+            default:
+                fprintf(stderr, "usage: %s [-b baud] [-n requests] [-p] [scenario ...]\n", argv[0]);
+                return 2;
+        }
+    }
+    printf("MAX_CONNECTIONS=%d MAX_RX_BUFFER_SIZE=%d MAX_TX_BUFFER_SIZE=%d SEND_BUDGET=%d, %s mode\n",
+            MAX_CONNECTIONS, MAX_RX_BUFFER_SIZE, MAX_TX_BUFFER_SIZE, SEND_BUDGET, passive ? "passive" : "active");
+    printf("%-11s %7s %5s %7s %8s %8s %9s %9s %7s %7s %6s %8s %6s\n", "scenario", "baud", "req", "req/s",
+            "p50 ms", "p99 ms", "cpu us/r", "busy us/r", "peak rx", "peak tx", "serial", "overruns", "failed");
+    bool success = true;
+    for (size_t i = 0; i < SCENARIOS; i++) {
+        bool selected = (optind == argc);
+        for (int a = optind; a < argc; a++)
+            selected |= (strcmp(argv[a], scenarios[i].name) == 0);
+        if (selected)
+            success &= run(scenarios[i], baud, requests, passive);
+    }
+    return success ? 0 : 1;
+}
@@ -0,0 +1,182 @@
+/*
+ * Export throughput of ESP8266_SampleStore against the simulated ESP8266 (see sim.h):
+ * 1000, 5000 and 10000 samples exported as CSV, packed binary and CSV downsampled by 10.
+ * Built with SAMPLE_STORE_CAPACITY=10000 as build/bench_history and with
+ * SAMPLE_DELTA_ENCODING as well as build/bench_history_delta.
+ *
+ *     ./build/bench_history [-b baud] [-p]
+ *
+ * B/s and samples/s are in virtual time - bound by the serial link and the AT+CIPSEND
+ * per TX_BUFFER. CPU is time of the host process per export, append is host time per sample -
+ * compare encodings, not boards. Every exported point is checked against the appended samples.
+ */
+#include "sim.h"
+#include "ESP8266_HTTP.h"
+#include "ESP8266_SampleStore.h"
+#include <time.h>
+#include <unistd.h>
+#include <string>
+
+#if !ESP8266_TASKS
+#error "The benchmark requires ESP8266_TASKS enabled"
+#endif
+
+#if SAMPLE_STORE_CAPACITY < 10000
+#error "The benchmark requires SAMPLE_STORE_CAPACITY of at least 10000"
+#endif
+
+#define RX_PIN  4
+#define TX_PIN  6
+#define RST_PIN 5
+
+#define PERIOD 1 // s
+#define DEADLINE 600000000ULL // us of virtual time per export
+
+#define REQUEST(path) "GET " path " HTTP/1.1\r\nHost: esp8266\r\nUser-Agent: bench\r\nAccept: */*\r\n\r\n"
+
+struct Export {
+    const char * name;
+    const char * request;
+    byte step;   // samples per point
+    bool binary;
+};
+
+static const Export exports[] = {
+    { "csv", REQUEST("/history"), 1, false },
+    { "bin", REQUEST("/history?format=bin"), 1, true },
+    { "csv/10", REQUEST("/history?step=10"), 10, false },
+};
+#define EXPORTS (sizeof(exports) / sizeof(exports[0]))
+
+static const unsigned int sizes[] = { 1000, 5000, 10000 };
+#define SIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+
+// Triangle 100 - 500, differences fit into SAMPLE_DELTA_ENCODING
+static int sample(unsigned int i) {
+    unsigned int t = i % 800;
+    return 100 + ((t < 400) ? t : 800 - t);
+}
+
+
+static unsigned long long clockNs() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+
+// Compares the body with the points expected from count samples, the newest one at time newest
+static bool check(const std::string & response, const Export & e, unsigned int count, unsigned long newest) {
+    size_t body = response.find("\r\n\r\n");
+    if (response.compare(0, 12, "HTTP/1.1 200") != 0 || body == std::string::npos)
+        return false;
+    body += 4;
+    if (!e.binary) {
+        if (response.compare(body, 11, "time,value\n") != 0)
+            return false;
+        body += 11;
+    }
+    std::string expected;
+    for (unsigned int i = 0; i < count; i += e.step) {
+        unsigned long time = newest - (count - 1 - i) * PERIOD;
+        long sum = 0;
+        byte n = 0;
+        for (; n < e.step && i + n < count; n++)
+            sum += sample(i + n);
+        int mean = sum / n;
+        if (e.binary) {
+            for (byte b = 0; b < 4; b++)
+                expected += (char)((time >> (8 * b)) & 0xFF);
+            expected += (char)(mean & 0xFF);
+            expected += (char)((mean >> 8) & 0xFF);
+        }
+        else {
+            char point[24];
+            snprintf(point, sizeof(point), "%lu,%d\n", time, mean);
+            expected += point;
+        }
+    }
+    return response.compare(body, std::string::npos, expected) == 0;
+}
+
+
+static bool run(unsigned int count, long baud, bool passive) {
+    SimBoard board;
+    if (getenv("SIM_TRACE") != NULL)
+        board.trace = stderr;
+    board.clientTimeout = DEADLINE;
+    host_attach(&board);
+    board.setResetPin(RST_PIN);
+    ESP8266_HTTP * server = new ESP8266_HTTP(RX_PIN, TX_PIN, RST_PIN, baud);
+    server->setPassiveMode(passive);
+    byte error = server->start("bench", "password", "80");
+    if (error != 0) {
+        fprintf(stderr, "%u samples: start() failed (%d)\n", count, error);
+        delete server;
+        host_attach(NULL);
+        return false;
+    }
+    ESP8266_SampleStore * store = new ESP8266_SampleStore(PERIOD);
+    store->registerExport(*server, "/history");
+
+    // Samples of the last count seconds
+    board.advance(count * PERIOD * 1000000ULL);
+    unsigned long long ns = clockNs();
+    for (unsigned int i = 0; i < count; i++)
+        store->append(sample(i));
+    ns = clockNs() - ns;
+    // Health probe of the supervisor after the idle time - a request arriving meanwhile is lost in active mode
+    unsigned long long idle = board.now();
+    while (board.now() - idle < 100000)
+        server->update();
+
+    bool success = true;
+    for (size_t i = 0; i < EXPORTS; i++) {
+        const Export & e = exports[i];
+        board.resetCounters();
+        board.removeClients();
+        board.addClient(e.request, 200);
+        board.setBudget(1);
+        unsigned long long start = board.now();
+        unsigned long long cpu = host_cpu_micros();
+        while (!board.done() && board.now() - start < DEADLINE)
+            server->update();
+        cpu = host_cpu_micros() - cpu;
+        double seconds = (board.now() - start) / 1e6;
+
+        bool valid = board.served == 1 && check(board.lastResponse, e, count, store->newest());
+        success &= valid;
+        printf("%6u %-7s %8lu %8.1f %8.0f %9.0f %8.1f %9.1f %9.1f  %s\n", count, e.name,
+                (unsigned long)board.bytes, seconds, board.bytes / seconds, count / seconds,
+                cpu / 1000.0, (double)cpu * 1000 / count, (double)ns / count, valid ? "ok" : "FAIL");
+    }
+    delete store;
+    delete server;
+    host_attach(NULL);
+    return success;
+}
+
+
+int main(int argc, char ** argv) {
+    long baud = 9600;
+    bool passive = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "b:p")) != -1) {
+        switch (opt) {
+            case 'b': baud = atol(optarg); break;
+            case 'p': passive = true; break;
+            default:
+                fprintf(stderr, "usage: %s [-b baud] [-p]\n", argv[0]);
+                return 2;
+        }
+    }
+    printf("SAMPLE_STORE_CAPACITY=%d SAMPLE_DELTA_ENCODING=%d MAX_TX_BUFFER_SIZE=%d, %ld baud, %s mode\n",
+            SAMPLE_STORE_CAPACITY, SAMPLE_DELTA_ENCODING, MAX_TX_BUFFER_SIZE, baud, passive ? "passive" : "active");
+    printf("%6s %-7s %8s %8s %8s %9s %8s %9s %9s  %s\n", "samples", "format", "bytes", "s", "B/s",
+            "samples/s", "cpu ms", "ns/sample", "append ns", "check");
+    bool success = true;
+    for (size_t i = 0; i < SIZES; i++)
+        success &= run(sizes[i], baud, passive);
+    return success ? 0 : 1;
+}
@@ -0,0 +1,347 @@
+/*
+ * ESP8266 with AT firmware 1.x behind a pseudo terminal, links are real sockets on 127.0.0.1.
+ * A host build of a sketch (see sketch.cpp) talks to it over the tty, curl or wrk talk to
+ * its server:
+ *
+ *     ./build/esp8266_emu [-b baud] [-p port] [-l] [-v]
+ *
+ * -b  speed of the serial link (9600), bytes for the board are paced by it
+ * -p  port of AT+CIPSERVER on the host (e. g. 8080 instead of 80 without root)
+ * -l  AT+CIPSTART connects to 127.0.0.1 whatever the host - a collector stand-in runs locally
+ * -v  prints the serial traffic line by line to stderr
+ *
+ * The reset pin of ESP8266 is a FIFO - the board writes '0' (low) and '1' (high) into it.
+ * Ctrl+C prints statistics of the module.
+ */
+#include "at_emulator.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <string>
+
+#define SEGMENT 1460          // bytes received at once - one TCP segment
+#define MAX_BUFFERED 2920     // passive mode: the module stops reading the socket
+#define MAX_QUEUED 4096       // active mode: bytes waiting for the serial link
+
+static volatile sig_atomic_t stop = 0;
+
+
+static void onSignal(int) {
+    stop = 1;
+}
+
+
+static unsigned long long clockNs() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+
+class PtyNetwork : public ATNetwork
+{
+public:
+    PtyNetwork() : port(0), loopback(false), _listen(-1) {
+        for (int i = 0; i < AT_LINKS; i++) {
+            links[i] = -1;
+            udp[i] = false;
+        }
+    }
+
+    bool listen(unsigned int atPort) {
+        unlisten();
+        unsigned int p = port ? port : atPort;
+        _listen = socket(AF_INET, SOCK_STREAM, 0);
+        int on = 1;
+        setsockopt(_listen, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(p);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(_listen, (struct sockaddr *)&addr, sizeof(addr)) != 0 || ::listen(_listen, 8) != 0) {
+            fprintf(stderr, "port %u: %s\n", p, strerror(errno));
+            ::close(_listen);
+            _listen = -1;
+            return false;
+        }
+        printf("server: http://127.0.0.1:%u/\n", p);
+        fflush(stdout);
+        return true;
+    }
+
+    void unlisten() {
+        if (_listen >= 0)
+            ::close(_listen);
+        _listen = -1;
+    }
+
+    bool open(int link, bool isUdp, const char * host, unsigned int remotePort) {
+        char service[8];
+        snprintf(service, sizeof(service), "%u", remotePort);
+        struct addrinfo hints, * res;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = isUdp ? SOCK_DGRAM : SOCK_STREAM;
+        if (getaddrinfo(loopback ? "127.0.0.1" : host, service, &hints, &res) != 0)
+            return false;
+        int fd = socket(res->ai_family, res->ai_socktype, 0);
+        bool connected = (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) == 0);
+        freeaddrinfo(res);
+        if (!connected) {
+            if (fd >= 0)
+                ::close(fd);
+            return false;
+        }
+        links[link] = fd;
+        udp[link] = isUdp;
+        return true;
+    }
+
+    void send(int link, const char * data, size_t len) {
+        if (links[link] >= 0)
+            ::send(links[link], data, len, MSG_NOSIGNAL);
+    }
+
+    void close(int link) {
+        if (links[link] >= 0)
+            ::close(links[link]);
+        links[link] = -1;
+    }
+
+    int accept() {
+        int fd = ::accept(_listen, NULL, NULL);
+        if (fd >= 0) {
+            int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        }
+        return fd;
+    }
+
+    int listening() { return _listen; }
+
+    unsigned int port; // 0 - port of AT+CIPSERVER
+    bool loopback;     // AT+CIPSTART to 127.0.0.1
+    int links[AT_LINKS];
+    bool udp[AT_LINKS];
+private:
+    int _listen;
+};
+
+
+static void traceByte(std::string & line, char direction, unsigned char c) {
+    if (c == '\n') {
+        fprintf(stderr, "%c %s\n", direction, line.c_str());
+        line.clear();
+    }
+    else if (c == '\r') {
+        line += "\\r";
+    }
+    else if (c < ' ' || c > '~') {
+        char hex[8];
+        snprintf(hex, sizeof(hex), "\\x%02x", c);
+        line += hex;
+    }
+    else {
+        line += (char)c;
+    }
+}
+
+
+static int openPty() {
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+        return -1;
+    fcntl(master, F_SETFL, O_NONBLOCK);
+    return master;
+}
+
+
+int main(int argc, char ** argv) {
+    long baud = 9600;
+    bool verbose = false;
+    PtyNetwork network;
+    int opt;
+    while ((opt = getopt(argc, argv, "b:p:lv")) != -1) {
+        switch (opt) {
+            case 'b': baud = atol(optarg); break;
+            case 'p': network.port = atoi(optarg); break;
+            case 'l': network.loopback = true; break;
+            case 'v': verbose = true; break;
+            default:
+                fprintf(stderr, "usage: %s [-b baud] [-p port] [-l] [-v]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (baud <= 0) {
+        fprintf(stderr, "invalid baud rate\n");
+        return 2;
+    }
+
+    int master = openPty();
+    if (master < 0) {
+        perror("pty");
+        return 1;
+    }
+    // Raw line, kept open so the board may come and go
+    const char * tty = ptsname(master);
+    int slave = ::open(tty, O_RDWR | O_NOCTTY);
+    struct termios t;
+    tcgetattr(slave, &t);
+    cfmakeraw(&t);
+    tcsetattr(slave, TCSANOW, &t);
+
+    char fifo[64];
+    snprintf(fifo, sizeof(fifo), "/tmp/esp8266_emu.%d.rst", (int)getpid());
+    if (mkfifo(fifo, 0600) != 0) {
+        perror(fifo);
+        return 1;
+    }
+    int reset = ::open(fifo, O_RDONLY | O_NONBLOCK);
+    // No EOF while no board holds the pin
+    int resetHold = ::open(fifo, O_WRONLY);
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    printf("ESP8266 emulator at %ld baud\n", baud);
+    printf("export ESP8266_TTY=%s ESP8266_RST=%s\n", tty, fifo);
+    fflush(stdout);
+
+    ATEmulator esp(&network);
+    unsigned long long start = clockNs();
+    unsigned long long byteNs = 10000000000ULL / baud; // start bit, 8 data bits, stop bit
+    unsigned long long lineFreeAt = 0; // end of the last byte sent to the board
+    bool idle = true;
+    std::string traceIn, traceOut;
+
+    while (!stop) {
+        unsigned long long ns = clockNs() - start;
+        unsigned long long now = ns / 1000;
+        esp.update(now);
+
+        // Serial link to the board
+        std::string & out = esp.output();
+        if (idle && !out.empty() && lineFreeAt < ns)
+            lineFreeAt = ns;
+        size_t due = 0;
+        while (due < out.size() && lineFreeAt + byteNs <= ns) {
+            lineFreeAt += byteNs;
+            due++;
+        }
+        if (due > 0) {
+            // The board flushes what it finds on the tty when it starts
+            if (::write(master, out.data(), due) < 0 && errno != EAGAIN)
+                perror("tty");
+            for (ssize_t i = 0; verbose && i < (ssize_t)due; i++)
+                traceByte(traceIn, '<', out[i]);
+            out.erase(0, due);
+        }
+        idle = out.empty();
+
+        // Waiting for the next byte, timer of the module, board, pin and sockets
+        unsigned long long wait = 100000000ULL;
+        if (!out.empty())
+            wait = lineFreeAt + byteNs - ns;
+        unsigned long long event = esp.nextEvent();
+        if (event != ~0ULL)
+            wait = (event * 1000 > ns) ? (event * 1000 - ns < wait ? event * 1000 - ns : wait) : 0;
+
+        struct pollfd fds[3 + AT_LINKS];
+        int links[3 + AT_LINKS];
+        nfds_t count = 0;
+        fds[count].fd = master;
+        fds[count++].events = POLLIN;
+        fds[count].fd = reset;
+        fds[count++].events = POLLIN;
+        if (network.listening() >= 0) {
+            fds[count].fd = network.listening();
+            fds[count++].events = POLLIN;
+        }
+        for (int i = 0; i < AT_LINKS; i++) {
+            if (network.links[i] < 0)
+                continue;
+            bool full = esp.isPassive() ? esp.buffered(i) >= MAX_BUFFERED : out.size() >= MAX_QUEUED;
+            links[count] = i;
+            fds[count].fd = network.links[i];
+            fds[count++].events = full ? 0 : POLLIN;
+        }
+        struct timespec timeout;
+        timeout.tv_sec = wait / 1000000000ULL;
+        timeout.tv_nsec = wait % 1000000000ULL;
+        if (ppoll(fds, count, &timeout, NULL) <= 0)
+            continue;
+        now = (clockNs() - start) / 1000;
+
+        for (nfds_t f = 0; f < count; f++) {
+            if (fds[f].revents == 0)
+                continue;
+            if (fds[f].fd == master) {
+                unsigned char buf[256];
+                ssize_t n = ::read(master, buf, sizeof(buf));
+                for (ssize_t i = 0; i < n; i++) {
+                    if (verbose)
+                        traceByte(traceOut, '>', buf[i]);
+                    esp.input(buf[i], now);
+                }
+            }
+            else if (fds[f].fd == reset) {
+                char buf[16];
+                ssize_t n = ::read(reset, buf, sizeof(buf));
+                for (ssize_t i = 0; i < n; i++) {
+                    if (buf[i] == '0' || buf[i] == '1')
+                        esp.setResetPin(buf[i] == '1', now);
+                }
+            }
+            else if (fds[f].fd == network.listening()) {
+                int fd = network.accept();
+                if (fd < 0)
+                    continue;
+                int link = esp.accept(now);
+                if (link < 0) {
+                    // No free link - the module closes the connection at once
+                    ::close(fd);
+                    continue;
+                }
+                network.links[link] = fd;
+                network.udp[link] = false;
+            }
+            else {
+                int link = links[f];
+                if (network.links[link] != fds[f].fd)
+                    continue; // closed meanwhile
+                char buf[SEGMENT];
+                ssize_t n = recv(fds[f].fd, buf, sizeof(buf), 0);
+                if (n > 0) {
+                    esp.received(link, buf, n, now);
+                }
+                else if (n == 0 && !network.udp[link]) {
+                    network.close(link);
+                    esp.closed(link, now);
+                }
+            }
+        }
+    }
+
+    printf("\ncommands %lu, AT+CIPSEND %lu (%lu B), received %lu, AT+CIPRECVDATA %lu, errors %lu, resets %lu\n",
+            esp.stats.commands, esp.stats.sends, esp.stats.sendBytes, esp.stats.received,
+            esp.stats.pulls, esp.stats.errors, esp.stats.resets);
+    ::close(resetHold);
+    ::close(reset);
+    unlink(fifo);
+    ::close(slave);
+    ::close(master);
+    return 0;
+}
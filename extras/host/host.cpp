@@ -0,0 +1,289 @@
+#include "host.h"
+#include "SoftwareSerial.h"
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PINS 20
+
+
+// Board without ESP8266 - real clock, silent serial link
+class NullBoard : public HostBoard
+{
+public:
+    unsigned long long now() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        unsigned long long us = ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+        if (_start == 0)
+            _start = us;
+        return us - _start;
+    }
+    void sleep(unsigned long us) { usleep(us); }
+    int available() { return 0; }
+    int read() { return -1; }
+    int peek() { return -1; }
+    void write(uint8_t /* c */) {}
+private:
+    unsigned long long _start = 0;
+};
+
+static NullBoard nullBoard;
+static HostBoard * board = &nullBoard;
+static uint8_t pins[PINS];
+static int analog[PINS];
+HardwareSerial Serial;
+
+
+void host_attach(HostBoard * b) {
+    board = (b != NULL) ? b : &nullBoard;
+}
+
+
+HostBoard * host_board() {
+    return board;
+}
+
+
+void host_set_analog(uint8_t pin, int value) {
+    if (pin < PINS)
+        analog[pin] = value + 1; // 0 means not set
+}
+
+
+unsigned long long host_cpu_micros() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+
+/***************************************
+ * --------- ARDUINO FUNCTIONS ------- *
+ ***************************************/
+unsigned long millis() {
+    return (unsigned long)(board->now() / 1000);
+}
+
+
+unsigned long micros() {
+    return (unsigned long)board->now();
+}
+
+
+void delay(unsigned long ms) {
+    board->sleep(ms * 1000);
+}
+
+
+void delayMicroseconds(unsigned int us) {
+    board->sleep(us);
+}
+
+
+void pinMode(uint8_t /* pin */, uint8_t /* mode */) {}
+
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    if (pin < PINS)
+        pins[pin] = value;
+    board->pinWritten(pin, value);
+}
+
+
+int digitalRead(uint8_t pin) {
+    return (pin < PINS) ? pins[pin] : LOW;
+}
+
+
+int analogRead(uint8_t pin) {
+    if (pin < PINS && analog[pin] != 0)
+        return analog[pin] - 1;
+    return 512;
+}
+
+
+static char * format(unsigned long value, bool negative, char * buf, int radix) {
+    char tmp[66];
+    int n = 0;
+    do {
+        int digit = value % radix;
+        tmp[n++] = (digit < 10) ? '0' + digit : 'a' + digit - 10;
+        value /= radix;
+    } while (value > 0);
+    char * p = buf;
+    if (negative)
+        *p++ = '-';
+    while (n > 0)
+        *p++ = tmp[--n];
+    *p = '\0';
+    return buf;
+}
+
+
+char * itoa(int value, char * buf, int radix) {
+    return ltoa(value, buf, radix);
+}
+
+
+char * ltoa(long value, char * buf, int radix) {
+    // Like avr-libc only radix 10 is signed
+    if (radix == 10 && value < 0)
+        return format(-(unsigned long)value, true, buf, radix);
+    return format((unsigned long)value, false, buf, radix);
+}
+
+
+char * utoa(unsigned int value, char * buf, int radix) {
+    return format(value, false, buf, radix);
+}
+
+
+char * ultoa(unsigned long value, char * buf, int radix) {
+    return format(value, false, buf, radix);
+}
+
+
+char * dtostrf(double value, signed char width, unsigned char precision, char * buf) {
+    sprintf(buf, "%*.*f", width, precision, value);
+    return buf;
+}
+
+
+/***************************************
+ * ----------- PRINT, STREAM --------- *
+ ***************************************/
+size_t Print::write(const uint8_t * buf, size_t len) {
+    for (size_t i = 0; i < len; i++)
+        write(buf[i]);
+    return len;
+}
+
+
+size_t Print::print(long n, int base) {
+    char buf[66];
+    return write(ltoa(n, buf, base));
+}
+
+
+size_t Print::print(unsigned long n, int base) {
+    char buf[66];
+    return write(ultoa(n, buf, base));
+}
+
+
+size_t Print::print(double n, int digits) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", digits, n);
+    return write(buf);
+}
+
+
+int Stream::timedRead() {
+    unsigned long start = millis();
+    do {
+        int c = read();
+        if (c >= 0)
+            return c;
+    } while (millis() - start < _timeout);
+    return -1;
+}
+
+
+bool Stream::find(char * target) {
+    size_t len = strlen(target);
+    size_t matched = 0;
+    if (len == 0)
+        return true;
+    int c;
+    while ((c = timedRead()) >= 0) {
+        if (c == target[matched]) {
+            if (++matched == len)
+                return true;
+        }
+        else {
+            matched = (c == target[0]) ? 1 : 0;
+        }
+    }
+    return false;
+}
+
+
+size_t Stream::readBytes(char * buf, size_t len) {
+    size_t n = 0;
+    while (n < len) {
+        int c = timedRead();
+        if (c < 0)
+            break;
+        buf[n++] = c;
+    }
+    return n;
+}
+
+
+size_t Stream::readBytesUntil(char terminator, char * buf, size_t len) {
+    size_t n = 0;
+    while (n < len) {
+        int c = timedRead();
+        if (c < 0 || c == terminator)
+            break;
+        buf[n++] = c;
+    }
+    return n;
+}
+
+
+/***************************************
+ * ------------- SERIALS ------------- *
+ ***************************************/
+int HardwareSerial::available() {
+    struct pollfd fd = { 0, POLLIN, 0 };
+    return (poll(&fd, 1, 0) > 0 && (fd.revents & POLLIN)) ? 1 : 0;
+}
+
+
+int HardwareSerial::read() {
+    unsigned char c;
+    if (!available() || ::read(0, &c, 1) != 1)
+        return -1;
+    return c;
+}
+
+
+size_t HardwareSerial::write(uint8_t c) {
+    putchar(c);
+    if (c == '\n')
+        fflush(stdout);
+    return 1;
+}
+
+
+void SoftwareSerial::begin(long baud) {
+    board->begin(baud);
+}
+
+
+bool SoftwareSerial::overflow() {
+    return board->overflow();
+}
+
+
+int SoftwareSerial::available() {
+    return board->available();
+}
+
+
+int SoftwareSerial::read() {
+    return board->read();
+}
+
+
+int SoftwareSerial::peek() {
+    return board->peek();
+}
+
+
+size_t SoftwareSerial::write(uint8_t c) {
+    board->write(c);
+    return 1;
+}
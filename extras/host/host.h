@@ -0,0 +1,39 @@
+/*
+ * Arduino core of the host build. The board behind it (clock, serial link to ESP8266,
+ * reset pin of ESP8266) is chosen by host_attach():
+ * SimBoard (sim.h) - simulated ESP8266 in virtual time;
+ * TtyBoard (sketch.cpp) - real clock, ESP8266 emulator (esp8266_emu.cpp) behind a tty.
+ */
+#ifndef HOST_H
+#define HOST_H
+
+#include "Arduino.h"
+
+
+class HostBoard
+{
+public:
+    virtual ~HostBoard() {}
+    // Clock in microseconds since start
+    virtual unsigned long long now() = 0;
+    virtual void sleep(unsigned long us) = 0;
+    // Serial link to ESP8266 (SoftwareSerial)
+    virtual void begin(long /* baud */) {}
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual void write(uint8_t c) = 0;
+    virtual bool overflow() { return false; }
+    // Pin written by the sketch (e. g. reset of ESP8266)
+    virtual void pinWritten(uint8_t /* pin */, uint8_t /* value */) {}
+};
+
+void host_attach(HostBoard * board);
+HostBoard * host_board();
+
+// Value returned by analogRead() of the pin
+void host_set_analog(uint8_t pin, int value);
+// Process CPU time in microseconds (work of the host, not of the board)
+unsigned long long host_cpu_micros();
+
+#endif
@@ -0,0 +1,386 @@
+#include "sim.h"
+#include <algorithm>
+
+#define NEVER (~0ULL)
+
+
+SimBoard::SimBoard()
+    : esp(this)
+{
+    _ns = 0;
+    _overflow = false;
+    _inFlight = false;
+    _listening = false;
+    _budget = 0;
+    _resetPin = 0xFF;
+    _collector = false;
+    _keepAlive = true;
+    trace = NULL;
+    clientTimeout = SIM_CLIENT_TIMEOUT;
+    begin(9600);
+    resetCounters();
+}
+
+
+unsigned long long SimBoard::now() {
+    advanceTo(_ns + 1000);
+    return _ns / 1000;
+}
+
+
+void SimBoard::sleep(unsigned long us) {
+    advanceTo(_ns + us * 1000ULL);
+}
+
+
+void SimBoard::begin(long b) {
+    baud = b;
+    // Start bit, 8 data bits, stop bit
+    _byteNs = 10000000000ULL / baud;
+}
+
+
+int SimBoard::available() {
+    if (_rx.empty())
+        advanceTo(_ns + SIM_IDLE_STEP * 1000);
+    return _rx.size();
+}
+
+
+int SimBoard::read() {
+    if (_rx.empty())
+        advanceTo(_ns + SIM_IDLE_STEP * 1000);
+    if (_rx.empty())
+        return -1;
+    int c = _rx.front();
+    _rx.pop_front();
+    traceByte(_traceIn, '<', c);
+    return c;
+}
+
+
+int SimBoard::peek() {
+    if (_rx.empty())
+        advanceTo(_ns + SIM_IDLE_STEP * 1000);
+    return _rx.empty() ? -1 : _rx.front();
+}
+
+
+// SoftwareSerial sends with interrupts disabled - the board waits for the whole byte
+void SimBoard::write(uint8_t c) {
+    advanceTo(_ns + _byteNs);
+    traceByte(_traceOut, '>', c);
+    esp.input(c, _ns / 1000);
+    esp.update(_ns / 1000);
+    startByte();
+}
+
+
+bool SimBoard::overflow() {
+    bool o = _overflow;
+    _overflow = false;
+    return o;
+}
+
+
+void SimBoard::pinWritten(uint8_t pin, uint8_t value) {
+    if (pin == _resetPin)
+        esp.setResetPin(value == HIGH, _ns / 1000);
+}
+
+
+bool SimBoard::listen(unsigned int port) {
+    _listening = true;
+    return true;
+}
+
+
+void SimBoard::unlisten() {
+    _listening = false;
+}
+
+
+// Peers of outbound links accept everything
+bool SimBoard::open(int link, bool udp, const char * host, unsigned int port) {
+    outbound[link].clear();
+    opened++;
+    return true;
+}
+
+
+void SimBoard::send(int link, const char * data, size_t len) {
+    for (size_t i = 0; i < _clients.size(); i++) {
+        if (_clients[i].link == link) {
+            _clients[i].response.append(data, len);
+            return;
+        }
+    }
+    outbound[link].append(data, len);
+    if (_collector)
+        collect(link);
+}
+
+
+void SimBoard::close(int link) {
+    for (size_t i = 0; i < _clients.size(); i++) {
+        if (_clients[i].link != link)
+            continue;
+        SimClient & client = _clients[i];
+        int status = 0;
+        if (client.response.compare(0, 9, "HTTP/1.1 ") == 0)
+            status = atoi(client.response.c_str() + 9);
+        finish(client, status == client.expect && client.response.size() >= client.minBytes);
+        return;
+    }
+}
+
+
+/**
+ * @brief Adds client which starts now.
+ * @param request Whole HTTP request.
+ * @param expect HTTP status of the right response.
+ * @param cls Latency class of its requests.
+ * @param think Time in us between the response and the next request.
+ * @param minBytes Responses shorter than this fail.
+ */
+void SimBoard::addClient(const char * request, int expect, int cls, unsigned long think, size_t minBytes) {
+    SimClient client;
+    client.request = request;
+    client.expect = expect;
+    client.minBytes = minBytes;
+    client.cls = cls;
+    client.think = think;
+    client.link = -1;
+    client.nextAt = _ns / 1000;
+    client.sentAt = 0;
+    _clients.push_back(client);
+}
+
+
+// All requests of the budget were issued and answered
+bool SimBoard::done() {
+    if (issued < _budget)
+        return false;
+    for (size_t i = 0; i < _clients.size(); i++) {
+        if (_clients[i].link >= 0)
+            return false;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Answers POSTs on outbound links 1 ms after the whole request came.
+ * @param keepAlive false - answers with "Connection: close", so the board opens a new link for every POST.
+ */
+void SimBoard::setCollector(bool keepAlive) {
+    _collector = true;
+    _keepAlive = keepAlive;
+}
+
+
+// Takes complete requests out of outbound[link]
+void SimBoard::collect(int link) {
+    std::string & data = outbound[link];
+    while (1) {
+        size_t end = data.find("\r\n\r\n");
+        if (end == std::string::npos)
+            return;
+        size_t length = 0;
+        size_t pos = data.find("Content-Length:");
+        if (pos != std::string::npos && pos < end)
+            length = strtoul(data.c_str() + pos + 15, NULL, 10);
+        if (data.size() < end + 4 + length)
+            return;
+        posts++;
+        collected.append(data, end + 4, length);
+        data.erase(0, end + 4 + length);
+        Answer answer = { link, _ns / 1000 + 1000 };
+        _answers.push_back(answer);
+    }
+}
+
+
+void SimBoard::advance(unsigned long long us) {
+    advanceTo(_ns + us * 1000);
+}
+
+
+void SimBoard::resetCounters() {
+    for (int i = 0; i < SIM_CLASSES; i++)
+        latency[i].clear();
+    issued = 0;
+    served = 0;
+    failed = 0;
+    timeouts = 0;
+    refused = 0;
+    bytes = 0;
+    lastResponse.clear();
+    overruns = 0;
+    peakRx = 0;
+    opened = 0;
+    posts = 0;
+    collected.clear();
+}
+
+
+/**
+ * @return Value of the percentile (1 - 100), 0 when there are no values.
+ */
+unsigned long SimBoard::percentile(std::vector<unsigned long> & values, int p) {
+    if (values.empty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    size_t rank = (values.size() * p + 99) / 100;
+    return values[(rank > 0) ? rank - 1 : 0];
+}
+
+
+// Prints whole lines: '>' written by the board, '<' read by the board
+void SimBoard::traceByte(std::string & line, char direction, uint8_t c) {
+    if (trace == NULL)
+        return;
+    if (c == '\n') {
+        fprintf(trace, "%10.3f %c %s\n", _ns / 1e6, direction, line.c_str());
+        line.clear();
+    }
+    else if (c == '\r') {
+        line += "\\r";
+    }
+    else if (c < ' ' || c > '~') {
+        char hex[8];
+        snprintf(hex, sizeof(hex), "\\x%02x", c);
+        line += hex;
+    }
+    else {
+        line += (char)c;
+    }
+}
+
+
+// Processes deliveries of bytes, timers of ESP8266 and clients in time order
+void SimBoard::advanceTo(unsigned long long ns) {
+    while (1) {
+        unsigned long long next = _inFlight ? _byteAt : NEVER;
+        unsigned long long espAt = esp.nextEvent();
+        if (espAt != NEVER && espAt * 1000 < next)
+            next = espAt * 1000;
+        unsigned long long clientAt = nextClientEvent();
+        if (clientAt != NEVER && clientAt * 1000 < next)
+            next = clientAt * 1000;
+        if (next > ns)
+            break;
+        if (next > _ns)
+            _ns = next;
+        if (_inFlight && _byteAt <= _ns) {
+            _inFlight = false;
+            if (_rx.size() >= SIM_RX_BUFFER) {
+                overruns++;
+                _overflow = true;
+                if (trace != NULL)
+                    fprintf(trace, "%10.3f ! overrun\n", _ns / 1e6);
+            }
+            else {
+                _rx.push_back(_byte);
+                if (_rx.size() > peakRx)
+                    peakRx = _rx.size();
+            }
+        }
+        esp.update(_ns / 1000);
+        runClients();
+        startByte();
+    }
+    if (ns > _ns)
+        _ns = ns;
+}
+
+
+// Next byte from ESP8266 goes on the line
+void SimBoard::startByte() {
+    std::string & out = esp.output();
+    if (_inFlight || out.empty())
+        return;
+    _byte = out[0];
+    out.erase(0, 1);
+    _inFlight = true;
+    _byteAt = _ns + _byteNs;
+}
+
+
+unsigned long long SimBoard::nextClientEvent() {
+    unsigned long long next = NEVER;
+    for (size_t i = 0; i < _clients.size(); i++) {
+        SimClient & client = _clients[i];
+        unsigned long long at = NEVER;
+        if (client.link >= 0)
+            at = client.sentAt + clientTimeout;
+        else if (issued < _budget && _listening)
+            at = client.nextAt;
+        if (at < next)
+            next = at;
+    }
+    if (!_answers.empty() && _answers.front().at < next)
+        next = _answers.front().at;
+    return next;
+}
+
+
+void SimBoard::runClients() {
+    unsigned long long us = _ns / 1000;
+    while (!_answers.empty() && _answers.front().at <= us) {
+        int link = _answers.front().link;
+        _answers.pop_front();
+        if (_keepAlive) {
+            const char answer[] = "HTTP/1.1 204 No Content\r\n\r\n";
+            esp.received(link, answer, sizeof(answer) - 1, us);
+        }
+        else {
+            const char answer[] = "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 2\r\n\r\nOK";
+            // The board closes the link
+            esp.received(link, answer, sizeof(answer) - 1, us);
+        }
+    }
+    for (size_t i = 0; i < _clients.size(); i++) {
+        SimClient & client = _clients[i];
+        if (client.link >= 0) {
+            if (us - client.sentAt >= clientTimeout) {
+                // Gives up and closes the connection
+                int link = client.link;
+                timeouts++;
+                client.link = -1;
+                client.nextAt = us + client.think;
+                esp.closed(link, us);
+            }
+            continue;
+        }
+        if (issued >= _budget || !_listening || client.nextAt > us)
+            continue;
+        int link = esp.accept(us);
+        if (link < 0) {
+            refused++;
+            client.nextAt = us + 1000;
+            continue;
+        }
+        issued++;
+        client.link = link;
+        client.sentAt = us;
+        client.response.clear();
+        esp.received(link, client.request.data(), client.request.size(), us);
+    }
+}
+
+
+void SimBoard::finish(SimClient & client, bool success) {
+    unsigned long long us = _ns / 1000;
+    if (success) {
+        served++;
+        latency[client.cls].push_back(us - client.sentAt);
+    }
+    else {
+        failed++;
+    }
+    bytes += client.response.size();
+    lastResponse = client.response;
+    client.link = -1;
+    client.nextAt = us + client.think;
+}
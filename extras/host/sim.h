@@ -0,0 +1,129 @@
+/*
+ * Board with simulated ESP8266 in virtual time.
+ * The serial link carries one byte per 10 bit times both ways, bytes from ESP8266 land in
+ * the 63 byte receive buffer of SoftwareSerial (overruns are counted). Waiting for the serial
+ * link (available() and read() with nothing received) advances the clock by IDLE_STEP,
+ * every millis() or micros() by 1 us. Work of the board itself takes no virtual time.
+ * HTTP clients are simulated in closed loop: request, response, close, think, next request.
+ * Outbound links of the board may end in a collector which answers every POST.
+ */
+#ifndef SIM_H
+#define SIM_H
+
+#include "host.h"
+#include "at_emulator.h"
+#include <deque>
+#include <string>
+#include <vector>
+
+#define SIM_RX_BUFFER 63      // _SS_MAX_RX_BUFF of SoftwareSerial minus 1
+#define SIM_IDLE_STEP 10      // us per poll of an empty serial link
+#define SIM_CLASSES 4
+#define SIM_CLIENT_TIMEOUT 10000000ULL // us
+
+
+struct SimClient {
+    std::string request;
+    int expect;          // HTTP status of the response
+    size_t minBytes;     // shortest acceptable response
+    int cls;             // latency class
+    unsigned long think; // us between response and next request
+    // State
+    int link;            // -1 - not connected
+    unsigned long long nextAt;
+    unsigned long long sentAt;
+    std::string response;
+};
+
+
+class SimBoard : public HostBoard, public ATNetwork
+{
+public:
+    SimBoard();
+
+    ATEmulator esp;
+
+    // HostBoard
+    unsigned long long now();
+    void sleep(unsigned long us);
+    void begin(long baud);
+    int available();
+    int read();
+    int peek();
+    void write(uint8_t c);
+    bool overflow();
+    void pinWritten(uint8_t pin, uint8_t value);
+
+    // ATNetwork
+    bool listen(unsigned int port);
+    void unlisten();
+    bool open(int link, bool udp, const char * host, unsigned int port);
+    void send(int link, const char * data, size_t len);
+    void close(int link);
+
+    // Workload
+    void setResetPin(uint8_t pin) { _resetPin = pin; }
+    void addClient(const char * request, int expect, int cls = 0, unsigned long think = 0, size_t minBytes = 0);
+    void removeClients() { _clients.clear(); }
+    // Received so far by the client of the index (e. g. of an upgraded connection)
+    const std::string & response(size_t client) { return _clients[client].response; }
+    void setBudget(unsigned long requests) { _budget = requests; }
+    void setCollector(bool keepAlive);
+    bool done();
+    void advance(unsigned long long us);
+    void resetCounters();
+
+    static unsigned long percentile(std::vector<unsigned long> & values, int p);
+
+    long baud;
+    FILE * trace; // serial traffic line by line, NULL - off
+    unsigned long long clientTimeout; // us, SIM_CLIENT_TIMEOUT by default
+    // Client side results since resetCounters()
+    std::vector<unsigned long> latency[SIM_CLASSES]; // us
+    unsigned long issued;
+    unsigned long served;
+    unsigned long failed;   // unexpected status or short response
+    unsigned long timeouts;
+    unsigned long refused;  // no free link
+    unsigned long long bytes;
+    std::string lastResponse; // of the last finished request
+    // Serial link
+    unsigned long overruns;
+    size_t peakRx;
+    std::string outbound[AT_LINKS]; // data sent over links opened by the board
+    // Collector
+    unsigned long opened;   // outbound links
+    unsigned long posts;
+    std::string collected;  // bodies of the posts
+private:
+    struct Answer {
+        int link;
+        unsigned long long at;
+    };
+    void advanceTo(unsigned long long ns);
+    unsigned long long nextClientEvent();
+    void runClients();
+    void startByte();
+    void finish(SimClient & client, bool success);
+    void collect(int link);
+    void traceByte(std::string & line, char direction, uint8_t c);
+
+    unsigned long long _ns;
+    unsigned long long _byteNs;
+    std::deque<uint8_t> _rx;
+    bool _overflow;
+    bool _inFlight;
+    uint8_t _byte;
+    unsigned long long _byteAt;
+    bool _listening;
+    std::vector<SimClient> _clients;
+    unsigned long _budget;
+    uint8_t _resetPin;
+    bool _collector;
+    bool _keepAlive;
+    std::deque<Answer> _answers;
+    std::string _traceOut;
+    std::string _traceIn;
+};
+
+#endif
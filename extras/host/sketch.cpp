@@ -0,0 +1,158 @@
+/*
+ * Host build of a sketch talking to esp8266_emu over its tty:
+ *
+ *     make sketch SKETCH=../../examples/ESP8266_HTTP.ino
+ *     ESP8266_TTY=/dev/pts/N ESP8266_RST=/tmp/esp8266_emu.PID.rst ./build/ESP8266_HTTP
+ *
+ * The clock is real. Bytes to ESP8266 are paced by the baud rate of SoftwareSerial (the board
+ * waits for each of them), received bytes beyond its 63 byte buffer are lost. The reset pin
+ * (RST_PIN of the sketch) is written into the FIFO of the emulator, without ESP8266_RST it is
+ * not connected.
+ */
+#include "host.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <deque>
+
+#include SKETCH
+
+#define TTY_RX_BUFFER 63 // _SS_MAX_RX_BUFF of SoftwareSerial minus 1
+
+
+class TtyBoard : public HostBoard
+{
+public:
+    TtyBoard(const char * tty, const char * reset) {
+        _fd = ::open(tty, O_RDWR | O_NOCTTY | O_NONBLOCK);
+        if (_fd < 0) {
+            perror(tty);
+            exit(1);
+        }
+        struct termios t;
+        tcgetattr(_fd, &t);
+        cfmakeraw(&t);
+        tcsetattr(_fd, TCSANOW, &t);
+        // Bytes sent by ESP8266 before the board was powered
+        tcflush(_fd, TCIFLUSH);
+        _reset = -1;
+        if (reset != NULL && (_reset = ::open(reset, O_WRONLY | O_NONBLOCK)) < 0)
+            perror(reset);
+        _resetPin = 0xFF;
+        _overflow = false;
+        _writeAt = 0;
+        overruns = 0;
+        begin(9600);
+    }
+
+    unsigned long long now() {
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return t.tv_sec * 1000000ULL + t.tv_nsec / 1000;
+    }
+
+    void sleep(unsigned long us) {
+        usleep(us);
+    }
+
+    void begin(long baud) {
+        _byteUs = 10000000ULL / baud;
+    }
+
+    int available() {
+        receive();
+        return _rx.size();
+    }
+
+    int read() {
+        receive();
+        if (_rx.empty())
+            return -1;
+        int c = _rx.front();
+        _rx.pop_front();
+        return c;
+    }
+
+    int peek() {
+        receive();
+        return _rx.empty() ? -1 : _rx.front();
+    }
+
+    // SoftwareSerial sends with interrupts disabled - the board waits for the whole byte
+    void write(uint8_t c) {
+        unsigned long long t = now();
+        if (_writeAt < t)
+            _writeAt = t;
+        _writeAt += _byteUs;
+        while (::write(_fd, &c, 1) < 0 && errno == EAGAIN)
+            usleep(100);
+        while ((t = now()) < _writeAt) {
+            if (_writeAt - t > 200)
+                usleep(_writeAt - t - 100);
+        }
+    }
+
+    bool overflow() {
+        bool o = _overflow;
+        _overflow = false;
+        return o;
+    }
+
+    void setResetPin(uint8_t pin) { _resetPin = pin; }
+
+    void pinWritten(uint8_t pin, uint8_t value) {
+        if (pin != _resetPin || _reset < 0)
+            return;
+        char level = (value == HIGH) ? '1' : '0';
+        if (::write(_reset, &level, 1) < 0)
+            perror("reset");
+    }
+
+    unsigned long overruns;
+private:
+    // Everything waiting on the tty arrived while nobody read - the buffer keeps what fits
+    void receive() {
+        unsigned char buf[256];
+        ssize_t n;
+        while ((n = ::read(_fd, buf, sizeof(buf))) > 0) {
+            for (ssize_t i = 0; i < n; i++) {
+                if (_rx.size() < TTY_RX_BUFFER) {
+                    _rx.push_back(buf[i]);
+                }
+                else {
+                    overruns++;
+                    _overflow = true;
+                }
+            }
+        }
+    }
+
+    int _fd;
+    int _reset;
+    uint8_t _resetPin;
+    unsigned long long _byteUs;
+    unsigned long long _writeAt;
+    std::deque<uint8_t> _rx;
+    bool _overflow;
+};
+
+
+int main() {
+    const char * tty = getenv("ESP8266_TTY");
+    if (tty == NULL) {
+        fprintf(stderr, "ESP8266_TTY is not set - start esp8266_emu first\n");
+        return 2;
+    }
+    TtyBoard board(tty, getenv("ESP8266_RST"));
+#ifdef RST_PIN
+    board.setResetPin(RST_PIN);
+#endif
+    host_attach(&board);
+    setup();
+    while (1)
+        loop();
+}
@@ -0,0 +1,117 @@
+/*
+ * Arduino core for the host build - just what the library and its examples use.
+ * Time, pins and the serial link are provided by host.cpp (see host.h).
+ */
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <string>
+#include <avr/pgmspace.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define LED_BUILTIN 13
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+
+char * itoa(int value, char * buf, int radix);
+char * ltoa(long value, char * buf, int radix);
+char * utoa(unsigned int value, char * buf, int radix);
+char * ultoa(unsigned long value, char * buf, int radix);
+char * dtostrf(double value, signed char width, unsigned char precision, char * buf);
+
+
+class String
+{
+public:
+    String(const char * s = "") : _s(s) {}
+    const char * c_str() const { return _s.c_str(); }
+    unsigned int length() const { return _s.size(); }
+private:
+    std::string _s;
+};
+
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t * buf, size_t len);
+    size_t write(const char * s) { return write((const uint8_t *)s, strlen(s)); }
+    virtual void flush() {}
+
+    size_t print(const char * s) { return write(s); }
+    size_t print(const String & s) { return write(s.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(unsigned char n, int base = 10) { return print((unsigned long)n, base); }
+    size_t print(int n, int base = 10) { return print((long)n, base); }
+    size_t print(unsigned int n, int base = 10) { return print((unsigned long)n, base); }
+    size_t print(long n, int base = 10);
+    size_t print(unsigned long n, int base = 10);
+    size_t print(double n, int digits = 2);
+
+    size_t println() { return write("\r\n"); }
+    template <typename T> size_t println(T value) { size_t n = print(value); return n + println(); }
+    template <typename T> size_t println(T value, int format) { size_t n = print(value, format); return n + println(); }
+};
+
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    void setTimeout(unsigned long timeout) { _timeout = timeout; }
+    bool find(char * target);
+    size_t readBytes(char * buf, size_t len);
+    size_t readBytesUntil(char terminator, char * buf, size_t len);
+protected:
+    int timedRead();
+    unsigned long _timeout = 1000;
+};
+
+
+// Hardware serial of the board - stdout and stdin of the host program
+class HardwareSerial : public Stream
+{
+public:
+    void begin(long /* baud */) {}
+    operator bool() { return true; }
+    int available();
+    int read();
+    int peek() { return -1; }
+    size_t write(uint8_t c);
+    using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+#endif
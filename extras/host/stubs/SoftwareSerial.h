@@ -0,0 +1,24 @@
+/*
+ * SoftwareSerial of the host build - bytes go to the port selected by host_attach()
+ * (simulated ESP8266 or a tty of the AT emulator).
+ */
+#ifndef SOFTWARESERIAL_H
+#define SOFTWARESERIAL_H
+
+#include "Arduino.h"
+
+class SoftwareSerial : public Stream
+{
+public:
+    SoftwareSerial(uint8_t /* rxPin */, uint8_t /* txPin */) {}
+    void begin(long baud);
+    void end() {}
+    bool overflow();
+    int available();
+    int read();
+    int peek();
+    size_t write(uint8_t c);
+    using Print::write;
+};
+
+#endif
@@ -0,0 +1,33 @@
+/*
+ * Flash and RAM are the same memory on the host.
+ */
+#ifndef PGMSPACE_H
+#define PGMSPACE_H
+
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(p) (*(const unsigned char *)(p))
+#define pgm_read_word(p) (*(const unsigned short *)(p))
+#define pgm_read_ptr(p) (*(void * const *)(p))
+#define strlen_P strlen
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define strcat_P strcat
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strcasecmp_P strcasecmp
+#define strncasecmp_P strncasecmp
+#define memcpy_P memcpy
+#define sprintf_P sprintf
+#define snprintf_P snprintf
+
+// Like avr-libc - the result is not const
+static inline char * strstr_P(const char * s, const char * find) {
+    return (char *)strstr(s, find);
+}
+
+#endif
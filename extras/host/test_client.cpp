@@ -0,0 +1,136 @@
+/*
+ * ESP8266_HTTPClient next to a busy server against the simulated ESP8266 (see sim.h): samples
+ * are posted in batches to the collector of SimBoard while clients keep requesting pages.
+ * Every accepted sample must reach the collector, over one link when it keeps the connection
+ * alive and over a new link per POST when it answers "Connection: close". Passive mode.
+ *
+ *     make test
+ */
+#include "sim.h"
+#include "ESP8266_HTTP.h"
+#include "ESP8266_HTTPClient.h"
+#include <string>
+
+#define RX_PIN  4
+#define TX_PIN  6
+#define RST_PIN 5
+
+#define BAUD 9600
+#define REQUESTS 30
+#define SAMPLES 200
+#define SAMPLE_INTERVAL 50 // ms
+#define DEADLINE 120000000ULL // us of virtual time
+
+#define REQUEST "GET / HTTP/1.1\r\nHost: esp8266\r\nUser-Agent: test\r\nAccept: */*\r\n\r\n"
+
+const char PROGMEM_PAGE[] PROGMEM = "HTTP/1.1 200 OK\r\nConnection: Closed\r\nContent-Type: text/html\r\n\r\n"
+        "<html><body><h1>ESP8266</h1></body></html>";
+
+
+static void sendPage(ESP8266_HTTP & server, Route * route, char channel) {
+    server.send_PROGMEM(PROGMEM_PAGE);
+    server.send(channel);
+    server.closeConnection(channel);
+}
+
+
+struct Result {
+    bool started;
+    unsigned long accepted;
+    unsigned long dropped;
+    std::string expected; // accepted samples
+    int status;
+};
+
+
+static Result run(SimBoard & board, bool keepAlive) {
+    Result result = { false, 0, 0, std::string(), 0 };
+    host_attach(&board);
+    board.setResetPin(RST_PIN);
+    board.setCollector(keepAlive);
+    ESP8266_HTTP * server = new ESP8266_HTTP(RX_PIN, TX_PIN, RST_PIN, BAUD);
+    server->setPassiveMode(true);
+    result.started = (server->start("test", "password", "80") == 0);
+    if (result.started) {
+        server->registerRoute(GET, "/", sendPage);
+        ESP8266_HTTPClient client(*server, "192.168.1.2", "8080", "/samples");
+        board.resetCounters();
+        for (byte i = 0; i < MAX_CONNECTIONS - 1; i++)
+            board.addClient(REQUEST, 200, 0, 100000);
+        board.setBudget(REQUESTS);
+        unsigned long long start = board.now();
+        unsigned long lastSample = millis();
+        unsigned int samples = 0;
+        while (board.now() - start < DEADLINE) {
+            server->update();
+            client.update();
+            if (samples < SAMPLES && millis() - lastSample >= SAMPLE_INTERVAL) {
+                lastSample = millis();
+                char sample[24];
+                snprintf(sample, sizeof(sample), "n=%u", samples);
+                if (client.addSample("n", samples)) {
+                    result.accepted++;
+                    result.expected += sample;
+                    result.expected += '\n';
+                }
+                else {
+                    result.dropped++;
+                }
+                samples++;
+            }
+            if (samples == SAMPLES && !client.isBusy())
+                client.flush();
+            if (board.done() && samples == SAMPLES && client.pending() == 0 && !client.isBusy())
+                break;
+        }
+        result.status = client.lastStatus();
+    }
+    delete server;
+    host_attach(NULL);
+    return result;
+}
+
+
+static int check(const char * mode, SimBoard & board, Result & result, int status, bool keepAlive) {
+    printf("%-11s served %lu/%d, samples %lu (dropped %lu), posts %lu, links %lu, last status %d\n", mode,
+            board.served, REQUESTS, result.accepted, result.dropped, board.posts, board.opened, result.status);
+    int failures = 0;
+    if (!result.started) {
+        printf("FAIL %s: start() failed\n", mode);
+        return 1;
+    }
+    if (board.served != REQUESTS) {
+        printf("FAIL %s: %lu of %d requests served\n", mode, board.served, REQUESTS);
+        failures++;
+    }
+    if (board.collected != result.expected) {
+        printf("FAIL %s: collector got %u of %u bytes of samples\n", mode,
+                (unsigned int)board.collected.size(), (unsigned int)result.expected.size());
+        failures++;
+    }
+    if (result.status != status) {
+        printf("FAIL %s: last status %d\n", mode, result.status);
+        failures++;
+    }
+    if (keepAlive ? board.opened != 1 : board.opened != board.posts) {
+        printf("FAIL %s: %lu links for %lu posts\n", mode, board.opened, board.posts);
+        failures++;
+    }
+    return failures;
+}
+
+
+int main() {
+    int failures = 0;
+
+    SimBoard reused;
+    Result result = run(reused, true);
+    failures += check("keep-alive", reused, result, 204, true);
+
+    SimBoard closed;
+    result = run(closed, false);
+    failures += check("close", closed, result, 200, false);
+
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures ? 1 : 0;
+}
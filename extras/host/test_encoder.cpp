@@ -0,0 +1,643 @@
+/*
+ * ESP8266_Encoder against the simulated ESP8266 (see sim.h): typical payloads requested with
+ * and without "Accept: application/cbor". The JSON body is parsed, the CBOR body decoded, both
+ * must give the expected value (compared in one canonical JSON form). Checks Content-Length,
+ * negotiation by the Accept header and 500 for responses which do not fit into the TX_BUFFER,
+ * then prints bytes of both encodings per payload - at 9600 baud every byte costs ~1 ms.
+ *
+ *     make test
+ */
+#include "sim.h"
+#include "ESP8266_HTTP.h"
+#include "ESP8266_Encoder.h"
+#include <string>
+
+#define RX_PIN  4
+#define TX_PIN  6
+#define RST_PIN 5
+
+#define BAUD 9600
+#define DEADLINE 30000000ULL // us of virtual time per request
+
+#define ACCEPT_JSON "Accept: application/json\r\n"
+#define ACCEPT_CBOR "Accept: application/cbor\r\n"
+
+struct Payload {
+    const char * name;
+    void (*write)(ESP8266_Encoder & out);
+    const char * expected; // JSON, NULL - the response does not fit
+};
+
+
+static void writeState(ESP8266_Encoder & out) {
+    out.beginObject();
+    out.key_P(PSTR("uptime"));
+    out.value(123456L);
+    out.key_P(PSTR("relay"));
+    out.boolean(false);
+    out.key_P(PSTR("inputs"));
+    out.beginArray();
+    out.value(512);
+    out.value(498);
+    out.endArray();
+    out.endObject();
+}
+
+
+#if ESP8266_FLOAT
+static void writeSensor(ESP8266_Encoder & out) {
+    out.beginObject();
+    out.key_P(PSTR("temp"));
+    out.value(21.5f);
+    out.key_P(PSTR("hum"));
+    out.value(40.25f);
+    out.key_P(PSTR("hPa"));
+    out.value(1013.7f);
+    out.key_P(PSTR("unit"));
+    out.value_P(PSTR("C"));
+    out.endObject();
+}
+#endif
+
+
+// Limits of the argument sizes of CBOR
+static void writeIntegers(ESP8266_Encoder & out) {
+    static const long values[] = { 0, 23, 24, 255, 256, 65535, 65536, -1, -24, -25, -256, -257,
+            2147483647L, -2147483647L - 1 };
+    out.beginArray();
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+        out.value(values[i]);
+    out.endArray();
+}
+
+
+static void writeText(ESP8266_Encoder & out) {
+    out.beginObject();
+    out.key("note");
+    out.value("\"q\" \\ \t");
+    // 24 bytes and more - length in the next byte of CBOR
+    out.key_P(PSTR("long"));
+    out.value_P(PSTR("abcdefghijklmnopqrstuvwxyz"));
+    out.endObject();
+}
+
+
+static void writeNested(ESP8266_Encoder & out) {
+    out.beginObject();
+    out.key_P(PSTR("net"));
+    out.beginObject();
+    out.key_P(PSTR("dhcp"));
+    out.boolean(true);
+    out.key_P(PSTR("gw"));
+    out.null();
+    out.endObject();
+    out.key_P(PSTR("ports"));
+    out.beginArray();
+    out.value(80);
+    out.value(8080);
+    out.endArray();
+    out.key_P(PSTR("m"));
+    out.beginArray();
+    out.beginArray();
+    out.value(1);
+    out.value(-2);
+    out.endArray();
+    out.beginArray();
+    out.endArray();
+    out.endArray();
+    out.key_P(PSTR("e"));
+    out.beginObject();
+    out.endObject();
+    out.endObject();
+}
+
+
+// Fits into the TX_BUFFER as CBOR only
+static void writeSeries(ESP8266_Encoder & out) {
+    out.beginObject();
+    out.key_P(PSTR("a0"));
+    out.beginArray();
+    for (int i = 0; i < 20; i++)
+        out.value(500 + i);
+    out.endArray();
+    out.endObject();
+}
+
+
+// Deeper than ENCODER_MAX_DEPTH
+static void writeDeep(ESP8266_Encoder & out) {
+    for (byte i = 0; i <= ENCODER_MAX_DEPTH; i++)
+        out.beginArray();
+    for (byte i = 0; i <= ENCODER_MAX_DEPTH; i++)
+        out.endArray();
+}
+
+
+#define SERIES "[500,501,502,503,504,505,506,507,508,509,510,511,512,513,514,515,516,517,518,519]"
+
+static const Payload payloads[] = {
+    { "state", writeState, "{\"uptime\":123456,\"relay\":false,\"inputs\":[512,498]}" },
+#if ESP8266_FLOAT
+    { "sensor", writeSensor, "{\"temp\":21.5,\"hum\":40.25,\"hPa\":1013.7,\"unit\":\"C\"}" },
+#endif
+    { "integers", writeIntegers,
+            "[0,23,24,255,256,65535,65536,-1,-24,-25,-256,-257,2147483647,-2147483648]" },
+    { "text", writeText,
+            "{\"note\":\"\\\"q\\\" \\\\ \\t\",\"long\":\"abcdefghijklmnopqrstuvwxyz\"}" },
+    { "nested", writeNested, "{\"net\":{\"dhcp\":true,\"gw\":null},\"ports\":[80,8080],\"m\":[[1,-2],[]],\"e\":{}}" },
+    { "series", writeSeries, "{\"a0\":" SERIES "}" },
+    { "deep", writeDeep, NULL },
+};
+#define PAYLOADS (sizeof(payloads) / sizeof(payloads[0]))
+
+static const Payload * current;
+
+
+static void sendPayload(ESP8266_HTTP & server, Route * route, char channel) {
+    ESP8266_Encoder out(server);
+    current->write(out);
+    out.send(channel);
+    server.closeConnection(channel);
+}
+
+
+/***************************************
+ * Canonical form: compact JSON, members in the written order, floats with 2 decimals
+ ***************************************/
+static void canonicalText(const std::string & text, std::string & out) {
+    out += '"';
+    for (size_t i = 0; i < text.size(); i++) {
+        unsigned char c = text[i];
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        }
+        else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        }
+        else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+
+static void canonicalFloat(double number, std::string & out) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.2f", number);
+    out += buf;
+}
+
+
+static void canonicalInteger(long long number, std::string & out) {
+    char buf[24];
+    snprintf(buf, sizeof(buf), "%lld", number);
+    out += buf;
+}
+
+
+// Strict enough for the encoder: no whitespace, escapes \" \\ \/ \b \f \n \r \t \u00XX
+class JsonParser
+{
+public:
+    JsonParser(const std::string & text) : _s(text), _pos(0) {}
+
+    bool parse(std::string & out) {
+        return value(out) && _pos == _s.size();
+    }
+private:
+    bool value(std::string & out) {
+        if (_pos >= _s.size())
+            return false;
+        char c = _s[_pos];
+        if (c == '{' || c == '[')
+            return container(out);
+        if (c == '"') {
+            std::string text;
+            if (!string(text))
+                return false;
+            canonicalText(text, out);
+            return true;
+        }
+        if (literal("true") || literal("false") || literal("null")) {
+            out += _literal;
+            return true;
+        }
+        return number(out);
+    }
+
+    bool container(std::string & out) {
+        char close = (_s[_pos] == '{') ? '}' : ']';
+        out += _s[_pos++];
+        bool first = true;
+        while (_pos < _s.size() && _s[_pos] != close) {
+            if (!first) {
+                if (_s[_pos++] != ',')
+                    return false;
+                out += ',';
+            }
+            first = false;
+            if (close == '}') {
+                std::string key;
+                if (_pos >= _s.size() || _s[_pos] != '"' || !string(key))
+                    return false;
+                canonicalText(key, out);
+                if (_pos >= _s.size() || _s[_pos++] != ':')
+                    return false;
+                out += ':';
+            }
+            if (!value(out))
+                return false;
+        }
+        if (_pos >= _s.size())
+            return false;
+        out += _s[_pos++];
+        return true;
+    }
+
+    bool string(std::string & text) {
+        _pos++; // "
+        while (_pos < _s.size() && _s[_pos] != '"') {
+            char c = _s[_pos++];
+            if ((unsigned char)c < 0x20)
+                return false;
+            if (c != '\\') {
+                text += c;
+                continue;
+            }
+            if (_pos >= _s.size())
+                return false;
+            c = _s[_pos++];
+            switch (c) {
+                case '"': case '\\': case '/': text += c; break;
+                case 'b': text += '\b'; break;
+                case 'f': text += '\f'; break;
+                case 'n': text += '\n'; break;
+                case 'r': text += '\r'; break;
+                case 't': text += '\t'; break;
+                case 'u': {
+                    if (_pos + 4 > _s.size() || _s.compare(_pos, 2, "00") != 0)
+                        return false;
+                    text += (char)strtol(_s.substr(_pos + 2, 2).c_str(), NULL, 16);
+                    _pos += 4;
+                    break;
+                }
+                default: return false;
+            }
+        }
+        if (_pos >= _s.size())
+            return false;
+        _pos++;
+        return true;
+    }
+
+    bool literal(const char * word) {
+        size_t len = strlen(word);
+        if (_s.compare(_pos, len, word) != 0)
+            return false;
+        _pos += len;
+        _literal = word;
+        return true;
+    }
+
+    bool number(std::string & out) {
+        size_t start = _pos;
+        bool fraction = false;
+        if (_pos < _s.size() && _s[_pos] == '-')
+            _pos++;
+        while (_pos < _s.size() && (isdigit(_s[_pos]) || _s[_pos] == '.')) {
+            fraction |= (_s[_pos] == '.');
+            _pos++;
+        }
+        std::string text = _s.substr(start, _pos - start);
+        if (text.empty() || text == "-")
+            return false;
+        if (fraction)
+            canonicalFloat(strtod(text.c_str(), NULL), out);
+        else
+            canonicalInteger(strtoll(text.c_str(), NULL, 10), out);
+        return true;
+    }
+
+    const std::string & _s;
+    size_t _pos;
+    const char * _literal;
+};
+
+
+// CBOR (RFC 8949) items written by the encoder plus definite lengths and half/double floats
+class CborDecoder
+{
+public:
+    CborDecoder(const std::string & data) : _d(data), _pos(0) {}
+
+    bool decode(std::string & out) {
+        return item(out) && _pos == _d.size();
+    }
+private:
+    bool byte(unsigned char & b) {
+        if (_pos >= _d.size())
+            return false;
+        b = _d[_pos++];
+        return true;
+    }
+
+    bool argument(unsigned char info, unsigned long long & value) {
+        if (info < 24) {
+            value = info;
+            return true;
+        }
+        if (info > 27)
+            return false;
+        int len = 1 << (info - 24);
+        value = 0;
+        for (int i = 0; i < len; i++) {
+            unsigned char b;
+            if (!byte(b))
+                return false;
+            value = (value << 8) | b;
+        }
+        return true;
+    }
+
+    bool item(std::string & out) {
+        unsigned char initial;
+        if (!byte(initial))
+            return false;
+        unsigned char major = initial >> 5;
+        unsigned char info = initial & 0x1F;
+        unsigned long long value = 0;
+        if (major == 7)
+            return simple(info, out);
+        if (info == 31) {
+            if (major == 4 || major == 5)
+                return container(major, true, 0, out);
+            return false; // indefinite strings are not written by the encoder
+        }
+        if (!argument(info, value))
+            return false;
+        switch (major) {
+            case 0:
+                canonicalInteger((long long)value, out);
+                return true;
+            case 1:
+                canonicalInteger(-1 - (long long)value, out);
+                return true;
+            case 3:
+                if (_pos + value > _d.size())
+                    return false;
+                canonicalText(_d.substr(_pos, value), out);
+                _pos += value;
+                return true;
+            case 4:
+            case 5:
+                return container(major, false, value, out);
+        }
+        return false; // byte strings and tags
+    }
+
+    bool container(unsigned char major, bool indefinite, unsigned long long count, std::string & out) {
+        out += (major == 5) ? '{' : '[';
+        for (unsigned long long i = 0; indefinite || i < count; i++) {
+            if (indefinite) {
+                if (_pos >= _d.size())
+                    return false;
+                if ((unsigned char)_d[_pos] == 0xFF) {
+                    _pos++;
+                    break;
+                }
+            }
+            if (i > 0)
+                out += ',';
+            if (major == 5) {
+                // Keys are text
+                if (_pos >= _d.size() || ((unsigned char)_d[_pos] >> 5) != 3 || !item(out))
+                    return false;
+                out += ':';
+            }
+            if (!item(out))
+                return false;
+        }
+        out += (major == 5) ? '}' : ']';
+        return true;
+    }
+
+    bool simple(unsigned char info, std::string & out) {
+        unsigned long long bits;
+        switch (info) {
+            case 20: out += "false"; return true;
+            case 21: out += "true"; return true;
+            case 22: out += "null"; return true;
+            case 25: {
+                if (!argument(info, bits))
+                    return false;
+                // Half precision
+                int exponent = (bits >> 10) & 0x1F;
+                double mantissa = bits & 0x3FF;
+                double number = (exponent == 0) ? ldexp(mantissa, -24) : ldexp(mantissa + 1024, exponent - 25);
+                canonicalFloat((bits & 0x8000) ? -number : number, out);
+                return true;
+            }
+            case 26: {
+                if (!argument(info, bits))
+                    return false;
+                uint32_t u = bits;
+                float number;
+                memcpy(&number, &u, sizeof(number));
+                canonicalFloat(number, out);
+                return true;
+            }
+            case 27: {
+                if (!argument(info, bits))
+                    return false;
+                double number;
+                memcpy(&number, &bits, sizeof(number));
+                canonicalFloat(number, out);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const std::string & _d;
+    size_t _pos;
+};
+
+
+/***************************************
+ * Requests through the simulated ESP8266
+ ***************************************/
+struct Response {
+    int status;
+    std::string type;
+    long length; // Content-Length, -1 - none
+    std::string body;
+    size_t size; // whole response
+};
+
+
+static bool header(const std::string & head, const char * name, std::string & value) {
+    size_t pos = head.find(std::string("\r\n") + name + ": ");
+    if (pos == std::string::npos)
+        return false;
+    pos += strlen(name) + 4;
+    value = head.substr(pos, head.find("\r\n", pos) - pos);
+    return true;
+}
+
+
+static bool request(SimBoard & board, ESP8266_HTTP & server, const Payload & payload, const char * accept,
+        Response & response) {
+    current = &payload;
+    std::string text = std::string("GET /payload HTTP/1.1\r\nHost: esp8266\r\nUser-Agent: test\r\n") + accept + "\r\n";
+    board.resetCounters();
+    board.removeClients();
+    board.addClient(text.c_str(), 0);
+    board.setBudget(1);
+    unsigned long long start = board.now();
+    while (!board.done() && board.now() - start < DEADLINE)
+        server.update();
+    const std::string & r = board.lastResponse;
+    size_t end = r.find("\r\n\r\n");
+    if (!board.done() || r.compare(0, 9, "HTTP/1.1 ") != 0 || end == std::string::npos)
+        return false;
+    std::string head = r.substr(0, end);
+    std::string value;
+    response.status = atoi(r.c_str() + 9);
+    response.type = header(head, "Content-Type", value) ? value : "";
+    response.length = header(head, "Content-Length", value) ? atol(value.c_str()) : -1;
+    response.body = r.substr(end + 4);
+    response.size = r.size();
+    return true;
+}
+
+
+static int failures = 0;
+
+static void fail(const char * payload, const char * format, const char * what) {
+    printf("FAIL %s %s: %s\n", payload, format, what);
+    failures++;
+}
+
+
+// Status, type, length and the decoded body of one encoding
+static bool checkResponse(const Payload & payload, const char * format, Response & response, bool cbor,
+        const std::string & expected) {
+    if (payload.expected == NULL) {
+        if (response.status != 500)
+            fail(payload.name, format, "response which does not fit is not 500");
+        return response.status == 500;
+    }
+    if (response.status != 200) {
+        char what[32];
+        snprintf(what, sizeof(what), "status %d", response.status);
+        fail(payload.name, format, what);
+        return false;
+    }
+    if (response.type != (cbor ? "application/cbor" : "application/json")) {
+        fail(payload.name, format, ("Content-Type " + response.type).c_str());
+        return false;
+    }
+    if (response.length != (long)response.body.size()) {
+        fail(payload.name, format, "Content-Length differs from the body");
+        return false;
+    }
+    std::string decoded;
+    bool valid = cbor ? CborDecoder(response.body).decode(decoded) : JsonParser(response.body).parse(decoded);
+    if (!valid) {
+        fail(payload.name, format, "malformed body");
+        return false;
+    }
+    if (decoded != expected) {
+        fail(payload.name, format, ("decoded " + decoded + ", expected " + expected).c_str());
+        return false;
+    }
+    return true;
+}
+
+
+int main() {
+    SimBoard board;
+    if (getenv("SIM_TRACE") != NULL)
+        board.trace = stderr;
+    host_attach(&board);
+    board.setResetPin(RST_PIN);
+    ESP8266_HTTP * server = new ESP8266_HTTP(RX_PIN, TX_PIN, RST_PIN, BAUD);
+    if (server->start("test", "password", "80") != 0) {
+        printf("FAIL start() failed\nFAILED\n");
+        return 1;
+    }
+    server->registerRoute(GET, "/payload", sendPayload);
+
+    printf("MAX_TX_BUFFER_SIZE=%d, body bytes (whole response bytes ~ ms at 9600 baud)\n", MAX_TX_BUFFER_SIZE);
+    printf("%-9s %14s %14s %6s\n", "payload", "JSON", "CBOR", "ratio");
+    for (size_t i = 0; i < PAYLOADS; i++) {
+        const Payload & payload = payloads[i];
+        std::string expected;
+        if (payload.expected != NULL && !JsonParser(payload.expected).parse(expected)) {
+            fail(payload.name, "", "expected value is not valid JSON");
+            continue;
+        }
+        Response json, cbor;
+        if (!request(board, *server, payload, ACCEPT_JSON, json)) {
+            fail(payload.name, "JSON", "no response");
+            continue;
+        }
+        if (!request(board, *server, payload, ACCEPT_CBOR, cbor)) {
+            fail(payload.name, "CBOR", "no response");
+            continue;
+        }
+        // JSON which does not fit into the TX_BUFFER, the same data as CBOR do
+        bool jsonFits = json.status != 500 || payload.expected == NULL;
+        bool jsonValid = jsonFits && checkResponse(payload, "JSON", json, false, expected);
+        bool cborValid = checkResponse(payload, "CBOR", cbor, true, expected);
+
+        char jsonBytes[24], cborBytes[24], ratio[8] = "-";
+        if (jsonValid && payload.expected != NULL)
+            snprintf(jsonBytes, sizeof(jsonBytes), "%u (%u)", (unsigned int)json.body.size(), (unsigned int)json.size);
+        else
+            snprintf(jsonBytes, sizeof(jsonBytes), "%d", json.status);
+        if (cborValid && payload.expected != NULL)
+            snprintf(cborBytes, sizeof(cborBytes), "%u (%u)", (unsigned int)cbor.body.size(), (unsigned int)cbor.size);
+        else
+            snprintf(cborBytes, sizeof(cborBytes), "%d", cbor.status);
+        if (jsonValid && cborValid && payload.expected != NULL)
+            snprintf(ratio, sizeof(ratio), "%.2f", (double)json.body.size() / cbor.body.size());
+        printf("%-9s %14s %14s %6s\n", payload.name, jsonBytes, cborBytes, ratio);
+    }
+
+    // Negotiation - CBOR only when the Accept header lists it and q is not 0
+    struct Negotiation {
+        const char * accept;
+        bool cbor;
+    };
+    static const Negotiation accepts[] = {
+        { "", false },
+        { "Accept: */*\r\n", false },
+        { "Accept: text/html, application/json\r\n", false },
+        { "Accept: application/json, application/cbor\r\n", true },
+        { "Accept: Application/CBOR\r\n", true },
+        { "accept: application/cbor\r\n", true },
+        { "X-Accept: application/cbor\r\n", false },
+        { "Accept: application/cbor;q=0.5, application/json\r\n", true },
+        { "Accept: application/cbor;q=0, application/json\r\n", false },
+        { "Accept: application/json, application/cbor; q=0.000\r\n", false },
+        { "Accept: application/cbor-seq, application/json\r\n", false },
+        { "Accept: application/json;profile=application/cbor\r\n", false },
+    };
+    for (size_t i = 0; i < sizeof(accepts) / sizeof(accepts[0]); i++) {
+        Response response;
+        bool cbor = accepts[i].cbor;
+        if (!request(board, *server, payloads[0], accepts[i].accept, response)
+                || response.type != (cbor ? "application/cbor" : "application/json"))
+            fail("Accept", accepts[i].accept[0] ? accepts[i].accept : "(none)", ("Content-Type " + response.type).c_str());
+    }
+
+    delete server;
+    host_attach(NULL);
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures ? 1 : 0;
+}
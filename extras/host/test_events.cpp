@@ -0,0 +1,90 @@
+/*
+ * Server-Sent Events against the simulated ESP8266 (see sim.h): EventSource of a browser
+ * subscribes with a request bigger than the RX_BUFFER, then an event is published.
+ * The subscription must survive in both receive modes - the rest of the request is not
+ * taken for a new one - and the client must get the header and the event.
+ *
+ *     make test
+ */
+#include "sim.h"
+#include "ESP8266_HTTP.h"
+#include <string>
+
+#define RX_PIN  4
+#define TX_PIN  6
+#define RST_PIN 5
+
+#define BAUD 9600
+#define DEADLINE 3000000ULL // us of virtual time before and after the event
+
+#define SMALL "GET /events HTTP/1.1\r\nHost: 192.168.1.20\r\nAccept: text/event-stream\r\nCache-Control: no-cache\r\n\r\n"
+// 542 bytes like Chrome sends
+#define BROWSER "GET /events HTTP/1.1\r\nHost: 192.168.1.20\r\nConnection: keep-alive\r\n" \
+        "Accept: text/event-stream\r\nCache-Control: no-cache\r\nUser-Agent: Mozilla/5.0 (X11; Linux x86_64) " \
+        "AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n" \
+        "Referer: http://192.168.1.20/dashboard\r\nAccept-Encoding: gzip, deflate\r\n" \
+        "Accept-Language: en-US,en;q=0.9,cs;q=0.8\r\n" \
+        "Cookie: session=0123456789abcdef0123456789abcdef; theme=dark; panel=relays; refresh=1000\r\n" \
+        "sec-ch-ua: \"Not_A Brand\";v=\"8\", \"Chromium\";v=\"120\"\r\nsec-ch-ua-mobile: ?0\r\n" \
+        "sec-ch-ua-platform: \"Linux\"\r\n\r\n"
+
+
+// Subscribes, publishes one event, returns what the client received and the subscribers left
+static std::string subscribe(bool passive, const char * request, byte * subscribers) {
+    SimBoard board;
+    if (getenv("SIM_TRACE") != NULL)
+        board.trace = stderr;
+    host_attach(&board);
+    board.setResetPin(RST_PIN);
+    ESP8266_HTTP * server = new ESP8266_HTTP(RX_PIN, TX_PIN, RST_PIN, BAUD);
+    server->setPassiveMode(passive);
+    std::string response;
+    *subscribers = 0;
+    if (server->start("test", "password", "80") == 0) {
+        server->registerEventStream("/events");
+        board.clientTimeout = DEADLINE * 4;
+        board.addClient(request, 200);
+        board.setBudget(1);
+        unsigned long long start = board.now();
+        // The connection stays open
+        while (board.now() - start < DEADLINE)
+            server->update();
+        server->publishEvent("/events", "42");
+        start = board.now();
+        while (board.now() - start < DEADLINE)
+            server->update();
+        *subscribers = server->subscribers("/events");
+        response = board.response(0);
+    }
+    delete server;
+    host_attach(NULL);
+    return response;
+}
+
+
+static int check(bool passive, const char * request) {
+    const char * mode = passive ? "passive" : "active";
+    byte subscribers;
+    std::string response = subscribe(passive, request, &subscribers);
+    bool success = subscribers == 1 && response.compare(0, 12, "HTTP/1.1 200") == 0
+            && response.find("text/event-stream") != std::string::npos
+            && response.find("data: 42\n\n") != std::string::npos;
+    printf("%-8s %3u B request: %u subscriber(s), %u B received\n", mode, (unsigned int)strlen(request),
+            subscribers, (unsigned int)response.size());
+    if (!success)
+        printf("FAIL %s: subscription of %u B request lost\n", mode, (unsigned int)strlen(request));
+    return success ? 0 : 1;
+}
+
+
+int main() {
+    int failures = 0;
+    printf("RX_BUFFER %d B\n", MAX_RX_BUFFER_SIZE);
+    failures += check(false, SMALL);
+    failures += check(false, BROWSER);
+    failures += check(true, SMALL);
+    failures += check(true, BROWSER);
+
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures ? 1 : 0;
+}
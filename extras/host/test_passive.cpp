@@ -0,0 +1,124 @@
+/*
+ * Passive receive mode against the simulated ESP8266 (see sim.h): bursts of concurrent
+ * requests at 9600 baud. In passive mode every request is served and the receive buffer
+ * of SoftwareSerial never overflows. Active mode runs the same load - "+IPD" frames which arrive
+ * in the middle of an AT command are kept for the next update(), so no request is lost either.
+ * Requests of a browser, bigger than the RX_BUFFER, are served in passive mode as well - the rest
+ * of a request whose response is streamed by later update() calls is not taken for a new request.
+ *
+ *     make test
+ */
+#include "sim.h"
+#include "ESP8266_HTTP.h"
+
+#define RX_PIN  4
+#define TX_PIN  6
+#define RST_PIN 5
+
+#define BAUD 9600
+#define REQUESTS 60
+#define DEADLINE 120000000ULL // us of virtual time
+
+#define REQUEST "GET / HTTP/1.1\r\nHost: esp8266\r\nUser-Agent: test\r\nAccept: */*\r\n\r\n"
+// 520 bytes, Chrome sends about as many
+#define BROWSER_REQUEST "GET /stream HTTP/1.1\r\nHost: 192.168.1.20\r\nConnection: keep-alive\r\nCache-Control: max-age=0\r\n" \
+        "Upgrade-Insecure-Requests: 1\r\nUser-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 " \
+        "(KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\nAccept: text/html,application/xhtml+xml," \
+        "application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n" \
+        "Accept-Encoding: gzip, deflate\r\nAccept-Language: en-US,en;q=0.9,cs;q=0.8\r\n" \
+        "Cookie: session=0123456789abcdef0123456789abcdef; theme=dark\r\n\r\n"
+
+const char PROGMEM_PAGE[] PROGMEM = "HTTP/1.1 200 OK\r\nConnection: Closed\r\nContent-Type: text/html\r\n\r\n"
+        "<html><body><h1>ESP8266</h1></body></html>";
+
+
+static void sendPage(ESP8266_HTTP & server, Route * route, char channel) {
+    server.send_PROGMEM(PROGMEM_PAGE);
+    server.send(channel);
+    server.closeConnection(channel);
+}
+
+
+static void streamPage(ESP8266_HTTP & server, Route * route, char channel) {
+    server.streamResponse_PROGMEM(route, PROGMEM_PAGE);
+}
+
+
+// Runs the burst, false when the server did not start
+static bool burst(SimBoard & board, bool passive, const char * request) {
+    host_attach(&board);
+    board.setResetPin(RST_PIN);
+    ESP8266_HTTP * server = new ESP8266_HTTP(RX_PIN, TX_PIN, RST_PIN, BAUD);
+    server->setPassiveMode(passive);
+    bool started = (server->start("test", "password", "80") == 0);
+    if (started) {
+        server->registerRoute(GET, "/", sendPage);
+        server->registerRoute(GET, "/stream", streamPage);
+        board.resetCounters();
+        for (byte i = 0; i < MAX_CONNECTIONS; i++)
+            board.addClient(request, 200);
+        board.setBudget(REQUESTS);
+        unsigned long long start = board.now();
+        while (!board.done() && board.now() - start < DEADLINE)
+            server->update();
+    }
+    delete server;
+    host_attach(NULL);
+    return started;
+}
+
+
+static void report(const char * mode, SimBoard & board) {
+    printf("%-8s issued %lu, served %lu, failed %lu, timeouts %lu, overruns %lu, peak %u B\n", mode,
+            board.issued, board.served, board.failed, board.timeouts, board.overruns, (unsigned int)board.peakRx);
+}
+
+
+int main() {
+    int failures = 0;
+
+    SimBoard active;
+    if (!burst(active, false, REQUEST)) {
+        printf("FAIL active: start() failed\n");
+        failures++;
+    }
+    report("active", active);
+    if (active.served != REQUESTS) {
+        printf("FAIL active: %lu of %d requests served\n", active.served, REQUESTS);
+        failures++;
+    }
+
+    SimBoard passive;
+    if (!burst(passive, true, REQUEST)) {
+        printf("FAIL passive: start() failed\n");
+        failures++;
+    }
+    report("passive", passive);
+    if (passive.served != REQUESTS) {
+        printf("FAIL passive: %lu of %d requests served\n", passive.served, REQUESTS);
+        failures++;
+    }
+    if (passive.overruns != 0) {
+        printf("FAIL passive: %lu bytes lost by overruns\n", passive.overruns);
+        failures++;
+    }
+    if (passive.peakRx >= SIM_RX_BUFFER) {
+        printf("FAIL passive: receive buffer full\n");
+        failures++;
+    }
+
+    printf("%u B requests, RX_BUFFER %d B\n", (unsigned int)strlen(BROWSER_REQUEST), MAX_RX_BUFFER_SIZE);
+    SimBoard large;
+    if (!burst(large, true, BROWSER_REQUEST)) {
+        printf("FAIL passive: start() failed\n");
+        failures++;
+    }
+    report("passive", large);
+    if (large.served != REQUESTS) {
+        printf("FAIL passive: %lu of %d requests bigger than the RX_BUFFER served\n", large.served, REQUESTS);
+        failures++;
+    }
+
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures ? 1 : 0;
+}
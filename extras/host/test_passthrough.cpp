@@ -0,0 +1,106 @@
+/*
+ * Pass-through session against the simulated ESP8266 (see sim.h) started while a client is
+ * connected - a subscriber of an event stream. ESP8266 refuses single connection mode while
+ * any link is open, so beginPassThrough() must close the link and forget the subscription.
+ * After endPassThrough() the server must serve requests again.
+ *
+ *     make test
+ */
+#include "sim.h"
+#include "ESP8266_HTTP.h"
+#include <string>
+
+#if !ESP8266_PASSTHROUGH
+#error "The test requires ESP8266_PASSTHROUGH enabled"
+#endif
+
+#define RX_PIN  4
+#define TX_PIN  6
+#define RST_PIN 5
+
+#define BAUD 9600
+#define DEADLINE 2000000ULL // us of virtual time
+
+#define SUBSCRIBE "GET /events HTTP/1.1\r\nHost: 192.168.1.20\r\nAccept: text/event-stream\r\n\r\n"
+#define REQUEST "GET / HTTP/1.1\r\nHost: esp8266\r\nUser-Agent: test\r\nAccept: */*\r\n\r\n"
+#define DATA "time,value\n1200,215\n1260,217\n"
+
+const char PROGMEM_PAGE[] PROGMEM = "HTTP/1.1 200 OK\r\nConnection: Closed\r\nContent-Type: text/html\r\n\r\n"
+        "<html><body><h1>ESP8266</h1></body></html>";
+
+
+static void sendPage(ESP8266_HTTP & server, Route * /* route */, char channel) {
+    server.send_PROGMEM(PROGMEM_PAGE);
+    server.send(channel);
+    server.closeConnection(channel);
+}
+
+
+static void run(SimBoard & board, ESP8266_HTTP * server) {
+    unsigned long long start = board.now();
+    while (board.now() - start < DEADLINE)
+        server->update();
+}
+
+
+int main() {
+    int failures = 0;
+    SimBoard board;
+    if (getenv("SIM_TRACE") != NULL)
+        board.trace = stderr;
+    host_attach(&board);
+    board.setResetPin(RST_PIN);
+    ESP8266_HTTP * server = new ESP8266_HTTP(RX_PIN, TX_PIN, RST_PIN, BAUD);
+    if (server->start("test", "password", "80") != 0) {
+        printf("FAIL start() failed\n");
+        failures++;
+    }
+    else {
+        server->registerRoute(GET, "/", sendPage);
+        server->registerEventStream("/events");
+        board.clientTimeout = DEADLINE * 10;
+        board.addClient(SUBSCRIBE, 200);
+        board.setBudget(1);
+        run(board, server);
+        byte subscribed = server->subscribers("/events");
+
+        bool begun = server->beginPassThrough("192.168.1.2", "5000");
+        server->passThrough(DATA, strlen(DATA));
+        run(board, server);
+        bool sent = (board.outbound[0] == DATA);
+        byte left = server->subscribers("/events");
+        bool ended = begun && server->endPassThrough();
+
+        // The server again
+        board.removeClients();
+        board.resetCounters();
+        board.addClient(REQUEST, 200);
+        board.setBudget(1);
+        run(board, server);
+
+        printf("subscribers %u, pass-through %s, %u B sent, subscribers %u, server %s, request %s\n",
+                subscribed, begun ? "begun" : "refused", (unsigned int)board.outbound[0].size(), left,
+                ended ? "restored" : "not restored", board.served == 1 ? "served" : "not served");
+        if (subscribed != 1) {
+            printf("FAIL client did not subscribe\n");
+            failures++;
+        }
+        if (!begun || !sent) {
+            printf("FAIL pass-through session with a client connected\n");
+            failures++;
+        }
+        if (left != 0) {
+            printf("FAIL subscription of the closed link kept\n");
+            failures++;
+        }
+        if (!ended || board.served != 1) {
+            printf("FAIL server not restored\n");
+            failures++;
+        }
+    }
+    delete server;
+    host_attach(NULL);
+
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * Health probe against the simulated ESP8266 (see sim.h): a client which keeps its connection
+ * open sends a request just when the idle server probes ESP8266 by "AT". Its "+IPD" frame comes
+ * before the reply of the probe - the request must be served and the probe must not fail.
+ *
+ *     make test
+ */
+#include "sim.h"
+#include "ESP8266_HTTP.h"
+#include <string>
+
+#define RX_PIN  4
+#define TX_PIN  6
+#define RST_PIN 5
+
+#define BAUD 9600
+#define DEADLINE 2000000ULL // us of virtual time after the probe
+
+#define REQUEST "GET / HTTP/1.1\r\nHost: esp8266\r\nUser-Agent: test\r\nAccept: */*\r\n\r\n"
+
+const char PROGMEM_PAGE[] PROGMEM = "HTTP/1.1 200 OK\r\nConnection: Closed\r\nContent-Type: text/html\r\n\r\n"
+        "<html><body><h1>ESP8266</h1></body></html>";
+
+
+static void sendPage(ESP8266_HTTP & server, Route * /* route */, char channel) {
+    server.send_PROGMEM(PROGMEM_PAGE);
+    server.send(channel);
+    server.closeConnection(channel);
+}
+
+
+// Sends the request of the open link right before the first AT command written while armed
+class ProbeBoard : public SimBoard
+{
+public:
+    ProbeBoard() : link(-1), armed(false), probed(false), _lineStart(true) {}
+
+    void write(uint8_t c) {
+        if (armed && _lineStart && c == 'A') {
+            armed = false;
+            probed = true;
+            esp.received(link, REQUEST, strlen(REQUEST), now());
+        }
+        _lineStart = (c == '\n');
+        SimBoard::write(c);
+    }
+
+    int link;
+    bool armed;
+    bool probed;
+private:
+    bool _lineStart;
+};
+
+
+int main() {
+    int failures = 0;
+    ProbeBoard board;
+    if (getenv("SIM_TRACE") != NULL)
+        board.trace = stderr;
+    host_attach(&board);
+    board.setResetPin(RST_PIN);
+    ESP8266_HTTP * server = new ESP8266_HTTP(RX_PIN, TX_PIN, RST_PIN, BAUD);
+    if (server->start("test", "password", "80") != 0) {
+        printf("FAIL start() failed\n");
+        failures++;
+    }
+    else {
+        server->registerRoute(GET, "/", sendPage);
+        board.link = board.esp.accept(board.now());
+        unsigned long long start = board.now();
+        while (board.now() - start < DEADLINE)
+            server->update();
+        // Nothing else happens until the probe
+        board.armed = true;
+        start = board.now();
+        while (!board.probed && board.now() - start < (HEALTH_PROBE_INTERVAL + 1000) * 1000ULL)
+            server->update();
+        start = board.now();
+        while (board.now() - start < DEADLINE)
+            server->update();
+
+        const std::string & response = board.outbound[board.link];
+        printf("request during the probe: %s\n", response.substr(0, response.find('\r')).c_str());
+        if (!board.probed) {
+            printf("FAIL no probe\n");
+            failures++;
+        }
+        if (response.compare(0, 15, "HTTP/1.1 200 OK") != 0) {
+            printf("FAIL request sent during the probe not served\n");
+            failures++;
+        }
+        if (server->getHealth()->failures != 0 || server->uptime() == 0) {
+            printf("FAIL probe failed\n");
+            failures++;
+        }
+    }
+    delete server;
+    host_attach(NULL);
+
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,71 @@
+/*
+ * ESP8266_SampleStore with SAMPLE_DELTA_ENCODING (built with SAMPLE_STORE_CAPACITY=10000):
+ * samples after jumps over 127 are stored whole, get() must return every appended value.
+ * With more jumps in the store than SAMPLE_DELTA_ESCAPES the store starts at the oldest
+ * one kept - shorter, never wrong.
+ *
+ *     make test
+ */
+#include "host.h"
+#include "ESP8266_SampleStore.h"
+#include <vector>
+
+#if !SAMPLE_DELTA_ENCODING
+#error "The test requires SAMPLE_DELTA_ENCODING"
+#endif
+
+
+// Compares the store with the newest of the appended values
+static int check(const char * name, ESP8266_SampleStore & store, const std::vector<int> & values, unsigned int expected) {
+    printf("%-10s appended %u, kept %u\n", name, (unsigned int)values.size(), store.size());
+    if (store.size() != expected) {
+        printf("FAIL %s: %u samples kept, %u expected\n", name, store.size(), expected);
+        return 1;
+    }
+    size_t offset = values.size() - store.size();
+    for (unsigned int i = 0; i < store.size(); i++) {
+        if (store.get(i) != values[offset + i]) {
+            printf("FAIL %s: sample %u is %d, %d appended\n", name, i, store.get(i), values[offset + i]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+int main() {
+    int failures = 0;
+
+    // Steps over 127 in both directions, the extremes of int included
+    std::vector<int> steps;
+    ESP8266_SampleStore store(1);
+    const int levels[] = { 20, 200, -300, 32767, -32768, 0, 128, 0, -128 };
+    for (unsigned int i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+        for (int n = 0; n < 50; n++) {
+            steps.push_back(levels[i] + n % 3);
+            store.append(steps.back());
+        }
+    }
+    failures += check("steps", store, steps, steps.size());
+
+    // Jumps every 3000 samples - the ring overwrites samples stored whole as well
+    std::vector<int> ring;
+    store.clear();
+    for (unsigned int i = 0; i < 25000; i++) {
+        ring.push_back((i / 3000) % 2 ? 1000 + i % 7 : i % 5);
+        store.append(ring.back());
+    }
+    failures += check("ring", store, ring, SAMPLE_STORE_CAPACITY);
+
+    // Jump every 10 samples - only the last SAMPLE_DELTA_ESCAPES jumps are kept
+    std::vector<int> square;
+    store.clear();
+    for (unsigned int i = 0; i < 1000; i++) {
+        square.push_back((i / 10) % 2 ? 500 : -500);
+        store.append(square.back());
+    }
+    failures += check("square", store, square, (SAMPLE_DELTA_ESCAPES + 1) * 10);
+
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures ? 1 : 0;
+}
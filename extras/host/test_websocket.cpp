@@ -0,0 +1,104 @@
+/*
+ * WebSocket opening handshake against the simulated ESP8266 (see sim.h) with the upgrade
+ * request of a browser - bigger than the RX_BUFFER, Sec-WebSocket-Key near its end.
+ * The key must be kept from the overflowing part in both receive modes and answered by
+ * 101 Switching Protocols with the right Sec-WebSocket-Accept (the example of RFC 6455).
+ * Header names are case insensitive - the same request is sent with lower case names too.
+ *
+ *     make test
+ */
+#include "sim.h"
+#include "ESP8266_HTTP.h"
+#include <string>
+
+#define RX_PIN  4
+#define TX_PIN  6
+#define RST_PIN 5
+
+#define BAUD 9600
+#define DEADLINE 5000000ULL // us of virtual time
+
+// 546 bytes like Chrome sends, Sec-WebSocket-Key after 429 of them
+#define UPGRADE "GET /ws HTTP/1.1\r\nHost: 192.168.1.20\r\nConnection: Upgrade\r\nPragma: no-cache\r\n" \
+        "Cache-Control: no-cache\r\nUser-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 " \
+        "(KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\nUpgrade: websocket\r\n" \
+        "Origin: http://192.168.1.20\r\nSec-WebSocket-Version: 13\r\nAccept-Encoding: gzip, deflate\r\n" \
+        "Accept-Language: en-US,en;q=0.9,cs;q=0.8\r\n" \
+        "Cookie: session=0123456789abcdef0123456789abcdef; theme=dark\r\n" \
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n" \
+        "Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits\r\n\r\n"
+#define ACCEPT "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo="
+
+
+static void control(ESP8266_HTTP & server, char channel, const char * data, size_t len) {
+}
+
+
+// Sends the upgrade request, returns what the client received
+static std::string upgrade(bool passive, const char * request) {
+    SimBoard board;
+    if (getenv("SIM_TRACE") != NULL)
+        board.trace = stderr;
+    host_attach(&board);
+    board.setResetPin(RST_PIN);
+    ESP8266_HTTP * server = new ESP8266_HTTP(RX_PIN, TX_PIN, RST_PIN, BAUD);
+    server->setPassiveMode(passive);
+    std::string response;
+    if (server->start("test", "password", "80") == 0) {
+        server->registerWebSocket("/ws", control);
+        board.clientTimeout = DEADLINE * 2;
+        board.addClient(request, 101);
+        board.setBudget(1);
+        unsigned long long start = board.now();
+        // The connection stays open
+        while (board.now() - start < DEADLINE)
+            server->update();
+        response = board.response(0);
+    }
+    delete server;
+    host_attach(NULL);
+    return response;
+}
+
+
+// The request with lower case header names (e. g. "sec-websocket-key:")
+static std::string lowerNames(const char * request) {
+    std::string lower(request);
+    bool name = false;
+    for (size_t i = 0; i < lower.size(); i++) {
+        if (lower[i] == '\n')
+            name = true;
+        else if (lower[i] == ':')
+            name = false;
+        else if (name)
+            lower[i] = tolower(lower[i]);
+    }
+    return lower;
+}
+
+
+static int check(const char * mode, const char * request) {
+    std::string response = upgrade(strcmp(mode, "passive") == 0, request);
+    std::string status = response.substr(0, response.find('\r'));
+    bool success = response.compare(0, 12, "HTTP/1.1 101") == 0 && response.find(ACCEPT "\r\n") != std::string::npos;
+    printf("%-8s %u B upgrade request%s: %s\n", mode, (unsigned int)strlen(request),
+            strstr(request, "sec-websocket-key:") != NULL ? " (lower case names)" : "",
+            status.empty() ? "no response" : status.c_str());
+    if (!success)
+        printf("FAIL %s: handshake not answered by " ACCEPT "\n", mode);
+    return success ? 0 : 1;
+}
+
+
+int main() {
+    int failures = 0;
+    printf("RX_BUFFER %d B\n", MAX_RX_BUFFER_SIZE);
+    failures += check("active", UPGRADE);
+    failures += check("passive", UPGRADE);
+    std::string lower = lowerNames(UPGRADE);
+    failures += check("active", lower.c_str());
+    failures += check("passive", lower.c_str());
+
+    printf(failures ? "FAILED\n" : "OK\n");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,73 @@
+#!/bin/sh
+# Flash and SRAM cost of the library per feature combination (see "Constants" in README.md).
+#
+#     sh extras/size_report.sh [extra flags ...]      e.g. -DMAX_CONNECTIONS=2
+#
+# With avr-g++ and avr-size the library is compiled for ATmega328P against the Arduino AVR core
+# found in ARDUINO_AVR (directory with cores/, variants/ and libraries/, by default the newest one
+# in ~/.arduino15). Otherwise it is compiled for the host with the stubs of extras/host - the sizes
+# are of x86-64 code, only differences between the combinations mean something.
+# text is Flash, data is Flash and SRAM, bss is SRAM - including one ESP8266_HTTP object as a
+# sketch declares it. Objects are measured before linking, so code removed by --gc-sections
+# (unused methods) is counted.
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+SRC="$ROOT/src"
+OUT=${TMPDIR:-/tmp}/esp8266_size.$$
+trap 'rm -rf "$OUT"' EXIT
+mkdir -p "$OUT"
+printf '#include "ESP8266_HTTP.h"\nESP8266_HTTP server(4, 6, 5);\n' > "$OUT/server.cpp"
+
+if [ -z "$ARDUINO_AVR" ]; then
+    ARDUINO_AVR=$(ls -d "$HOME"/.arduino15/packages/arduino/hardware/avr/* 2>/dev/null | sort -V | tail -1)
+fi
+
+if command -v avr-g++ >/dev/null && command -v avr-size >/dev/null && [ -d "$ARDUINO_AVR/cores/arduino" ]; then
+    TARGET="ATmega328P ($ARDUINO_AVR)"
+    CXX="avr-g++ -mmcu=atmega328p -DF_CPU=16000000L -DARDUINO=10819 -DARDUINO_AVR_UNO -DARDUINO_ARCH_AVR
+        -Os -std=gnu++11 -fno-exceptions -fno-threadsafe-statics -ffunction-sections -fdata-sections
+        -I$ARDUINO_AVR/cores/arduino -I$ARDUINO_AVR/variants/standard -I$ARDUINO_AVR/libraries/SoftwareSerial/src"
+    SIZE=avr-size
+else
+    TARGET="host (avr-g++, avr-size or ARDUINO_AVR not found)"
+    # int has 4 bytes - contexts of resumable handlers need twice the space of AVR
+    CXX="g++ -Os -std=gnu++11 -ffunction-sections -fdata-sections -DESP8266_HOST -DTASK_CONTEXT_SIZE=16 -I$ROOT/extras/host/stubs"
+    SIZE=size
+fi
+
+# name|flags
+COMBINATIONS="default|
+no float|-DESP8266_FLOAT=0
+no metrics|-DESP8266_METRICS=0
+no supervisor|-DESP8266_SUPERVISOR=0
+no saved AP|-DESP8266_SAVE_AP=0
+no pass-through|-DESP8266_PASSTHROUGH=0
+no tasks|-DESP8266_TASKS=0
+no websocket|-DESP8266_WEBSOCKET=0
+memory profiler|-DESP8266_MEMORY=1
+minimal|-DESP8266_FLOAT=0 -DESP8266_METRICS=0 -DESP8266_SUPERVISOR=0 -DESP8266_SAVE_AP=0 -DESP8266_PASSTHROUGH=0 -DESP8266_TASKS=0 -DESP8266_WEBSOCKET=0"
+
+echo "Target: $TARGET"
+[ $# -gt 0 ] && echo "Flags: $*"
+printf "%-16s %8s %6s %6s %9s %8s\n" "combination" "text" "data" "bss" "text +/-" "SRAM +/-"
+
+BASE_TEXT=
+BASE_RAM=
+echo "$COMBINATIONS" | while IFS='|' read -r NAME FLAGS; do
+    DIR="$OUT/$(echo "$NAME" | tr ' ' '_')"
+    mkdir -p "$DIR"
+    for f in "$SRC"/*.cpp "$OUT/server.cpp"; do
+        # shellcheck disable=SC2086
+        $CXX $FLAGS "$@" -I"$SRC" -c "$f" -o "$DIR/$(basename "$f" .cpp).o" || exit 1
+    done
+    # text data bss dec hex filename
+    set -- $($SIZE -t "$DIR"/*.o | tail -1) "$@"
+    TEXT=$1; DATA=$2; BSS=$3
+    shift 6
+    RAM=$((DATA + BSS))
+    if [ -z "$BASE_TEXT" ]; then
+        BASE_TEXT=$TEXT
+        BASE_RAM=$RAM
+    fi
+    printf "%-16s %8d %6d %6d %+9d %+8d\n" "$NAME" "$TEXT" "$DATA" "$BSS" $((TEXT - BASE_TEXT)) $((RAM - BASE_RAM))
+done
@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+"""
+Receiver of datagrams sent by ESP8266_Telemetry.
+
+Prints every record as "<time ms> <sensor> <value>" and reports lost datagrams
+(gaps of the sequence number) and the rate of records once in a while.
+
+    python3 telemetry_receiver.py [--port 5005] [--quiet]
+"""
+import argparse
+import socket
+import struct
+import sys
+import time
+
+HEADER = struct.Struct("<HIB")   # sequence, time of the first record, number of records
+RECORD = struct.Struct("<HBh")   # time since the first record, sensor ID, value
+
+
+def parse(datagram):
+    """Returns (sequence, [(time, sensor, value), ...]), raises ValueError for malformed datagram."""
+    if len(datagram) < HEADER.size:
+        raise ValueError("short datagram (%d bytes)" % len(datagram))
+    sequence, start, count = HEADER.unpack_from(datagram)
+    if len(datagram) != HEADER.size + count * RECORD.size:
+        raise ValueError("%d records do not match %d bytes" % (count, len(datagram)))
+    records = []
+    for i in range(count):
+        delta, sensor, value = RECORD.unpack_from(datagram, HEADER.size + i * RECORD.size)
+        records.append(((start + delta) & 0xFFFFFFFF, sensor, value))
+    return sequence, records
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--bind", default="0.0.0.0", help="address to listen on")
+    parser.add_argument("--port", type=int, default=5005, help="UDP port (TELEMETRY port of the sketch)")
+    parser.add_argument("--quiet", action="store_true", help="print statistics only")
+    parser.add_argument("--interval", type=float, default=10.0, help="seconds between statistics")
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind((args.bind, args.port))
+    sock.settimeout(1.0)
+    print("Listening on %s:%d" % (args.bind, args.port), file=sys.stderr)
+
+    expected = None
+    received = lost = records = 0
+    window_records = 0
+    window_start = time.monotonic()
+    while True:
+        try:
+            datagram, sender = sock.recvfrom(2048)
+        except socket.timeout:
+            datagram = None
+        except KeyboardInterrupt:
+            break
+        if datagram is not None:
+            try:
+                sequence, batch = parse(datagram)
+            except ValueError as error:
+                print("%s: %s" % (sender[0], error), file=sys.stderr)
+                continue
+            if expected is not None and sequence != expected:
+                gap = (sequence - expected) & 0xFFFF
+                if gap < 0x8000:
+                    lost += gap
+                    print("lost %d datagram(s) before #%d" % (gap, sequence), file=sys.stderr)
+                else:
+                    print("out of order #%d (expected #%d)" % (sequence, expected), file=sys.stderr)
+            expected = (sequence + 1) & 0xFFFF
+            received += 1
+            records += len(batch)
+            window_records += len(batch)
+            if not args.quiet:
+                for record in batch:
+                    print("%d %d %d" % record)
+        now = time.monotonic()
+        if now - window_start >= args.interval:
+            print("%d datagrams, %d records, %d lost datagrams, %.1f records/s"
+                  % (received, records, lost, window_records / (now - window_start)), file=sys.stderr)
+            window_records = 0
+            window_start = now
+    print("%d datagrams, %d records, %d lost datagrams" % (received, records, lost), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,240 @@
+/*
+ * Compile-time configuration of ESP8266_WLAN and ESP8266_HTTP.
+ *
+ * Every value may be overridden by a compiler flag (e.g. -DMAX_RX_BUFFER_SIZE=256
+ * in build_flags of PlatformIO) or by editing this file. Features set to 0 are
+ * not compiled at all, so they cost neither Flash nor SRAM.
+ */
+#ifndef ESP8266_CONFIG_H
+#define ESP8266_CONFIG_H
+
+/*******************************
+ * ---------- LIMITS --------- *
+ *******************************/
+// Size of the RX_BUFFER where received requests are saved
+#ifndef MAX_RX_BUFFER_SIZE
+#define MAX_RX_BUFFER_SIZE 384
+#endif
+
+// Size of the TX_BUFFER where responses are composed by send() methods
+#ifndef MAX_TX_BUFFER_SIZE
+#define MAX_TX_BUFFER_SIZE 192
+#endif
+
+// Number of independent channels (links) served at the same time
+#ifndef MAX_CONNECTIONS
+#define MAX_CONNECTIONS 3
+#endif
+
+// Number of routes which can be registered
+#ifndef MAX_ROUTES
+#define MAX_ROUTES 3
+#endif
+
+// Parameters captured from the path of one request (e.g. "/relay/:id", "/static/*")
+#ifndef MAX_PATH_PARAMS
+#define MAX_PATH_PARAMS 3
+#endif
+
+// Recovery attempts of each kind (reconnect, soft reset) before escalating to the next one
+#ifndef MAX_RESET_ATTEMPTS
+#define MAX_RESET_ATTEMPTS 3
+#endif
+
+// Requests served at the same time, others get 503 SERVICE UNAVAILABLE (see setConcurrencyLimit())
+#ifndef MAX_ACTIVE_REQUESTS
+#define MAX_ACTIVE_REQUESTS MAX_CONNECTIONS
+#endif
+
+// Requests of one channel waiting for response, others get 503 SERVICE UNAVAILABLE
+#ifndef REQUEST_QUEUE_DEPTH
+#define REQUEST_QUEUE_DEPTH 1
+#endif
+
+// Value of "Retry-After" header of 503 SERVICE UNAVAILABLE (s)
+#ifndef RETRY_AFTER
+#define RETRY_AFTER 1
+#endif
+
+// Maximum number of bytes one queued response sends per turn (see stream_PROGMEM())
+#ifndef SEND_BUDGET
+#define SEND_BUDGET 128
+#endif
+
+// Every FAIR_TURN-th chunk goes round robin regardless of priority classes - lower classes are not starved
+#ifndef FAIR_TURN
+#define FAIR_TURN 4
+#endif
+
+// Link ID of the outbound connection (ESP8266_HTTPClient) - ESP8266 has links 0 - 4, the server uses the first MAX_CONNECTIONS
+#ifndef OUTBOUND_LINK
+#define OUTBOUND_LINK 4
+#endif
+#if OUTBOUND_LINK > 4
+#error "OUTBOUND_LINK must be a link ID (max 4)"
+#endif
+#if OUTBOUND_LINK < MAX_CONNECTIONS
+#error "OUTBOUND_LINK is used by the server - lower MAX_CONNECTIONS"
+#endif
+
+// Link ID of the UDP telemetry (ESP8266_Telemetry) - another link not used by the server
+#ifndef TELEMETRY_LINK
+#define TELEMETRY_LINK 3
+#endif
+#if TELEMETRY_LINK > 4 || TELEMETRY_LINK == OUTBOUND_LINK
+#error "TELEMETRY_LINK must be a link ID (max 4) other than OUTBOUND_LINK"
+#endif
+#if TELEMETRY_LINK < MAX_CONNECTIONS
+#error "TELEMETRY_LINK is used by the server - lower MAX_CONNECTIONS"
+#endif
+
+// Maximum size of one telemetry datagram (7 B header + 5 B per record), held in the ESP8266_Telemetry object
+#ifndef TELEMETRY_MTU
+#define TELEMETRY_MTU 67
+#endif
+
+// Records wait in the datagram at most this long (ms)
+#ifndef TELEMETRY_FLUSH_INTERVAL
+#define TELEMETRY_FLUSH_INTERVAL 1000
+#endif
+
+// Batch of samples of ESP8266_HTTPClient, sent as one POST when full (bytes)
+#ifndef CLIENT_BATCH_SIZE
+#define CLIENT_BATCH_SIZE 128
+#endif
+
+// Samples wait in the batch at most this long (ms)
+#ifndef CLIENT_FLUSH_INTERVAL
+#define CLIENT_FLUSH_INTERVAL 10000
+#endif
+
+// Maximum waiting time for a response of the collector (ms)
+#ifndef CLIENT_TIMEOUT
+#define CLIENT_TIMEOUT 5000
+#endif
+
+// State of a resumable handler which survives yielding (bytes per connection)
+#ifndef TASK_CONTEXT_SIZE
+#define TASK_CONTEXT_SIZE 8
+#endif
+
+// Number of samples kept by ESP8266_SampleStore (1 B each with SAMPLE_DELTA_ENCODING, 2 B otherwise)
+#ifndef SAMPLE_STORE_CAPACITY
+#define SAMPLE_STORE_CAPACITY 128
+#endif
+
+// Stores differences of successive samples in 1 B, a sample after a jump over 127 is stored whole
+#ifndef SAMPLE_DELTA_ENCODING
+#define SAMPLE_DELTA_ENCODING 0
+#endif
+
+// Samples stored whole (4 B each on AVR) - with more jumps in the store it starts at the oldest one kept
+#ifndef SAMPLE_DELTA_ESCAPES
+#define SAMPLE_DELTA_ESCAPES 8
+#endif
+
+// Maximum size of one Server-Sent Event including "event:" and "data:" fields
+#ifndef MAX_EVENT_SIZE
+#define MAX_EVENT_SIZE 64
+#endif
+
+/*******************************
+ * --------- TIMEOUTS -------- *
+ *******************************/
+// Maximum waiting time for a response to an AT command (ms)
+#ifndef AT_TIMEOUT
+#define AT_TIMEOUT 5000
+#endif
+
+// Maximum waiting time for joining Access Point (ms)
+#ifndef JOIN_TIMEOUT
+#define JOIN_TIMEOUT 20000
+#endif
+
+// Maximum waiting time for "ready" after restart of ESP8266 (ms)
+#ifndef READY_TIMEOUT
+#define READY_TIMEOUT 5000
+#endif
+
+// Event streams get a comment (WebSocket links a ping) this often, so that dead links are closed and live ones are not timed out (ms)
+#ifndef EVENT_HEARTBEAT
+#define EVENT_HEARTBEAT 15000
+#endif
+
+// How long warmStart() waits for ESP8266 to answer the probe (ms)
+#ifndef WARM_START_TIMEOUT
+#define WARM_START_TIMEOUT 300
+#endif
+
+/*******************************
+ * --------- FEATURES -------- *
+ *******************************/
+// send(float) and sendln(float) - pulls float formatting of avr-libc
+#ifndef ESP8266_FLOAT
+#define ESP8266_FLOAT 1
+#endif
+
+// Save Access Point to the flash of ESP8266 (AT+CWJAP_DEF) so it rejoins by itself
+// after its own reset. Requires AT firmware 1.5 or newer.
+#ifndef ESP8266_SAVE_AP
+#define ESP8266_SAVE_AP 1
+#endif
+
+// Background health monitor with automatic recovery - getHealth(), uptime()
+#ifndef ESP8266_SUPERVISOR
+#define ESP8266_SUPERVISOR 1
+#endif
+
+#if ESP8266_SUPERVISOR
+// ESP8266 is probed by "AT" after this long silence on the serial link, 0 disables probing (ms)
+#ifndef HEALTH_PROBE_INTERVAL
+#define HEALTH_PROBE_INTERVAL 30000
+#endif
+
+// How long update() waits for the reply of the probe (ms)
+#ifndef HEALTH_PROBE_TIMEOUT
+#define HEALTH_PROBE_TIMEOUT 100
+#endif
+
+// How long ESP8266 may rejoin Access Point by itself after "WIFI DISCONNECT" (ms)
+#ifndef RECONNECT_GRACE
+#define RECONNECT_GRACE 15000
+#endif
+
+// Consecutive AT timeouts or failed sends which are treated as malfunction
+#ifndef MAX_AT_FAILURES
+#define MAX_AT_FAILURES 3
+#endif
+
+// Delay before the first recovery attempt, doubled with every failed attempt (ms)
+#ifndef RECOVERY_BACKOFF
+#define RECOVERY_BACKOFF 1000
+#endif
+#endif
+
+// Performance counters - getMetrics(), latencyPercentile(), ...
+#ifndef ESP8266_METRICS
+#define ESP8266_METRICS 1
+#endif
+
+// Transparent transmission to one outbound connection - beginPassThrough(), passThrough(), ...
+#ifndef ESP8266_PASSTHROUGH
+#define ESP8266_PASSTHROUGH 1
+#endif
+
+// WebSocket routes of ESP8266_HTTP - registerWebSocket(), sendWebSocket(), ...
+#ifndef ESP8266_WEBSOCKET
+#define ESP8266_WEBSOCKET 1
+#endif
+
+// Resumable (protothread) route handlers of ESP8266_HTTP - registerTask(), TASK_BEGIN(), ...
+#ifndef ESP8266_TASKS
+#define ESP8266_TASKS 1
+#endif
+
+// SRAM profiler of ESP8266_HTTP - stack painting, heap, peak stack per route (AVR only, slows update() down)
+#ifndef ESP8266_MEMORY
+#define ESP8266_MEMORY 0
+#endif
+
+#endif
@@ -0,0 +1,353 @@
+#include "ESP8266_Encoder.h"
+
+
+const char PROGMEM_ENCODER_HEADER[] PROGMEM = "HTTP/1.1 200 OK\r\nConnection: Closed\r\nVary: Accept\r\nContent-Type: application/";
+const char PROGMEM_ENCODER_JSON[] PROGMEM = "json";
+const char PROGMEM_ENCODER_CBOR[] PROGMEM = "cbor";
+const char PROGMEM_ENCODER_LENGTH[] PROGMEM = "\r\nContent-Length: ";
+const char PROGMEM_ENCODER_END[] PROGMEM = "00000\r\n\r\n";
+const char PROGMEM_ENCODER_ERROR[] PROGMEM = "HTTP/1.1 500 INTERNAL SERVER ERROR\r\nConnection: Closed\r\nContent-Length: 0\r\n\r\n";
+const char PROGMEM_CBOR_TYPE[] PROGMEM = "application/cbor";
+/**
+ * HTTP/1.1 200 OK\r\n
+ * Connection: Closed\r\n
+ * Vary: Accept\r\n
+ * Content-Type: application/cbor\r\n
+ * Content-Length: 00014\r\n     <- patched by send()
+ * \r\n
+ * BF 64 74 65 6D 70 18 D7 ... FF
+ */
+
+#define CONTENT_LENGTH_DIGITS 5
+
+// Major types of CBOR (RFC 8949)
+#define CBOR_UNSIGNED 0
+#define CBOR_NEGATIVE 1
+#define CBOR_TEXT     3
+#define CBOR_INDEFINITE_ARRAY 0x9F
+#define CBOR_INDEFINITE_MAP   0xBF
+#define CBOR_FALSE  0xF4
+#define CBOR_TRUE   0xF5
+#define CBOR_NULL   0xF6
+#define CBOR_FLOAT  0xFA
+#define CBOR_BREAK  0xFF
+
+
+/**
+ * @brief Chooses CBOR when the Accept header of the request being handled lists application/cbor,
+ * JSON otherwise. Construct it in the handler before anything else is sent.
+ */
+ESP8266_Encoder::ESP8266_Encoder(ESP8266_HTTP & server)
+    : _server(server)
+{
+    begin(server.accepts_P(PROGMEM_CBOR_TYPE) ? FORMAT_CBOR : FORMAT_JSON);
+}
+
+
+/**
+ * @param format FORMAT_JSON or FORMAT_CBOR regardless of the Accept header.
+ */
+ESP8266_Encoder::ESP8266_Encoder(ESP8266_HTTP & server, byte format)
+    : _server(server)
+{
+    begin(format);
+}
+
+
+// Destructor
+ESP8266_Encoder::~ESP8266_Encoder() {}
+
+
+// Writes the header with Content-Length to be patched
+void ESP8266_Encoder::begin(byte format) {
+    _format = format;
+    _depth = 0;
+    _first = 0;
+    _afterKey = false;
+    _overflow = false;
+    _server.send_PROGMEM(PROGMEM_ENCODER_HEADER);
+    _server.send_PROGMEM(_format == FORMAT_CBOR ? PROGMEM_ENCODER_CBOR : PROGMEM_ENCODER_JSON);
+    _server.send_PROGMEM(PROGMEM_ENCODER_LENGTH);
+    _lengthAt = _server.CUR_TX_BUFFER_SIZE;
+    _server.send_PROGMEM(PROGMEM_ENCODER_END);
+    _start = _server.CUR_TX_BUFFER_SIZE;
+    _size = 0;
+}
+
+
+void ESP8266_Encoder::beginObject() {
+    open(CBOR_INDEFINITE_MAP, '{');
+}
+
+
+void ESP8266_Encoder::endObject() {
+    close('}');
+}
+
+
+void ESP8266_Encoder::beginArray() {
+    open(CBOR_INDEFINITE_ARRAY, '[');
+}
+
+
+void ESP8266_Encoder::endArray() {
+    close(']');
+}
+
+
+/**
+ * @brief Writes name of the member of the object, its value is written next.
+ * @param name Name saved in RAM.
+ */
+void ESP8266_Encoder::key(const char * name) {
+    separate();
+    text(name, strlen(name), false);
+    if (_format == FORMAT_JSON) {
+        write(":", 1);
+        _afterKey = true;
+    }
+}
+
+
+/**
+ * @param name Name saved in Flash (PROGMEM), e. g. PSTR("temp").
+ */
+void ESP8266_Encoder::key_P(const char * name) {
+    separate();
+    text(name, strlen_P(name), true);
+    if (_format == FORMAT_JSON) {
+        write(":", 1);
+        _afterKey = true;
+    }
+}
+
+
+void ESP8266_Encoder::value(long number) {
+    separate();
+    if (_format == FORMAT_CBOR) {
+        // Negative n is encoded as -1 - n
+        if (number >= 0)
+            head(CBOR_UNSIGNED, number);
+        else
+            head(CBOR_NEGATIVE, -1 - number);
+        return;
+    }
+    char buf[12];
+    ltoa(number, buf, 10);
+    write(buf, strlen(buf));
+}
+
+
+/**
+ * @param text Terminated UTF-8 text saved in RAM, escaped for JSON.
+ */
+void ESP8266_Encoder::value(const char * text) {
+    separate();
+    this->text(text, strlen(text), false);
+}
+
+
+void ESP8266_Encoder::value_P(const char * text) {
+    separate();
+    this->text(text, strlen_P(text), true);
+}
+
+
+#if ESP8266_FLOAT
+/**
+ * @param number Written as single precision float by CBOR, with 2 decimals by JSON (like send(float)).
+ * NaN and infinity are null in JSON.
+ */
+void ESP8266_Encoder::value(float number) {
+    separate();
+    if (_format == FORMAT_CBOR) {
+        uint32_t bits;
+        memcpy(&bits, &number, sizeof(bits));
+        char buf[5] = { (char)CBOR_FLOAT, (char)(bits >> 24), (char)(bits >> 16), (char)(bits >> 8), (char)bits };
+        write(buf, sizeof(buf));
+        return;
+    }
+    if (isnan(number) || isinf(number)) {
+        write("null", 4);
+        return;
+    }
+    // printf of avr-libc does not format floats
+    char buf[48];
+    dtostrf(number, 1, 2, buf);
+    write(buf, strlen(buf));
+}
+#endif
+
+
+void ESP8266_Encoder::boolean(bool flag) {
+    separate();
+    if (_format == FORMAT_CBOR) {
+        char c = flag ? CBOR_TRUE : CBOR_FALSE;
+        write(&c, 1);
+    }
+    else if (flag)
+        write("true", 4);
+    else
+        write("false", 5);
+}
+
+
+void ESP8266_Encoder::null() {
+    separate();
+    if (_format == FORMAT_CBOR) {
+        char c = CBOR_NULL;
+        write(&c, 1);
+    }
+    else
+        write("null", 4);
+}
+
+
+/**
+ * @brief Patches Content-Length and sends the response by one AT+CIPSEND (only the header
+ * for HEAD request). The connection is left open - close it after.
+ * When the response did not fit into the TX_BUFFER, 500 INTERNAL SERVER ERROR is sent instead.
+ * @return true when success.
+ */
+bool ESP8266_Encoder::send(char channel) {
+    if (isOverflow() || _depth != 0) {
+        _server.CUR_TX_BUFFER_SIZE = 0;
+        _server.send_PROGMEM(PROGMEM_ENCODER_ERROR);
+        _server.send(channel);
+        return false;
+    }
+    size_t len = _size;
+    for (byte i = CONTENT_LENGTH_DIGITS; i > 0; i--) {
+        _server.TX_BUFFER[_lengthAt + i - 1] = '0' + len % 10;
+        len /= 10;
+    }
+    return _server.send(channel);
+}
+
+
+// Comma between members and elements of JSON
+void ESP8266_Encoder::separate() {
+    if (_format != FORMAT_JSON)
+        return;
+    if (_afterKey) {
+        _afterKey = false;
+        return;
+    }
+    if (_depth == 0 || _depth > ENCODER_MAX_DEPTH)
+        return;
+    byte bit = 1 << (_depth - 1);
+    if (_first & bit)
+        _first &= ~bit;
+    else
+        write(",", 1);
+}
+
+
+void ESP8266_Encoder::open(byte cbor, char json) {
+    separate();
+    if (_format == FORMAT_CBOR)
+        write((const char *)&cbor, 1);
+    else
+        write(&json, 1);
+    if (++_depth > ENCODER_MAX_DEPTH)
+        _overflow = true;
+    else
+        _first |= 1 << (_depth - 1);
+}
+
+
+void ESP8266_Encoder::close(char json) {
+    if (_depth == 0)
+        return;
+    _depth--;
+    _afterKey = false;
+    if (_format == FORMAT_CBOR) {
+        char c = (char)CBOR_BREAK;
+        write(&c, 1);
+    }
+    else
+        write(&json, 1);
+}
+
+
+// Initial byte of CBOR data item with the shortest argument
+void ESP8266_Encoder::head(byte major, unsigned long argument) {
+    char buf[5];
+    byte len;
+    major <<= 5;
+    if (argument < 24) {
+        buf[0] = major | argument;
+        len = 1;
+    }
+    else if (argument <= 0xFF) {
+        buf[0] = major | 24;
+        buf[1] = argument;
+        len = 2;
+    }
+    else if (argument <= 0xFFFF) {
+        buf[0] = major | 25;
+        buf[1] = argument >> 8;
+        buf[2] = argument;
+        len = 3;
+    }
+    else {
+        buf[0] = major | 26;
+        buf[1] = argument >> 24;
+        buf[2] = argument >> 16;
+        buf[3] = argument >> 8;
+        buf[4] = argument;
+        len = 5;
+    }
+    write(buf, len);
+}
+
+
+// Text string of CBOR, quoted and escaped string of JSON
+void ESP8266_Encoder::text(const char * text, size_t len, bool progmem) {
+    if (_format == FORMAT_CBOR) {
+        head(CBOR_TEXT, len);
+        write(text, len, progmem);
+        return;
+    }
+    write("\"", 1);
+    char buf[16];
+    byte n = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = progmem ? pgm_read_byte(text + i) : text[i];
+        if (n > sizeof(buf) - 6) {
+            write(buf, n);
+            n = 0;
+        }
+        if (c == '"' || c == '\\') {
+            buf[n++] = '\\';
+            buf[n++] = c;
+        }
+        else if ((byte)c < 0x20) {
+            // \u00XX
+            byte low = c & 0xF;
+            buf[n++] = '\\';
+            buf[n++] = 'u';
+            buf[n++] = '0';
+            buf[n++] = '0';
+            buf[n++] = '0' + (c >> 4);
+            buf[n++] = (low < 10) ? '0' + low : 'a' + low - 10;
+        }
+        else {
+            buf[n++] = c;
+        }
+    }
+    write(buf, n);
+    write("\"", 1);
+}
+
+
+/**
+ * @brief Appends to the TX_BUFFER. Progmem data must be a whole terminated string.
+ */
+void ESP8266_Encoder::write(const char * data, size_t len, bool progmem) {
+    if (progmem)
+        _server.send_PROGMEM(data);
+    else
+        _server.send(data, len);
+    _size += len;
+}
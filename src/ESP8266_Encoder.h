@@ -0,0 +1,78 @@
+/*
+ * Response writer with content negotiation - the handler writes its fields once and the client
+ * gets JSON or CBOR (RFC 8949, 2-4x smaller for numeric data) according to its Accept header.
+ */
+#ifndef ESP8266_ENCODER_H
+#define ESP8266_ENCODER_H
+
+#include "ESP8266_HTTP.h"
+#include <avr/pgmspace.h>
+
+enum EncoderFormat { FORMAT_JSON, FORMAT_CBOR };
+
+// Nesting of objects and arrays (JSON needs to know whether a comma is due)
+#define ENCODER_MAX_DEPTH 8
+
+
+/**
+ * Writes the whole response into the TX_BUFFER - the header with Content-Length patched
+ * when the body is finished. Objects and arrays of CBOR are of indefinite length.
+ *
+ * ESP8266_Encoder out(server);   // application/cbor when the client accepts it
+ * out.beginObject();
+ * out.key_P(PSTR("temp"));
+ * out.value(215);
+ * out.endObject();
+ * out.send(channel);
+ */
+class ESP8266_Encoder
+{
+public:
+    ESP8266_Encoder(ESP8266_HTTP & server);
+    ESP8266_Encoder(ESP8266_HTTP & server, byte format);
+    ~ESP8266_Encoder();
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+
+    void key(const char * name);
+    void key_P(const char * name);
+    void value(int number) { value((long)number); }
+    void value(long number);
+    void value(const char * text);
+    void value_P(const char * text);
+#if ESP8266_FLOAT
+    void value(float number);
+#endif
+    void boolean(bool flag);
+    void null();
+
+    bool send(char channel);
+
+    byte format() { return _format; }
+    size_t size() { return _size; }
+    bool isOverflow() { return _overflow || _server.CUR_TX_BUFFER_SIZE < _start + _size; }
+private:
+    void begin(byte format);
+    void separate();
+    void open(byte cbor, char json);
+    void close(char json);
+    void head(byte major, unsigned long argument);
+    void text(const char * text, size_t len, bool progmem);
+    void write(const char * data, size_t len, bool progmem = false);
+
+    ESP8266_HTTP & _server;
+    byte _format;
+    byte _depth;
+    byte _first;     // bit per depth - no member written yet (JSON)
+    bool _afterKey;  // value of a member is due (JSON)
+    bool _overflow;  // nesting deeper than ENCODER_MAX_DEPTH
+    size_t _lengthAt; // digits of Content-Length in the TX_BUFFER
+    size_t _start;    // start of the body in the TX_BUFFER
+    size_t _size;     // bytes of the body written
+};
+
+
+#endif
@@ -22,15 +22,134 @@ const char PROGMEM_HTTP_NOT_FOUND[] PROGMEM = "HTTP/1.1 404 NOT FOUND\r\nConnect
  */
 
 
+const char PROGMEM_HTTP_METHOD_NOT_ALLOWED[] PROGMEM = "HTTP/1.1 405 METHOD NOT ALLOWED\r\nConnection: Closed\r\nContent-Length: 0\r\nAllow: ";
+/**
+ * HTTP/1.1 405 METHOD NOT ALLOWED\r\n
+ * Connection: Closed\r\n
+ * Content-Length: 0\r\n
+ * Allow: GET, POST\r\n
+ * \r\n
+ */
+
+#define STRINGIFY(x) #x
+#define TO_STRING(x) STRINGIFY(x)
+const char PROGMEM_HTTP_OPTIONS[] PROGMEM = "HTTP/1.1 204 NO CONTENT\r\nConnection: Closed\r\nAllow: ";
+/**
+ * HTTP/1.1 204 NO CONTENT\r\n
+ * Connection: Closed\r\n
+ * Allow: GET, HEAD, OPTIONS\r\n
+ * \r\n
+ */
+
+const char PROGMEM_HTTP_EVENT_STREAM[] PROGMEM = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\nConnection: keep-alive\r\n\r\n";
+/**
+ * HTTP/1.1 200 OK\r\n
+ * Content-Type: text/event-stream\r\n
+ * Cache-Control: no-cache\r\n
+ * Connection: keep-alive\r\n
+ * \r\n
+ */
+
+// Comment line of event stream
+const char PROGMEM_EVENT_HEARTBEAT[] PROGMEM = ":\n\n";
+
+const char PROGMEM_HTTP_SERVICE_UNAVAILABLE[] PROGMEM = "HTTP/1.1 503 SERVICE UNAVAILABLE\r\nConnection: Closed\r\nRetry-After: " TO_STRING(RETRY_AFTER) "\r\nContent-Length: 0\r\n\r\n";
+/**
+ * HTTP/1.1 503 SERVICE UNAVAILABLE\r\n
+ * Connection: Closed\r\n
+ * Retry-After: 1\r\n
+ * Content-Length: 0\r\n
+ * \r\n
+ */
+
+#if ESP8266_WEBSOCKET
+const char PROGMEM_HTTP_SWITCHING_PROTOCOLS[] PROGMEM = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: ";
+/**
+ * HTTP/1.1 101 Switching Protocols\r\n
+ * Upgrade: websocket\r\n
+ * Connection: Upgrade\r\n
+ * Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n
+ * \r\n
+ */
+
+const char PROGMEM_HTTP_BAD_REQUEST[] PROGMEM = "HTTP/1.1 400 BAD REQUEST\r\nConnection: Closed\r\nContent-Length: 0\r\n\r\n";
+/**
+ * HTTP/1.1 400 BAD REQUEST\r\n
+ * Connection: Closed\r\n
+ * Content-Length: 0\r\n
+ * \r\n
+ */
+
+const char PROGMEM_WEBSOCKET_KEY[] PROGMEM = "Sec-WebSocket-Key:";
+const char PROGMEM_WEBSOCKET_GUID[] PROGMEM = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+const char PROGMEM_BASE64[] PROGMEM = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// WebSocket frame (RFC 6455)
+#define WS_FIN          0x80
+#define WS_MASKED       0x80
+#define WS_CONTINUATION 0x0
+#define WS_TEXT         0x1
+#define WS_BINARY       0x2
+#define WS_CLOSE        0x8
+#define WS_PING         0x9
+#define WS_PONG         0xA
+// States of the parser of client frames
+enum WebSocketState { WS_OPCODE, WS_LENGTH, WS_EXTENDED, WS_MASK, WS_PAYLOAD };
+#endif
+
+const char PROGMEM_ACCEPT[] PROGMEM = "Accept:";
+
+#if ESP8266_MEMORY
+const char PROGMEM_HTTP_MEMORY[] PROGMEM = "HTTP/1.1 200 OK\r\nConnection: Closed\r\nContent-Type: text/plain\r\nCache-Control: no-store\r\n\r\n";
+const char PROGMEM_MEMORY_FREE[] PROGMEM = "free: %u B, least %u B\n";
+const char PROGMEM_MEMORY_STACK[] PROGMEM = "stack peak: %u B\n";
+const char PROGMEM_MEMORY_HEAP[] PROGMEM = "heap: %u B, %u B free in %u blocks (largest %u B)\n";
+const char PROGMEM_MEMORY_OTHER[] PROGMEM = "no route: %u B\n";
+const char PROGMEM_MEMORY_ROUTE[] PROGMEM = "route %u %s: %u B\n";
+/**
+ * free: 412 B, least 236 B
+ * stack peak: 296 B
+ * heap: 0 B, 0 B free in 0 blocks (largest 0 B)
+ * no route: 180 B
+ * route 1 /state: 296 B
+ */
+#endif
+
+const char PROGMEM_METHOD_GET[] PROGMEM = "GET";
+const char PROGMEM_METHOD_HEAD[] PROGMEM = "HEAD";
+const char PROGMEM_METHOD_POST[] PROGMEM = "POST";
+const char PROGMEM_METHOD_PUT[] PROGMEM = "PUT";
+const char PROGMEM_METHOD_DELETE[] PROGMEM = "DELETE";
+const char PROGMEM_METHOD_TRACE[] PROGMEM = "TRACE";
+const char PROGMEM_METHOD_OPTIONS[] PROGMEM = "OPTIONS";
+const char PROGMEM_METHOD_CONNECT[] PROGMEM = "CONNECT";
+const char PROGMEM_METHOD_PATCH[] PROGMEM = "PATCH";
+// Indexed by HTTP_Method
+const char * const PROGMEM_METHODS[] PROGMEM = {
+    PROGMEM_METHOD_GET, PROGMEM_METHOD_HEAD, PROGMEM_METHOD_POST,
+    PROGMEM_METHOD_PUT, PROGMEM_METHOD_DELETE, PROGMEM_METHOD_TRACE,
+    PROGMEM_METHOD_OPTIONS, PROGMEM_METHOD_CONNECT, PROGMEM_METHOD_PATCH
+};
+
+
 /*******************************
  * ---------- ROUTE ---------- *
  *******************************/
 // Constructor
 Route::Route() {
     _id = 0;
+    _priority = PRIORITY_NORMAL;
     _method = HTTP_Method::HTTP_METHOD_LENGTH;
+    _handler = NULL;
+#if ESP8266_WEBSOCKET
+    _onMessage = NULL;
+#endif
+#if ESP8266_TASKS
+    _task = NULL;
+#endif
     _path = NULL;
     _params = NULL;
+    _data = NULL;
 }
 
 
@@ -49,26 +168,62 @@ Route::Route(HTTP_Method method, const char * path) {
 
 void Route::set(byte ID, HTTP_Method method, const char * path) {
     _id = ID;
+    _priority = PRIORITY_NORMAL;
+    _handler = NULL;
+#if ESP8266_WEBSOCKET
+    _onMessage = NULL;
+#endif
+#if ESP8266_TASKS
+    _task = NULL;
+#endif
     _method = method;
-    size_t len = strlen(path);
-    _path = new char[len + 1];
-    strcpy(_path, path);
+    // Not copied - path is expected to be a string literal
+    _path = path;
+    _params = NULL;
+    _data = NULL;
 }
 
 
 /**
  * @brief Sets the received parameters of the evoked route
- * @param params string of params in format for example a=5&b=7, NULL does not save anything
+ * @param params string of params in format for example a=5&b=7 inside the request (not copied), NULL when none
  */
-void Route::setParams(const char * params) {
-    if (params == NULL) {
-        _params = NULL;
-    }
-    else {
-        size_t len = strlen(params);
-        _params = new char[len + 1];
-        strcpy(_params, params);
+void Route::setParams(char * params) {
+    _params = params;
+}
+
+
+/**
+ * @brief Finds parameter of the query (e. g. "b" of "a=5&b=7").
+ * @param name Name of the parameter.
+ * @return Value of the parameter ended by '&' or '\0' (not terminated), NULL when missing.
+ */
+const char * Route::getParam(const char * name) {
+    size_t len = strlen(name);
+    for (const char * p = _params; p != NULL; p = strchr(p, '&')) {
+        if (*p == '&')
+            p++;
+        if (strncmp(p, name, len) == 0 && p[len] == '=')
+            return p + len + 1;
     }
+    return NULL;
+}
+
+
+/**
+ * @brief Parses parameter of the query as decimal number (optional sign).
+ * @return false when the parameter is missing or it is not a number.
+ */
+bool Route::getParamInt(const char * name, long * value) {
+    const char * param = getParam(name);
+    if (param == NULL)
+        return false;
+    char * end;
+    long number = strtol(param, &end, 10);
+    if (end == param || (*end != '\0' && *end != '&'))
+        return false;
+    *value = number;
+    return true;
 }
 
 
@@ -83,6 +238,8 @@ bool Route::operator==(const Route & route) {
 // Constructor
 Router::Router() {
     _size = 0;
+    _matched = NULL;
+    _paramCount = 0;
 }
 
 
@@ -93,11 +250,32 @@ Router::~Router() {}
 /**
  * @brief Routes which are not registered will be automatically refused with 404 NOT FOUND.
  * @param method HTTP_Method enum specifies HTTP method.
- * @param path corresponding URL path with the method (example: "/test").
+ * @param path corresponding URL path with the method (example: "/test"). It is not copied,
+ * pass a string literal. Segment ":name" matches any one segment (e. g. "/relay/:id"),
+ * "*" at the end matches the rest of the path (e. g. "/static/" followed by '*').
+ * @param priority Priority class of responses queued by streamResponse_PROGMEM().
+ * @return false when MAX_ROUTES routes are registered already.
  */
-void Router::registerRoute(HTTP_Method method, const char * path) {
+bool Router::registerRoute(HTTP_Method method, const char * path, byte priority) {
+    if (_size >= MAX_ROUTES)
+        return false;
     _routes[_size].set(_size + 1, method, path);
+    _routes[_size].setPriority(priority);
     _size++;
+    return true;
+}
+
+
+/**
+ * @brief Registers route served by handler directly in ESP8266_HTTP::update().
+ * HEAD is derived from GET route automatically, OPTIONS is answered from the route table.
+ * @param handler Function called for every request of the route.
+ */
+bool Router::registerRoute(HTTP_Method method, const char * path, RouteHandler handler, byte priority) {
+    if (!registerRoute(method, path, priority))
+        return false;
+    _routes[_size - 1].setHandler(handler);
+    return true;
 }
 
 
@@ -106,25 +284,7 @@ void Router::registerRoute(HTTP_Method method, const char * path) {
  * @return *Route - pointer to the route which was requested, otherwise NULL.
  */
 Route * Router::isRegistered(const char * method, const char * path) {
-    if (strcmp("GET", method) == 0)
-        return isRegistered(HTTP_Method::GET, path);
-    if (strcmp("HEAD", method) == 0)
-        return isRegistered(HTTP_Method::HEAD, path);
-    if (strcmp("POST", method) == 0)
-        return isRegistered(HTTP_Method::POST, path);
-    if (strcmp("PUT", method) == 0)
-        return isRegistered(HTTP_Method::PUT, path);
-    if (strcmp("DELETE", method) == 0)
-        return isRegistered(HTTP_Method::DELETE, path);
-    if (strcmp("TRACE", method) == 0)
-        return isRegistered(HTTP_Method::TRACE, path);
-    if (strcmp("OPTIONS", method) == 0)
-        return isRegistered(HTTP_Method::OPTIONS, path);
-    if (strcmp("CONNECT", method) == 0)
-        return isRegistered(HTTP_Method::CONNECT, path);
-    if (strcmp("PATCH", method) == 0)
-        return isRegistered(HTTP_Method::PATCH, path);
-    return NULL;
+    return isRegistered(parseMethod(method, strlen(method)), path);
 }
 
 
@@ -133,23 +293,210 @@ Route * Router::isRegistered(const char * method, const char * path) {
  * @return *Route - pointer to the route which was requested, otherwise NULL.
  */
 Route * Router::isRegistered(HTTP_Method method, const char * path) {
-    Route route = Route(method, path);
+    return isRegistered(method, path, strlen(path));
+}
+
+
+/**
+ * @brief Chceks whether the requested route is registered.
+ * HEAD request matches GET route when HEAD is not registered for the path.
+ * Routes are tried in the order of registration, parameters of the matched route
+ * are available by getPathParam().
+ * @param path Path which does not need to be terminated (e. g. inside the request line).
+ * @param len Length of the path.
+ * @return *Route - pointer to the route which was requested, otherwise NULL.
+ */
+Route * Router::isRegistered(HTTP_Method method, const char * path, size_t len) {
+    _matched = NULL;
+    for (size_t index = 0; index < _size; index++) {
+        Route * route = &_routes[index];
+        if (route->getMethod() == method && match(route->getPath(), path, len)) {
+            _matched = route;
+            return route;
+        }
+    }
+    if (method == HEAD)
+        return isRegistered(GET, path, len);
+    return NULL;
+}
+
+
+/**
+ * @return Bit mask of methods allowed for the path (bit n is HTTP_Method n), 0 when the path is unknown.
+ * HEAD is allowed with GET, OPTIONS with any method.
+ */
+unsigned int Router::allowedMethods(const char * path, size_t len) {
+    unsigned int methods = 0;
     for (size_t index = 0; index < _size; index++) {
-        if (_routes[index] == route)
-            return &_routes[index];
+        Route * route = &_routes[index];
+        if (match(route->getPath(), path, len))
+            methods |= (1 << route->getMethod());
+    }
+    if (methods & (1 << GET))
+        methods |= (1 << HEAD);
+    if (methods != 0)
+        methods |= (1 << OPTIONS);
+    return methods;
+}
+
+
+/**
+ * @param ID ID of the route - routes are numbered from 1 in the order of registration.
+ * @return Route of the ID, NULL when there is no such route.
+ */
+Route * Router::getRoute(byte ID) {
+    if (ID == 0 || ID > _size)
+        return NULL;
+    return &_routes[ID - 1];
+}
+
+
+/**
+ * @brief Matches the path segment by segment and captures parameters without copying them.
+ * @param pattern Path of the route (e. g. "/sensor/:name/history").
+ * @param path Requested path, does not need to be terminated.
+ * @param len Length of the path.
+ * @return true when the path matches the pattern.
+ */
+bool Router::match(const char * pattern, const char * path, size_t len) {
+    const char * end = path + len;
+    _paramCount = 0;
+    while (*pattern != '\0') {
+        if (*pattern == '*' && pattern[1] == '\0') {
+            // Rest of the path
+            if (_paramCount == MAX_PATH_PARAMS)
+                return false;
+            _params[_paramCount].value = path;
+            _params[_paramCount].len = end - path;
+            _paramCount++;
+            return true;
+        }
+        if (*pattern == ':') {
+            // One non-empty segment
+            const char * segment = path;
+            while (path < end && *path != '/')
+                path++;
+            if (path == segment || _paramCount == MAX_PATH_PARAMS)
+                return false;
+            _params[_paramCount].value = segment;
+            _params[_paramCount].len = path - segment;
+            _paramCount++;
+            while (*pattern != '\0' && *pattern != '/')
+                pattern++;
+            continue;
+        }
+        if (path == end || *pattern != *path)
+            return false;
+        pattern++;
+        path++;
+    }
+    return (path == end);
+}
+
+
+/**
+ * @return Parameter of the path of the last matched route, NULL when there is no such parameter.
+ */
+PathParam * Router::getPathParam(byte index) {
+    return (index < _paramCount) ? &_params[index] : NULL;
+}
+
+
+/**
+ * @param name Name of the parameter without ':' (e. g. "id" for "/relay/:id"), "*" for the rest of the path.
+ * @return Parameter of the path of the last matched route, NULL when there is no such parameter.
+ */
+PathParam * Router::getPathParam(const char * name) {
+    if (_matched == NULL)
+        return NULL;
+    size_t len = strlen(name);
+    byte index = 0;
+    for (const char * p = _matched->getPath(); *p != '\0'; p++) {
+        if (*p == '*')
+            return (len == 1 && name[0] == '*') ? getPathParam(index) : NULL;
+        if (*p != ':')
+            continue;
+        p++;
+        if (strncmp(p, name, len) == 0 && (p[len] == '/' || p[len] == '\0'))
+            return getPathParam(index);
+        index++;
     }
     return NULL;
 }
 
 
+/**
+ * @brief Parses the parameter of the path as a decimal number (e. g. "/relay/:id").
+ * @param value Parsed number.
+ * @return false when there is no such parameter or it is not a number.
+ */
+bool Router::getPathParamInt(const char * name, long * value) {
+    PathParam * param = getPathParam(name);
+    if (param == NULL || param->len == 0)
+        return false;
+    byte i = (param->value[0] == '-') ? 1 : 0;
+    if (i == param->len)
+        return false;
+    long number = 0;
+    for (; i < param->len; i++) {
+        char c = param->value[i];
+        if (c < '0' || c > '9')
+            return false;
+        number = number * 10 + (c - '0');
+    }
+    *value = (param->value[0] == '-') ? -number : number;
+    return true;
+}
+
+
+/**
+ * @param method Name of the method, does not need to be terminated.
+ * @return HTTP_Method enum, HTTP_METHOD_LENGTH when unknown.
+ */
+HTTP_Method Router::parseMethod(const char * method, size_t len) {
+    for (byte i = 0; i < HTTP_METHOD_LENGTH; i++) {
+        const char * name = (const char *)pgm_read_ptr(&PROGMEM_METHODS[i]);
+        if (strlen_P(name) == len && strncmp_P(method, name, len) == 0)
+            return (HTTP_Method)i;
+    }
+    return HTTP_METHOD_LENGTH;
+}
+
+
 /**************************************
  * ---------- ESP8266_HTTP ---------- *
  **************************************/
 // Constructor
-ESP8266_HTTP::ESP8266_HTTP(byte RX_PIN, byte TX_PIN, byte RST_PIN):
-ESP8266_WLAN::ESP8266_WLAN(RX_PIN, TX_PIN, RST_PIN),
+ESP8266_HTTP::ESP8266_HTTP(byte RX_PIN, byte TX_PIN, byte RST_PIN, long baud):
+ESP8266_WLAN::ESP8266_WLAN(RX_PIN, TX_PIN, RST_PIN, baud),
 Router::Router()
 {
+    _allowed = 0;
+    _route = NULL;
+    _headOnly = false;
+    _headerSent = false;
+    _heartbeat = 0;
+    for (byte i = 0; i < MAX_CONNECTIONS; i++) {
+        _links[i].events = NULL;
+#if ESP8266_WEBSOCKET
+        _links[i].socket = NULL;
+#endif
+#if ESP8266_TASKS
+        _links[i].task.handler = NULL;
+#endif
+    }
+#if ESP8266_TASKS
+    _taskIndex = 0;
+#endif
+#if ESP8266_WEBSOCKET
+    _messageEnd = false;
+#endif
+#if ESP8266_MEMORY
+    _served = NULL;
+    resetMemoryProfile();
+#endif
+    _concurrencyLimit = MAX_ACTIVE_REQUESTS;
+    _queueDepth = REQUEST_QUEUE_DEPTH;
 
 }
 
@@ -160,16 +507,19 @@ ESP8266_HTTP::~ESP8266_HTTP() {}
 
 /**
  * @brief Initializes ESP8266, connects to Access Point and creates TCP server.
+ * When ESP8266 survived reset of Arduino, it reuses its configuration and connection to Access Point.
  * @param ssid Access Point Identifier.
  * @param pass Passphrase.
  * @param port Port at which to create TCP server.
  * @return 0 - Success; 1 - Error: Unable to initialize ESP8266; 2 - Error: Unable to connect to Access Point; 3 - Error: Unable to start TCP server
  */
 byte ESP8266_HTTP::start(const char * ssid, const char * pass, const char * port) {
-    if (!init())
-        return 1;
-    if (!connectToAP(ssid, pass))
-        return 2;
+    if (!warmStart(ssid, pass)) {
+        if (!init())
+            return 1;
+        if (!connectToAP(ssid, pass))
+            return 2;
+    }
     if (!createTCPServer(port))
         return 3;
     return 0;
@@ -210,6 +560,9 @@ Route * ESP8266_HTTP::preprocessRequest() {
     char * pMethod = strtok(msg.message, " ?");
     char * pPath = strtok(NULL, " ?");
     char * pX = strtok(NULL, " ?");
+    // Response to HEAD request is sent without body
+    _headOnly = (parseMethod(pMethod, strlen(pMethod)) == HEAD);
+    _headerSent = false;
 
     // Check if the route is registered
     Route *pRoute = isRegistered(pMethod, pPath);
@@ -236,12 +589,941 @@ Route * ESP8266_HTTP::preprocessRequest() {
 }
 
 
+/**
+ * @brief Finds header of the request being handled (the name is case insensitive).
+ * Headers which did not fit into the RX_BUFFER are not found.
+ * @param name Name of the header with colon (e. g. "Accept:") saved in Flash (PROGMEM).
+ * @return Value of the header ended by "\r\n" (not terminated), NULL when missing. Valid until the next update().
+ */
+const char * ESP8266_HTTP::getHeader_P(const char * name) {
+    const char * end = RX_BUFFER + CUR_RX_BUFFER_SIZE;
+    size_t nameLen = strlen_P(name);
+    // Request line was terminated by preprocessRequest() - headers follow its \n
+    const char * header = (const char *)memchr(msg.message, '\n', end - msg.message);
+    // At the start of a line only ("X-Accept:" is not "Accept:")
+    while (header != NULL && strncasecmp_P(++header, name, nameLen) != 0)
+        header = (const char *)memchr(header, '\n', end - header);
+    if (header == NULL)
+        return NULL;
+    header += nameLen;
+    while (*header == ' ')
+        header++;
+    return header;
+}
+
+
+/**
+ * @brief Tells whether parameters of a media range (e. g. ";q=0.0") exclude it.
+ * @param params Parameters of the range, end points after them.
+ */
+static bool zeroQuality(const char * params, const char * end) {
+    while (params < end) {
+        if (*params++ != ';')
+            continue;
+        while (params < end && *params == ' ')
+            params++;
+        if (end - params < 2 || (*params != 'q' && *params != 'Q') || params[1] != '=')
+            continue;
+        // "0", "0.", "0.000" - no digit but 0
+        params += 2;
+        if (params == end || *params != '0')
+            return false;
+        while (params < end && (*params == '0' || *params == '.'))
+            params++;
+        return params == end || *params == ' ' || *params == ';';
+    }
+    return false;
+}
+
+
+/**
+ * @brief Tells whether the Accept header of the request being handled lists the media type.
+ * Media ranges are compared whole (case insensitive), one with q=0 is not accepted.
+ * Ranges with wildcards do not count - the type must be asked for.
+ * @param type Media type (e. g. "application/cbor") saved in Flash (PROGMEM).
+ */
+bool ESP8266_HTTP::accepts_P(const char * type) {
+    const char * accept = getHeader_P(PROGMEM_ACCEPT);
+    if (accept == NULL)
+        return false;
+    const char * end = accept + strcspn(accept, "\r");
+    size_t typeLen = strlen_P(type);
+    // Accept: text/html, application/cbor;q=0.9, */*;q=0.1
+    while (accept < end) {
+        while (accept < end && (*accept == ' ' || *accept == ','))
+            accept++;
+        const char * next = accept;
+        while (next < end && *next != ',')
+            next++;
+        const char * params = accept;
+        while (params < next && *params != ';' && *params != ' ')
+            params++;
+        if ((size_t)(params - accept) == typeLen && strncasecmp_P(accept, type, typeLen) == 0)
+            return !zeroQuality(params, next);
+        accept = next;
+    }
+    return false;
+}
+
+
+/**
+ * @brief Queues whole HTTP response saved in Flash (PROGMEM) for the current request.
+ * The response may be bigger than the TX_BUFFER. It is sent by update() in chunks
+ * interleaved with other queued responses according to the priority of the route.
+ * The connection is closed when the response is sent.
+ * @return false when another response is queued for the channel already.
+ */
+bool ESP8266_HTTP::streamResponse_PROGMEM(Route * route, const char * response) {
+    if (_headOnly) {
+        // Header only - small enough to be sent right away
+        bool success = transmit(msg.channel, response, headerLength_P(response), true);
+        closeConnection(msg.channel);
+        return success;
+    }
+    return stream_PROGMEM(msg.channel, response, route->getPriority());
+}
+
+
+/**
+ * @brief Sends message saved in the TX_BUFFER.
+ * Body of a response to HEAD request is dropped - only the header is sent.
+ * @param channel Channel to which to sent.
+ * @return true when success.
+ */
+bool ESP8266_HTTP::send(char channel) {
+    if (_headOnly) {
+        if (_headerSent) {
+            CUR_TX_BUFFER_SIZE = 0;
+        }
+        else {
+            const char * pEnd = strstr(TX_BUFFER, "\r\n\r\n");
+            if (pEnd != NULL) {
+                CUR_TX_BUFFER_SIZE = pEnd + 4 - TX_BUFFER;
+                _headerSent = true;
+            }
+        }
+    }
+    return ESP8266_WLAN::send(channel);
+}
+
+
+/**
+ * @brief Reads messages like ESP8266_WLAN::update(). Request of route with a handler
+ * is preprocessed and passed to the handler right away, so are WebSocket messages.
+ * When nothing happened, one running task (resumable handler) takes its step.
+ * 0 - 4 : Same as ESP8266_WLAN::update()
+ * 5 : Request (or WebSocket message) served by handler of its route, task finished
+ */
+byte ESP8266_HTTP::update() {
+#if ESP8266_MEMORY
+    // Stack used since the last call (e. g. by loop()) is painted again - only update() is measured
+    ESP8266_Memory::paint();
+    _served = NULL;
+    byte code = serve();
+    recordMemory(code);
+    return code;
+#else
+    return serve();
+#endif
+}
+
+
+byte ESP8266_HTTP::serve() {
+    byte code = ESP8266_WLAN::update();
+    if (code == 0 && millis() - _heartbeat >= EVENT_HEARTBEAT) {
+        _heartbeat = millis();
+        sendHeartbeat();
+    }
+#if ESP8266_TASKS
+    if (code == 0 && resumeTasks())
+        return 5;
+#endif
+#if ESP8266_WEBSOCKET
+    if (code == 3 && isRawLink(msg.channel)) {
+        receiveFrames(msg.channel);
+        return 5;
+    }
+#endif
+    if (code != 3 || _route == NULL || _route->getHandler() == NULL)
+        return code;
+
+    Route * route = preprocessRequest();
+    if (route == NULL)
+        return 0;
+#if ESP8266_MEMORY
+    _served = route;
+#endif
+    route->getHandler()(*this, route, msg.channel);
+    return 5;
+}
+
+
+/**
+ * @brief Registers GET route which holds the connection open as Server-Sent Events stream
+ * (text/event-stream). Events are sent by publishEvent().
+ * @param path Path of the stream, not copied (pass a string literal).
+ * @return false when MAX_ROUTES routes are registered already.
+ */
+bool ESP8266_HTTP::registerEventStream(const char * path, byte priority) {
+    return registerRoute(GET, path, subscribe, priority);
+}
+
+
+/**
+ * @brief Sends one event to all links subscribed to the event stream, each by one AT+CIPSEND.
+ * Links which do not accept it are closed.
+ * @param path Path of the event stream.
+ * @param data Data of the event - one line.
+ * @param event Name of the event, NULL for the default ("message").
+ * @return Number of links the event was delivered to.
+ */
+byte ESP8266_HTTP::publishEvent(const char * path, const char * data, const char * event) {
+    // event: <event>\n
+    // data: <data>\n
+    // \n
+    char frame[MAX_EVENT_SIZE];
+    int len;
+    if (event != NULL)
+        len = snprintf(frame, sizeof(frame), "event: %s\ndata: %s\n\n", event, data);
+    else
+        len = snprintf(frame, sizeof(frame), "data: %s\n\n", data);
+    if (len < 0 || len >= (int)sizeof(frame))
+        return 0;
+
+    byte delivered = 0;
+    for (byte i = 0; i < MAX_CONNECTIONS; i++) {
+        Route * route = _links[i].events;
+        if (route == NULL || strcmp(route->getPath(), path) != 0)
+            continue;
+        char channel = i + '0';
+        if (transmit(channel, frame, len, false))
+            delivered++;
+        else
+            closeConnection(channel);
+    }
+    return delivered;
+}
+
+
+/**
+ * @return Number of links subscribed to the event stream.
+ */
+byte ESP8266_HTTP::subscribers(const char * path) {
+    byte count = 0;
+    for (byte i = 0; i < MAX_CONNECTIONS; i++) {
+        if (_links[i].events != NULL && strcmp(_links[i].events->getPath(), path) == 0)
+            count++;
+    }
+    return count;
+}
+
+
+// Handler of event stream routes
+void ESP8266_HTTP::subscribe(ESP8266_HTTP & server, Route * route, char channel) {
+    server.openEventStream(route, channel);
+}
+
+
+/**
+ * @brief Answers the request by header of event stream and keeps the connection open.
+ */
+void ESP8266_HTTP::openEventStream(Route * route, char channel) {
+    byte index = channel - '0';
+    // HEAD request gets the header only
+    if (index >= MAX_CONNECTIONS
+            || !transmit(channel, PROGMEM_HTTP_EVENT_STREAM, strlen_P(PROGMEM_HTTP_EVENT_STREAM), true)
+            || _headOnly) {
+        closeConnection(channel);
+        return;
+    }
+    _links[index].events = route;
+    // The stream is open - the request does not count as being served anymore
+    finishRequest(channel);
+}
+
+
+/**
+ * @brief Sends comment to event streams (ping to WebSocket links) so that dead links are detected and closed.
+ */
+void ESP8266_HTTP::sendHeartbeat() {
+    for (byte i = 0; i < MAX_CONNECTIONS; i++) {
+        char channel = i + '0';
+        bool alive = true;
+        if (_links[i].events != NULL)
+            alive = transmit(channel, PROGMEM_EVENT_HEARTBEAT, strlen_P(PROGMEM_EVENT_HEARTBEAT), true);
+#if ESP8266_WEBSOCKET
+        else if (_links[i].socket != NULL)
+            alive = sendFrame(channel, WS_FIN | WS_PING, NULL, 0);
+#endif
+        if (!alive)
+            closeConnection(channel);
+    }
+}
+
+
+// Forgets the state of closed link
+void ESP8266_HTTP::linkClosed(char channel) {
+    byte index = channel - '0';
+    if (index >= MAX_CONNECTIONS)
+        return;
+    _links[index].events = NULL;
+#if ESP8266_WEBSOCKET
+    _links[index].socket = NULL;
+#endif
+#if ESP8266_TASKS
+    // Running task is abandoned - nobody to respond to
+    _links[index].task.handler = NULL;
+#endif
+}
+
+
+#if ESP8266_TASKS
+/**
+ * @brief Registers route served by resumable handler. The handler is started by update()
+ * like RouteHandler, it may yield (TASK_YIELD(), TASK_WAIT_UNTIL(), TASK_SLEEP()) and it is resumed
+ * by later update() calls until it returns TASK_DONE. Requests of other links are served meanwhile.
+ * The handler is responsible for the response and for closing the connection.
+ * @param task Resumable handler.
+ * @return false when MAX_ROUTES routes are registered already.
+ */
+bool ESP8266_HTTP::registerTask(HTTP_Method method, const char * path, TaskHandler task, byte priority) {
+    if (!registerRoute(method, path, startTask, priority))
+        return false;
+    getRoute(size())->setTask(task);
+    return true;
+}
+
+
+/**
+ * @return Number of links whose handler is not finished yet.
+ */
+byte ESP8266_HTTP::runningTasks() {
+    byte count = 0;
+    for (byte i = 0; i < MAX_CONNECTIONS; i++) {
+        if (_links[i].task.handler != NULL)
+            count++;
+    }
+    return count;
+}
+
+
+// Handler of routes with resumable handler
+void ESP8266_HTTP::startTask(ESP8266_HTTP & server, Route * route, char channel) {
+    server.beginTask(route, channel);
+}
+
+
+/**
+ * @brief Resets the task of the link and runs its first step while the request is in the RX_BUFFER.
+ */
+void ESP8266_HTTP::beginTask(Route * route, char channel) {
+    byte index = channel - '0';
+    if (index >= MAX_CONNECTIONS) {
+        closeConnection(channel);
+        return;
+    }
+    HTTP_Task & task = _links[index].task;
+    task.handler = route->getTask();
+    task.route = route;
+    task.since = millis();
+    task.line = 0;
+    task.channel = channel;
+    task.headOnly = _headOnly;
+    task.headerSent = false;
+    memset(task.context, 0, sizeof(task.context));
+    resumeTask(index);
+}
+
+
+/**
+ * @brief Runs one step of the task of the link. HEAD state of its request is restored for send().
+ * @return true when the task finished.
+ */
+bool ESP8266_HTTP::resumeTask(byte index) {
+    HTTP_Task & task = _links[index].task;
+#if ESP8266_MEMORY
+    _served = task.route;
+#endif
+    _headOnly = task.headOnly;
+    _headerSent = task.headerSent;
+    byte state = task.handler(*this, &task);
+    task.headerSent = _headerSent;
+    // The handler may have closed the link - the task is dropped then
+    if (state == TASK_DONE || task.handler == NULL) {
+        task.handler = NULL;
+        return true;
+    }
+    return false;
+}
+
+
+/**
+ * @brief Resumes the next running task (round robin).
+ * @return true when the task finished.
+ */
+bool ESP8266_HTTP::resumeTasks() {
+    for (byte i = 0; i < MAX_CONNECTIONS; i++) {
+        byte index = (_taskIndex + i) % MAX_CONNECTIONS;
+        if (_links[index].task.handler != NULL) {
+            _taskIndex = (index + 1) % MAX_CONNECTIONS;
+            return resumeTask(index);
+        }
+    }
+    return false;
+}
+#endif
+
+
+#if ESP8266_MEMORY
+/**
+ * @brief Starts a new measurement of the SRAM usage.
+ */
+void ESP8266_HTTP::resetMemoryProfile() {
+    memset(&_memory, 0, sizeof(_memory));
+    _memory.minFree = 0xFFFF;
+}
+
+
+/**
+ * @brief Prints the SRAM usage (e. g. to Serial), one value per line.
+ */
+void ESP8266_HTTP::printMemoryProfile(Print & out) {
+    char buf[64];
+    for (byte i = 0; formatMemoryLine(i, buf, sizeof(buf)); i++)
+        out.print(buf);
+}
+
+
+/**
+ * @brief Registers GET route answering the SRAM usage as text/plain.
+ * @param path Path of the route, not copied (pass a string literal).
+ * @return false when MAX_ROUTES routes are registered already.
+ */
+bool ESP8266_HTTP::registerMemoryRoute(const char * path) {
+    return registerRoute(GET, path, sendMemoryProfile, PRIORITY_LOW);
+}
+
+
+// Handler of the memory route
+void ESP8266_HTTP::sendMemoryProfile(ESP8266_HTTP & server, Route * /* route */, char channel) {
+    server.send_PROGMEM(PROGMEM_HTTP_MEMORY);
+    char buf[64];
+    for (byte i = 0; server.formatMemoryLine(i, buf, sizeof(buf)); i++)
+        server.send(buf);
+    server.send(channel);
+    server.closeConnection(channel);
+}
+
+
+/**
+ * @brief Formats one line of the SRAM usage.
+ * @return false when there is no such line.
+ */
+bool ESP8266_HTTP::formatMemoryLine(byte index, char * buf, size_t size) {
+    switch (index) {
+    case 0:
+        snprintf_P(buf, size, PROGMEM_MEMORY_FREE, (unsigned int)ESP8266_Memory::freeMemory(), _memory.minFree);
+        return true;
+    case 1:
+        snprintf_P(buf, size, PROGMEM_MEMORY_STACK, _memory.stackPeak);
+        return true;
+    case 2: {
+        byte blocks;
+        size_t largest;
+        size_t freeBytes = ESP8266_Memory::heapFree(&blocks, &largest);
+        snprintf_P(buf, size, PROGMEM_MEMORY_HEAP, _memory.heapPeak, (unsigned int)freeBytes, blocks, (unsigned int)largest);
+        return true;
+    }
+    case 3:
+        snprintf_P(buf, size, PROGMEM_MEMORY_OTHER, _memory.routePeak[0]);
+        return true;
+    }
+    byte ID = index - 3;
+    Route * route = getRoute(ID);
+    if (route == NULL)
+        return false;
+    snprintf_P(buf, size, PROGMEM_MEMORY_ROUTE, ID, route->getPath(), _memory.routePeak[ID]);
+    return true;
+}
+
+
+/**
+ * @brief Measures the stack used by the finished update() and attributes it to the served route.
+ */
+void ESP8266_HTTP::recordMemory(byte code) {
+    size_t unused = ESP8266_Memory::stackUnused();
+    unsigned int peak = ESP8266_Memory::stackPeak(unused);
+    // Request left to the sketch (code 3) belongs to its route as well
+    Route * route = (_served != NULL) ? _served : ((code == 3) ? _route : NULL);
+    byte ID = (route != NULL) ? route->getID() : 0;
+    if (peak > _memory.stackPeak)
+        _memory.stackPeak = peak;
+    if (peak > _memory.routePeak[ID])
+        _memory.routePeak[ID] = peak;
+    if (unused < _memory.minFree)
+        _memory.minFree = unused;
+    size_t heap = ESP8266_Memory::heapUsed();
+    if (heap > _memory.heapPeak)
+        _memory.heapPeak = heap;
+}
+#endif
+
+
+#if ESP8266_WEBSOCKET
+/**
+ * @brief Registers GET route which is upgraded to WebSocket. Messages of the client are passed
+ * to the handler, sendWebSocket() and broadcastWebSocket() send messages to the client.
+ * Ping and close are answered internally.
+ * @param path Path of the WebSocket, not copied (pass a string literal).
+ * @param handler Function called for every received message (or its part).
+ * @return false when MAX_ROUTES routes are registered already.
+ */
+bool ESP8266_HTTP::registerWebSocket(const char * path, WebSocketHandler handler, byte priority) {
+    if (!registerRoute(GET, path, upgrade, priority))
+        return false;
+    getRoute(size())->setWebSocketHandler(handler);
+    return true;
+}
+
+
+/**
+ * @brief Sends text message to the WebSocket link.
+ * @param text Terminated text (UTF-8).
+ * @return true when success.
+ */
+bool ESP8266_HTTP::sendWebSocket(char channel, const char * text) {
+    return sendWebSocket(channel, text, strlen(text));
+}
+
+
+/**
+ * @brief Sends message to the WebSocket link as one unmasked frame by one AT+CIPSEND.
+ * @param data Data of the message (max 2044 bytes).
+ * @param binary true - binary message; false - text message.
+ * @return false when the link is not a WebSocket or it does not accept the message.
+ */
+bool ESP8266_HTTP::sendWebSocket(char channel, const char * data, size_t len, bool binary) {
+    byte index = channel - '0';
+    if (index >= MAX_CONNECTIONS || _links[index].socket == NULL)
+        return false;
+    return sendFrame(channel, WS_FIN | (binary ? WS_BINARY : WS_TEXT), data, len);
+}
+
+
+/**
+ * @brief Sends text message to all links of the WebSocket route. Links which do not accept it are closed.
+ * @return Number of links the message was delivered to.
+ */
+byte ESP8266_HTTP::broadcastWebSocket(const char * path, const char * text) {
+    size_t len = strlen(text);
+    byte delivered = 0;
+    for (byte i = 0; i < MAX_CONNECTIONS; i++) {
+        Route * route = _links[i].socket;
+        if (route == NULL || strcmp(route->getPath(), path) != 0)
+            continue;
+        char channel = i + '0';
+        if (sendFrame(channel, WS_FIN | WS_TEXT, text, len))
+            delivered++;
+        else
+            closeConnection(channel);
+    }
+    return delivered;
+}
+
+
+// Handler of WebSocket routes
+void ESP8266_HTTP::upgrade(ESP8266_HTTP & server, Route * route, char channel) {
+    server.openWebSocket(route, channel);
+}
+
+
+// Browsers send Sec-WebSocket-Key after 400 - 500 bytes of other headers - it is kept when they overflow
+bool ESP8266_HTTP::keepLine(char /* channel */, const char * line) {
+    return strncasecmp_P(line, PROGMEM_WEBSOCKET_KEY, strlen_P(PROGMEM_WEBSOCKET_KEY)) == 0;
+}
+
+
+/**
+ * @brief Answers the opening handshake (101 Switching Protocols) and switches the link to raw mode.
+ * Sec-WebSocket-Key is found in the RX_BUFFER even when the request overflowed (see keepLine()).
+ */
+void ESP8266_HTTP::openWebSocket(Route * route, char channel) {
+    byte index = channel - '0';
+    const char * key = getHeader_P(PROGMEM_WEBSOCKET_KEY);
+    size_t keyLen = (key != NULL) ? strcspn(key, "\r ") : 0;
+    if (index >= MAX_CONNECTIONS || keyLen != 24 || _headOnly) {
+        transmit(channel, PROGMEM_HTTP_BAD_REQUEST, strlen_P(PROGMEM_HTTP_BAD_REQUEST), true);
+        closeConnection(channel);
+        return;
+    }
+
+    // Sec-WebSocket-Accept: base64(SHA-1(key + GUID))
+    char buf[61];
+    memcpy(buf, key, keyLen);
+    strcpy_P(buf + keyLen, PROGMEM_WEBSOCKET_GUID);
+    byte hash[20];
+    sha1(buf, strlen(buf), hash);
+    size_t len = base64(hash, sizeof(hash), buf);
+    memcpy(buf + len, "\r\n\r\n", 4);
+    if (!transmit(channel, PROGMEM_HTTP_SWITCHING_PROTOCOLS, strlen_P(PROGMEM_HTTP_SWITCHING_PROTOCOLS), true)
+            || !transmit(channel, buf, len + 4, false)) {
+        closeConnection(channel);
+        return;
+    }
+    _links[index].socket = route;
+    _links[index].state = WS_OPCODE;
+    setRawLink(channel, true);
+    // The link is open - the request does not count as being served anymore
+    finishRequest(channel);
+}
+
+
+/**
+ * @brief Parses client frames in msg.message incrementally and passes their payload
+ * (unmasked in place) to receivePart().
+ */
+void ESP8266_HTTP::receiveFrames(char channel) {
+    HTTP_Link & link = _links[channel - '0'];
+    if (link.socket == NULL || msg.overflowed) {
+        // Part of the data was lost - frames cannot be followed anymore
+        closeConnection(channel);
+        return;
+    }
+#if ESP8266_MEMORY
+    _served = link.socket;
+#endif
+    char * p = msg.message;
+    size_t n = msg.length;
+    while (n > 0) {
+        byte c = *p;
+        switch (link.state) {
+        case WS_OPCODE:
+            link.opcode = c;
+            link.state = WS_LENGTH;
+            break;
+        case WS_LENGTH:
+            // Client frames are masked; 64 bit length is not supported
+            if (!(c & WS_MASKED) || (c & 0x7F) == 127) {
+                closeConnection(channel);
+                return;
+            }
+            link.left = c & 0x7F;
+            link.need = 4;
+            link.state = WS_MASK;
+            if (link.left == 126) {
+                link.left = 0;
+                link.need = 2;
+                link.state = WS_EXTENDED;
+            }
+            break;
+        case WS_EXTENDED:
+            link.left = (link.left << 8) | c;
+            if (--link.need == 0) {
+                link.need = 4;
+                link.state = WS_MASK;
+            }
+            break;
+        case WS_MASK:
+            link.mask[4 - link.need] = c;
+            if (--link.need == 0) {
+                link.maskPos = 0;
+                link.state = WS_PAYLOAD;
+                if (link.left == 0) {
+                    // Empty payload (e. g. ping, close)
+                    link.state = WS_OPCODE;
+                    if (!receivePart(channel, p + 1, 0))
+                        return;
+                }
+            }
+            break;
+        case WS_PAYLOAD: {
+            size_t len = (n < link.left) ? n : link.left;
+            for (size_t i = 0; i < len; i++)
+                p[i] ^= link.mask[link.maskPos++ & 3];
+            link.left -= len;
+            if (link.left == 0)
+                link.state = WS_OPCODE;
+            if (!receivePart(channel, p, len))
+                return;
+            p += len;
+            n -= len;
+            continue;
+        }
+        }
+        p++;
+        n--;
+    }
+}
+
+
+/**
+ * @brief Handles (part of) payload of one frame. Control frames are answered here,
+ * data are passed to the handler of the route.
+ * @return false when the link was closed.
+ */
+bool ESP8266_HTTP::receivePart(char channel, char * data, size_t len) {
+    HTTP_Link & link = _links[channel - '0'];
+    byte opcode = link.opcode & 0x0F;
+    bool last = (link.left == 0);
+    if (opcode == WS_CLOSE) {
+        // Closing handshake - echo the status code
+        if (!last)
+            return true;
+        sendFrame(channel, WS_FIN | WS_CLOSE, data, (len < 2) ? len : 2);
+        closeConnection(channel);
+        return false;
+    }
+    if (opcode == WS_PING) {
+        // Control frames are short - payload is expected in one TCP segment
+        if (last)
+            sendFrame(channel, WS_FIN | WS_PONG, data, len);
+        return true;
+    }
+    if (opcode == WS_PONG)
+        return true;
+    if (opcode > WS_BINARY) {
+        // Unknown opcode
+        closeConnection(channel);
+        return false;
+    }
+    _messageEnd = last && (link.opcode & WS_FIN);
+    WebSocketHandler handler = link.socket->getWebSocketHandler();
+    if (handler != NULL && (len > 0 || _messageEnd))
+        handler(*this, channel, data, len);
+    // The handler may have closed the link
+    return link.socket != NULL;
+}
+
+
+/**
+ * @brief Sends one unmasked frame, header and payload by one AT+CIPSEND.
+ */
+bool ESP8266_HTTP::sendFrame(char channel, byte opcode, const char * data, size_t len, bool progmem) {
+    char header[4];
+    byte headerLen = 2;
+    header[0] = opcode;
+    if (len < 126) {
+        header[1] = len;
+    }
+    else {
+        header[1] = 126;
+        header[2] = len >> 8;
+        header[3] = len & 0xFF;
+        headerLen = 4;
+    }
+    return transmit(channel, data, len, progmem, header, headerLen);
+}
+
+
+/**
+ * @brief Computes SHA-1 digest (needed by the opening handshake only - not optimized for speed).
+ * @param hash Buffer for 20 bytes of the digest.
+ */
+void ESP8266_HTTP::sha1(const char * data, size_t len, byte * hash) {
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    uint32_t w[16] = { 0 };
+    // Message, 0x80, zeros and 64 bit length in bits
+    size_t blocks = (len + 9 + 63) / 64;
+    for (size_t block = 0; block < blocks; block++) {
+        for (byte i = 0; i < 64; i++) {
+            size_t pos = block * 64 + i;
+            byte x = 0;
+            if (pos < len)
+                x = data[pos];
+            else if (pos == len)
+                x = 0x80;
+            else if (pos >= blocks * 64 - 4)
+                x = ((uint32_t)len << 3) >> (8 * (blocks * 64 - 1 - pos));
+            w[i / 4] = (w[i / 4] << 8) | x;
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (byte t = 0; t < 80; t++) {
+            if (t >= 16) {
+                uint32_t x = w[(t + 13) & 15] ^ w[(t + 8) & 15] ^ w[(t + 2) & 15] ^ w[t & 15];
+                w[t & 15] = (x << 1) | (x >> 31);
+            }
+            uint32_t f, k;
+            if (t < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            }
+            else if (t < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            }
+            else if (t < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            }
+            else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t temp = ((a << 5) | (a >> 27)) + f + e + k + w[t & 15];
+            e = d;
+            d = c;
+            c = (b << 30) | (b >> 2);
+            b = a;
+            a = temp;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+    for (byte i = 0; i < 20; i++)
+        hash[i] = h[i / 4] >> (24 - 8 * (i % 4));
+}
+
+
+/**
+ * @brief Encodes data by base64 (with padding) and terminates the text.
+ * @param buf Buffer for at least 4 * ((len + 2) / 3) + 1 characters.
+ * @return Length of the text.
+ */
+size_t ESP8266_HTTP::base64(const byte * data, size_t len, char * buf) {
+    size_t out = 0;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t x = (uint32_t)data[i] << 16;
+        if (i + 1 < len)
+            x |= (uint32_t)data[i + 1] << 8;
+        if (i + 2 < len)
+            x |= data[i + 2];
+        for (byte j = 0; j < 4; j++) {
+            if (i + j <= len)
+                buf[out] = pgm_read_byte(PROGMEM_BASE64 + ((x >> (18 - 6 * j)) & 0x3F));
+            else
+                buf[out] = '=';
+            out++;
+        }
+    }
+    buf[out] = '\0';
+    return out;
+}
+#endif
+
+
+/**
+ * @brief Decides about the request from its request line only - the rest of the request
+ * is not read at all when the route is not registered.
+ * @param line Request line (e. g. "GET /test?a=5 HTTP/1.1").
+ * @return ACCEPT or reason of rejection (HTTP_Reject).
+ */
+byte ESP8266_HTTP::screenMessage(char channel, const char * line) {
+    _route = NULL;
+    if (!isHTTP(line))
+        return REJECT_NOT_HTTP;
+
+    // Admission control - shed load before doing any work
+    byte pending = pendingRequests(channel);
+    if (pending >= _queueDepth)
+        return REJECT_OVERLOADED;
+    if (pending == 0 && activeRequests() >= _concurrencyLimit)
+        return REJECT_OVERLOADED;
+
+    const char * pPath = strchr(line, ' ');
+    if (pPath == NULL)
+        return REJECT_NOT_HTTP;
+    HTTP_Method method = parseMethod(line, pPath - line);
+    pPath++;
+    size_t len = strcspn(pPath, " ?");
+
+    _route = isRegistered(method, pPath, len);
+    if (_route != NULL)
+        return ACCEPT;
+    _allowed = allowedMethods(pPath, len);
+    if (_allowed == 0)
+        return REJECT_NOT_FOUND;
+    return (method == OPTIONS) ? ANSWER_OPTIONS : REJECT_NOT_ALLOWED;
+}
+
+
+/**
+ * @brief Responds to rejected request (or OPTIONS request) from Flash (PROGMEM) and closes the connection.
+ */
+void ESP8266_HTTP::rejectMessage(char channel, byte reason) {
+    // Sent directly - another response may be being composed in TX_BUFFER
+    const char * response = NULL;
+    if (reason == REJECT_NOT_FOUND)
+        response = PROGMEM_HTTP_NOT_FOUND;
+    else if (reason == REJECT_NOT_ALLOWED)
+        response = PROGMEM_HTTP_METHOD_NOT_ALLOWED;
+    else if (reason == REJECT_OVERLOADED)
+        response = PROGMEM_HTTP_SERVICE_UNAVAILABLE;
+    else if (reason == ANSWER_OPTIONS)
+        response = PROGMEM_HTTP_OPTIONS;
+    if (response != NULL && transmit(channel, response, strlen_P(response), true)
+            && (reason == REJECT_NOT_ALLOWED || reason == ANSWER_OPTIONS)) {
+        char allowed[72];
+        transmit(channel, allowed, formatAllowed(_allowed, allowed), false);
+    }
+    closeConnection(channel);
+}
+
+
+
+/**
+ * @return Length of HTTP header saved in Flash (PROGMEM) including the empty line.
+ */
+size_t ESP8266_HTTP::headerLength_P(const char * response) {
+    const char * p = response;
+    byte matched = 0;
+    char c;
+    while (matched < 4 && (c = pgm_read_byte(p)) != '\0') {
+        if (c == ((matched % 2 == 0) ? '\r' : '\n'))
+            matched++;
+        else
+            matched = (c == '\r') ? 1 : 0;
+        p++;
+    }
+    return p - response;
+}
+
 // Sends generic 404 NOT FOUND response
 void ESP8266_HTTP::send404() {
     send_PROGMEM(PROGMEM_HTTP_NOT_FOUND);
 }
 
 
+/**
+ * @brief Appends 405 METHOD NOT ALLOWED response with "Allow" header.
+ * @param methods Bit mask of allowed methods (see Router::allowedMethods()).
+ */
+void ESP8266_HTTP::send405(unsigned int methods) {
+    send_PROGMEM(PROGMEM_HTTP_METHOD_NOT_ALLOWED);
+    char allowed[72];
+    formatAllowed(methods, allowed);
+    send(allowed);
+}
+
+
+/**
+ * @brief Formats value of "Allow" header followed by the end of the header.
+ * @param methods Bit mask of allowed methods.
+ * @param buf Buffer for at least 72 characters (all methods).
+ * @return Length of the text.
+ */
+size_t ESP8266_HTTP::formatAllowed(unsigned int methods, char * buf) {
+    buf[0] = '\0';
+    for (byte i = 0; i < HTTP_METHOD_LENGTH; i++) {
+        if (methods & (1 << i)) {
+            if (buf[0] != '\0')
+                strcat(buf, ", ");
+            strcat_P(buf, (const char *)pgm_read_ptr(&PROGMEM_METHODS[i]));
+        }
+    }
+    strcat(buf, "\r\n\r\n");
+    return strlen(buf);
+}
+
+
+// Sends generic 503 SERVICE UNAVAILABLE response
+void ESP8266_HTTP::send503() {
+    send_PROGMEM(PROGMEM_HTTP_SERVICE_UNAVAILABLE);
+}
+
+
 // Sends generic 200 OK response
 void ESP8266_HTTP::send200() {
     send_PROGMEM(PROGMEM_HTTP_OK);
@@ -7,12 +7,93 @@
 //#include "Arduino.h"
 #include "ESP8266_WLAN.h"
 #include <avr/pgmspace.h>
-
-#define MAX_ROUTES 3
+#if ESP8266_MEMORY
+#include "ESP8266_Memory.h"
+#endif
 
 
 enum HTTP_Method { GET, HEAD, POST, PUT, DELETE, TRACE, OPTIONS, CONNECT, PATCH, HTTP_METHOD_LENGTH };
 
+// Reasons of early rejection of a request (see ESP8266_HTTP::screenMessage())
+// ANSWER_OPTIONS - OPTIONS request answered from the route table
+enum HTTP_Reject { ACCEPT, REJECT_NOT_HTTP, REJECT_NOT_FOUND, REJECT_NOT_ALLOWED, REJECT_OVERLOADED, ANSWER_OPTIONS };
+
+class ESP8266_HTTP;
+class Route;
+
+/**
+ * Handler of a registered route, invoked by ESP8266_HTTP::update().
+ * The handler is responsible for the response and for closing the connection.
+ */
+typedef void (*RouteHandler)(ESP8266_HTTP & server, Route * route, char channel);
+
+#if ESP8266_TASKS
+struct HTTP_Task;
+
+/**
+ * Resumable handler of a route (protothread) - see TASK_BEGIN().
+ * @return TASK_RUNNING to be resumed by ESP8266_HTTP::update(), TASK_DONE when finished.
+ */
+typedef byte (*TaskHandler)(ESP8266_HTTP & server, HTTP_Task * task);
+
+enum TaskState { TASK_RUNNING, TASK_DONE };
+
+/**
+ * State of a resumable handler, one per link. Local variables of the handler do not survive
+ * yielding - keep them in the context. The request in RX_BUFFER is valid until the first yield only.
+ */
+struct HTTP_Task {
+    TaskHandler handler; // NULL when no handler is running
+    Route * route;
+    unsigned long since; // start of TASK_SLEEP()
+    unsigned int line;   // where to resume
+    char channel;
+    bool headOnly:1;
+    bool headerSent:1;
+    byte context[TASK_CONTEXT_SIZE];
+};
+
+/**
+ * Stackless coroutines (protothreads) - the handler returns at a yield and continues
+ * from there when it is called again:
+ *
+ * byte slowSensor(ESP8266_HTTP & server, HTTP_Task * task) {
+ *     TASK_BEGIN(task);
+ *     startConversion();
+ *     TASK_WAIT_UNTIL(task, conversionDone());
+ *     ...
+ *     TASK_END(task);
+ * }
+ *
+ * Do not use switch statement between TASK_BEGIN() and TASK_END().
+ */
+#define TASK_BEGIN(task) switch ((task)->line) { case 0:
+#define TASK_YIELD(task) do { (task)->line = __LINE__; return TASK_RUNNING; case __LINE__:; } while (0)
+#define TASK_WAIT_UNTIL(task, condition) do { (task)->line = __LINE__; case __LINE__: if (!(condition)) return TASK_RUNNING; } while (0)
+#define TASK_SLEEP(task, ms) do { (task)->since = millis(); TASK_WAIT_UNTIL(task, millis() - (task)->since >= (ms)); } while (0)
+#define TASK_END(task) } (task)->line = 0; return TASK_DONE
+// Context of the task as a structure of at most TASK_CONTEXT_SIZE bytes
+#define TASK_CONTEXT(task, type) ((type *)(task)->context)
+#endif
+
+#if ESP8266_WEBSOCKET
+/**
+ * Handler of data message (text or binary) received over WebSocket.
+ * Message split among more TCP segments is passed in more parts, ESP8266_HTTP::isMessageEnd()
+ * tells the last one. Data are not terminated, valid until the next update().
+ */
+typedef void (*WebSocketHandler)(ESP8266_HTTP & server, char channel, const char * data, size_t len);
+#endif
+
+/**
+ * Parameter captured from the path of the request, e. g. "7" of "/relay/7" for "/relay/:id".
+ * It is a slice of the request in RX_BUFFER - not terminated, valid until the next update().
+ */
+struct PathParam {
+    const char * value;
+    byte len;
+};
+
 
 class Route
 {
@@ -22,18 +103,47 @@ public:
     ~Route();
 
     void set(byte ID, HTTP_Method method, const char * path);
-    void setParams(const char * params);
+    void setParams(char * params);
+    void setPriority(byte priority) { _priority = priority; }
+    void setHandler(RouteHandler handler) { _handler = handler; }
+#if ESP8266_WEBSOCKET
+    void setWebSocketHandler(WebSocketHandler handler) { _onMessage = handler; }
+#endif
+#if ESP8266_TASKS
+    void setTask(TaskHandler task) { _task = task; }
+#endif
+    void setData(void * data) { _data = data; }
     bool operator==(const Route & route);
 
     byte getID() { return _id; }
     HTTP_Method getMethod() {return _method; }
-    char * getPath() { return _path; }
+    const char * getPath() { return _path; }
     char * getParams() { return _params; }
+    const char * getParam(const char * name);
+    bool getParamInt(const char * name, long * value);
+    byte getPriority() { return _priority; }
+    RouteHandler getHandler() { return _handler; }
+#if ESP8266_WEBSOCKET
+    WebSocketHandler getWebSocketHandler() { return _onMessage; }
+#endif
+#if ESP8266_TASKS
+    TaskHandler getTask() { return _task; }
+#endif
+    void * getData() { return _data; }
 private:
     byte _id;
+    byte _priority;
+    RouteHandler _handler;
+#if ESP8266_WEBSOCKET
+    WebSocketHandler _onMessage;
+#endif
+#if ESP8266_TASKS
+    TaskHandler _task;
+#endif
     HTTP_Method _method;
-    char * _path;
+    const char * _path;
     char * _params;
+    void * _data; // object served by the route (e. g. ESP8266_SampleStore), NULL when none
 };
 
 
@@ -43,31 +153,169 @@ public:
     Router();
     ~Router();
 
-    void registerRoute(HTTP_Method method, const char * path);
+    bool registerRoute(HTTP_Method method, const char * path, byte priority = PRIORITY_NORMAL);
+    bool registerRoute(HTTP_Method method, const char * path, RouteHandler handler, byte priority = PRIORITY_NORMAL);
     Route * isRegistered(const char * method, const char * path);
     Route * isRegistered(HTTP_Method method, const char * path);
+    Route * isRegistered(HTTP_Method method, const char * path, size_t len);
+    unsigned int allowedMethods(const char * path, size_t len);
+    Route * getRoute(byte ID);
+
+    byte pathParamCount() { return _paramCount; }
+    PathParam * getPathParam(byte index);
+    PathParam * getPathParam(const char * name);
+    bool getPathParamInt(const char * name, long * value);
+
+    static HTTP_Method parseMethod(const char * method, size_t len);
 
     size_t size() { return _size; }
 private:
+    bool match(const char * pattern, const char * path, size_t len);
     Route _routes[MAX_ROUTES];
     size_t _size;
+    // Parameters of the last matched route
+    Route * _matched;
+    PathParam _params[MAX_PATH_PARAMS];
+    byte _paramCount;
+};
+
+
+#if ESP8266_MEMORY
+/**
+ * SRAM usage of ESP8266_HTTP::update() - the stack is painted before every call
+ * and measured after it. Sizes in bytes.
+ */
+struct MemoryProfile {
+    unsigned int stackPeak; // deepest stack of update()
+    unsigned int minFree;   // least untouched SRAM between the heap and the stack, 0xFFFF until measured
+    unsigned int heapPeak;  // largest heap seen after update()
+    // stackPeak of update() calls serving route of the ID, [0] - calls serving no route
+    unsigned int routePeak[MAX_ROUTES + 1];
+};
+#endif
+
+/**
+ * State of one link (channel) kept by ESP8266_HTTP between requests.
+ */
+struct HTTP_Link {
+    Route * events; // event stream the link is subscribed to, NULL when none
+#if ESP8266_WEBSOCKET
+    Route * socket; // WebSocket route the link is upgraded to, NULL when none
+    // Parser of client frames - a frame may be split among more TCP segments
+    byte state;
+    byte opcode;       // FIN bit and opcode of the frame
+    byte need;         // missing bytes of extended length or mask
+    byte mask[4];
+    byte maskPos;
+    unsigned int left; // missing bytes of payload
+#endif
+#if ESP8266_TASKS
+    HTTP_Task task;
+#endif
 };
 
 
 class ESP8266_HTTP : public ESP8266_WLAN, public Router
 {
 public:
-    ESP8266_HTTP(byte RX_PIN, byte TX_PIN, byte RST_PIN);
+    ESP8266_HTTP(byte RX_PIN, byte TX_PIN, byte RST_PIN, long baud = 9600);
     ~ESP8266_HTTP();
 
     byte start(const char * ssid, const char * pass, const char * port);
     bool isHTTP();
     bool isHTTP(const char * message);
 
+    void setConcurrencyLimit(byte limit) { _concurrencyLimit = limit; }
+    void setQueueDepth(byte depth) { _queueDepth = depth; }
+
+    byte update();
     Route * preprocessRequest();
+    bool streamResponse_PROGMEM(Route * route, const char * response);
+    bool isHeadOnly() { return _headOnly; }
+    const char * getHeader_P(const char * name);
+    bool accepts_P(const char * type);
+
+    bool registerEventStream(const char * path, byte priority = PRIORITY_NORMAL);
+    byte publishEvent(const char * path, const char * data, const char * event = NULL);
+    byte subscribers(const char * path);
+
+#if ESP8266_WEBSOCKET
+    bool registerWebSocket(const char * path, WebSocketHandler handler, byte priority = PRIORITY_NORMAL);
+    bool sendWebSocket(char channel, const char * text);
+    bool sendWebSocket(char channel, const char * data, size_t len, bool binary = false);
+    byte broadcastWebSocket(const char * path, const char * text);
+    bool isMessageEnd() { return _messageEnd; }
+#endif
+
+#if ESP8266_TASKS
+    bool registerTask(HTTP_Method method, const char * path, TaskHandler task, byte priority = PRIORITY_NORMAL);
+    byte runningTasks();
+#endif
+
+#if ESP8266_MEMORY
+    MemoryProfile * getMemoryProfile() { return &_memory; }
+    void resetMemoryProfile();
+    void printMemoryProfile(Print & out);
+    bool registerMemoryRoute(const char * path = "/__mem");
+#endif
+
+    using ESP8266_WLAN::send;
+    bool send(char channel);
 
     void send404();
+    void send405(unsigned int methods);
+    void send503();
     void send200();
+protected:
+    byte screenMessage(char channel, const char * line);
+    void rejectMessage(char channel, byte reason);
+    void linkClosed(char channel);
+#if ESP8266_WEBSOCKET
+    bool keepLine(char channel, const char * line);
+#endif
+private:
+    byte serve();
+    static void subscribe(ESP8266_HTTP & server, Route * route, char channel);
+    void openEventStream(Route * route, char channel);
+    void sendHeartbeat();
+    HTTP_Link _links[MAX_CONNECTIONS];
+    unsigned long _heartbeat;
+
+#if ESP8266_WEBSOCKET
+    static void upgrade(ESP8266_HTTP & server, Route * route, char channel);
+    void openWebSocket(Route * route, char channel);
+    void receiveFrames(char channel);
+    bool receivePart(char channel, char * data, size_t len);
+    bool sendFrame(char channel, byte opcode, const char * data, size_t len, bool progmem = false);
+    static void sha1(const char * data, size_t len, byte * hash);
+    static size_t base64(const byte * data, size_t len, char * buf);
+    bool _messageEnd;
+#endif
+
+#if ESP8266_TASKS
+    static void startTask(ESP8266_HTTP & server, Route * route, char channel);
+    void beginTask(Route * route, char channel);
+    bool resumeTask(byte index);
+    bool resumeTasks();
+    byte _taskIndex;
+#endif
+
+#if ESP8266_MEMORY
+    static void sendMemoryProfile(ESP8266_HTTP & server, Route * route, char channel);
+    bool formatMemoryLine(byte index, char * buf, size_t size);
+    void recordMemory(byte code);
+    MemoryProfile _memory;
+    Route * _served; // route served by the running update()
+#endif
+
+    static size_t formatAllowed(unsigned int methods, char * buf);
+    static size_t headerLength_P(const char * response);
+    unsigned int _allowed;
+    Route * _route;
+    bool _headOnly;
+    bool _headerSent;
+    byte _concurrencyLimit;
+    byte _queueDepth;
 };
 
 
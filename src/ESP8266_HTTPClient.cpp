@@ -0,0 +1,217 @@
+#include "ESP8266_HTTPClient.h"
+
+
+const char PROGMEM_CLIENT_POST[] PROGMEM = "POST %s HTTP/1.1\r\nHost: %s:%s\r\nContent-Type: text/plain\r\nContent-Length: %u\r\n\r\n";
+/**
+ * POST /samples HTTP/1.1\r\n
+ * Host: 192.168.1.2:8080\r\n
+ * Content-Type: text/plain\r\n
+ * Content-Length: 24\r\n
+ * \r\n
+ * temp=21\n
+ * hum=40\n
+ * ...
+ */
+
+const char PROGMEM_CONTENT_LENGTH[] PROGMEM = "Content-Length:";
+const char PROGMEM_CONNECTION_CLOSE[] PROGMEM = "Connection: close";
+const char PROGMEM_CHUNKED[] PROGMEM = "Transfer-Encoding: chunked";
+
+
+/**
+ * @param wifi Running server (or plain ESP8266_WLAN) whose serial link is shared.
+ * @param host IP address or domain name of the collector, not copied (pass a string literal).
+ * @param port Port of the collector, not copied.
+ * @param path Path to which samples are posted, not copied.
+ */
+ESP8266_HTTPClient::ESP8266_HTTPClient(ESP8266_WLAN & wifi, const char * host, const char * port, const char * path)
+    : _wifi(wifi)
+{
+    _host = host;
+    _port = port;
+    _path = path;
+    _batchSize = 0;
+    _batchStart = 0;
+    _state = CLIENT_IDLE;
+    _keepAlive = false;
+    _status = 0;
+    _bodyLeft = 0;
+    _sentAt = 0;
+    _lineLen = 0;
+}
+
+
+// Destructor
+ESP8266_HTTPClient::~ESP8266_HTTPClient() {}
+
+
+/**
+ * @brief Appends one sample (one line) to the batch. Full batch is posted right away.
+ * @param sample Text of the sample without end of line.
+ * @return false when the sample does not fit - the batch is full and the previous POST is not answered yet.
+ */
+bool ESP8266_HTTPClient::addSample(const char * sample) {
+    size_t len = strlen(sample) + 1; // \n
+    if (_batchSize + len > CLIENT_BATCH_SIZE)
+        flush();
+    if (_batchSize + len > CLIENT_BATCH_SIZE)
+        return false;
+    if (_batchSize == 0)
+        _batchStart = millis();
+    memcpy(_batch + _batchSize, sample, len - 1);
+    _batchSize += len;
+    _batch[_batchSize - 1] = '\n';
+    return true;
+}
+
+
+/**
+ * @brief Appends sample "<name>=<value>" to the batch.
+ */
+bool ESP8266_HTTPClient::addSample(const char * name, long value) {
+    char sample[24];
+    int len = snprintf(sample, sizeof(sample), "%s=%ld", name, value);
+    if (len < 0 || len >= (int)sizeof(sample))
+        return false;
+    return addSample(sample);
+}
+
+
+/**
+ * @brief Posts the batch now unless the previous POST is not answered yet.
+ * The batch is emptied as soon as ESP8266 sends it ("SEND OK"), lastStatus() tells the answer.
+ * @return true when the batch was sent (or it is empty).
+ */
+bool ESP8266_HTTPClient::flush() {
+    if (_batchSize == 0)
+        return true;
+    if (_state != CLIENT_IDLE)
+        return false;
+    // Keep-alive link may have been closed by the collector meanwhile - one more try on a new link
+    bool reused = _wifi.isLinkOpen();
+    if (post() || (reused && post()))
+        return true;
+    // Next attempt after CLIENT_FLUSH_INTERVAL
+    _batchStart = millis();
+    return false;
+}
+
+
+/**
+ * @brief Posts the deadline-expired batch and times out unanswered POST. Call it every loop cycle
+ * next to the update() of the server.
+ */
+void ESP8266_HTTPClient::update() {
+    if (_state != CLIENT_IDLE) {
+        if (millis() - _sentAt >= CLIENT_TIMEOUT) {
+            _status = 0;
+            _state = CLIENT_IDLE;
+            _wifi.closeLink();
+        }
+        return;
+    }
+    if (_batchSize > 0 && millis() - _batchStart >= CLIENT_FLUSH_INTERVAL)
+        flush();
+}
+
+
+/**
+ * @brief Sends the batch with the request header by one AT+CIPSEND, opens the link when needed.
+ */
+bool ESP8266_HTTPClient::post() {
+    if (!_wifi.isLinkOpen() && !_wifi.openLink(_host, _port, this))
+        return false;
+    char header[128];
+    int len = snprintf_P(header, sizeof(header), PROGMEM_CLIENT_POST, _path, _host, _port, (unsigned int)_batchSize);
+    if (len < 0 || len >= (int)sizeof(header))
+        return false;
+
+    _state = CLIENT_STATUS;
+    _status = 0;
+    _keepAlive = true;
+    _lineLen = 0;
+    _sentAt = millis();
+    if (!_wifi.transmit('0' + OUTBOUND_LINK, _batch, _batchSize, false, header, len)) {
+        _state = CLIENT_IDLE;
+        _wifi.closeLink();
+        return false;
+    }
+    _batchSize = 0;
+    return true;
+}
+
+
+/**
+ * @brief Parses the response as it comes - status line and headers line by line in _line,
+ * the body is skipped (Content-Length) so that the link can be reused.
+ * readLine() and discardLines() of ESP8266_WLAN read the serial stream - here update() has
+ * read the data already (pulled them in passive mode) and a line may be split between two
+ * segments, so it is joined in _line.
+ */
+void ESP8266_HTTPClient::linkData(char * data, size_t len) {
+    while (len > 0 && _state != CLIENT_IDLE) {
+        if (_state == CLIENT_BODY) {
+            if (_bodyLeft < 0)
+                return; // until the link is closed
+            size_t skip = ((long)len < _bodyLeft) ? len : _bodyLeft;
+            _bodyLeft -= skip;
+            data += skip;
+            len -= skip;
+            if (_bodyLeft == 0)
+                finishResponse();
+            continue;
+        }
+        char c = *data++;
+        len--;
+        if (c == '\n') {
+            _line[_lineLen] = '\0';
+            _lineLen = 0;
+            parseLine();
+        }
+        else if (c != '\r' && _lineLen < sizeof(_line) - 1) {
+            _line[_lineLen++] = c;
+        }
+    }
+}
+
+
+void ESP8266_HTTPClient::parseLine() {
+    if (_state == CLIENT_STATUS) {
+        // HTTP/1.1 200 OK
+        const char * pCode = strchr(_line, ' ');
+        _status = (pCode != NULL) ? atoi(pCode + 1) : 0;
+        // Responses without body
+        _bodyLeft = (_status == 204 || _status == 304) ? 0 : -1;
+        _state = CLIENT_HEADERS;
+        return;
+    }
+    if (_line[0] != '\0') {
+        if (strncasecmp_P(_line, PROGMEM_CONTENT_LENGTH, strlen_P(PROGMEM_CONTENT_LENGTH)) == 0)
+            _bodyLeft = atol(_line + strlen_P(PROGMEM_CONTENT_LENGTH));
+        else if (strcasecmp_P(_line, PROGMEM_CONNECTION_CLOSE) == 0)
+            _keepAlive = false;
+        else if (strcasecmp_P(_line, PROGMEM_CHUNKED) == 0)
+            _keepAlive = false; // end of the body is not tracked - the link is not reused
+        return;
+    }
+    // Empty line - end of the header
+    if (_bodyLeft < 0)
+        _keepAlive = false;
+    if (_bodyLeft == 0 || !_keepAlive)
+        finishResponse();
+    else
+        _state = CLIENT_BODY;
+}
+
+
+void ESP8266_HTTPClient::finishResponse() {
+    _state = CLIENT_IDLE;
+    if (!_keepAlive)
+        _wifi.closeLink();
+}
+
+
+// The response ends with the link at latest
+void ESP8266_HTTPClient::linkClosed() {
+    _state = CLIENT_IDLE;
+}
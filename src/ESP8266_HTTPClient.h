@@ -0,0 +1,58 @@
+/*
+ * HTTP client posting batches of samples to a collector over the outbound link of ESP8266_WLAN.
+ */
+#ifndef ESP8266_HTTPCLIENT_H
+#define ESP8266_HTTPCLIENT_H
+
+#include "ESP8266_WLAN.h"
+#include <avr/pgmspace.h>
+
+
+// States of the parser of the response
+enum ClientState { CLIENT_IDLE, CLIENT_STATUS, CLIENT_HEADERS, CLIENT_BODY };
+
+
+class ESP8266_HTTPClient : public LinkListener
+{
+public:
+    ESP8266_HTTPClient(ESP8266_WLAN & wifi, const char * host, const char * port, const char * path);
+    ~ESP8266_HTTPClient();
+
+    bool addSample(const char * sample);
+    bool addSample(const char * name, long value);
+    bool flush();
+    void update();
+
+    bool isBusy() { return _state != CLIENT_IDLE; }
+    size_t pending() { return _batchSize; }
+    int lastStatus() { return _status; }
+
+    void linkData(char * data, size_t len);
+    void linkClosed();
+private:
+    bool post();
+    void parseLine();
+    void finishResponse();
+
+    ESP8266_WLAN & _wifi;
+    // Not copied - expected to be string literals
+    const char * _host;
+    const char * _port;
+    const char * _path;
+
+    char _batch[CLIENT_BATCH_SIZE];
+    size_t _batchSize;
+    unsigned long _batchStart;
+
+    // Response of the last request
+    byte _state;
+    bool _keepAlive;
+    int _status;
+    long _bodyLeft; // -1 - until the link is closed
+    unsigned long _sentAt;
+    char _line[32]; // longer lines are cut - only the status line and a few headers are needed
+    byte _lineLen;
+};
+
+
+#endif
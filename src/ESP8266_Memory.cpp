@@ -0,0 +1,158 @@
+#include "ESP8266_Memory.h"
+
+#ifdef __AVR__
+// Symbols of the linker and of malloc() of avr-libc
+extern char __heap_start;
+extern char * __brkval;
+struct __freelist {
+    size_t sz;
+    struct __freelist * nx;
+};
+extern struct __freelist * __flp;
+
+// Top of the heap - the stack grows down towards it
+static char * heapEnd() {
+    return (__brkval == NULL) ? &__heap_start : __brkval;
+}
+#elif defined(ESP8266_HOST)
+#include <malloc.h>
+
+// Host build (extras/host): a window of the stack below the frame of paint() stands in for the
+// free SRAM. The margin keeps paint() from painting its own frame.
+#define HOST_STACK_WINDOW 16384
+#define HOST_STACK_MARGIN 256
+
+static char * stackBase = NULL;
+
+static char * windowStart() {
+    return stackBase - HOST_STACK_WINDOW;
+}
+
+static char * windowEnd() {
+    return stackBase - HOST_STACK_MARGIN;
+}
+#endif
+
+
+/**
+ * @brief Paints the free SRAM between the heap and the stack with STACK_CANARY. Only the part
+ * used since the last paint is painted again, so repeated calls are cheap. The host build paints
+ * HOST_STACK_WINDOW bytes below the caller instead.
+ */
+void ESP8266_Memory::paint() {
+#ifdef __AVR__
+    char * sp = (char *)SP;
+    char * p = heapEnd();
+    while (p < sp && *p == (char)STACK_CANARY)
+        p++;
+    while (p < sp)
+        *p++ = STACK_CANARY;
+#elif defined(ESP8266_HOST)
+    stackBase = (char *)__builtin_frame_address(0);
+    // Below the stack pointer - volatile, so the writes are not optimized away
+    volatile char * p = windowStart();
+    while (p < windowEnd() && *p == (char)STACK_CANARY)
+        p++;
+    while (p < windowEnd())
+        *p++ = STACK_CANARY;
+#endif
+}
+
+
+/**
+ * @return Painted bytes above the heap which were not used since paint() - the margin left
+ * at the deepest point of the stack.
+ */
+size_t ESP8266_Memory::stackUnused() {
+#ifdef __AVR__
+    char * sp = (char *)SP;
+    char * p = heapEnd();
+    while (p < sp && *p == (char)STACK_CANARY)
+        p++;
+    return p - heapEnd();
+#elif defined(ESP8266_HOST)
+    if (stackBase == NULL)
+        return 0;
+    volatile char * p = windowStart();
+    while (p < windowEnd() && *p == (char)STACK_CANARY)
+        p++;
+    return (char *)p - windowStart();
+#else
+    return 0;
+#endif
+}
+
+
+/**
+ * @param unused Result of stackUnused().
+ * @return Size of the stack at its deepest point since paint().
+ */
+size_t ESP8266_Memory::stackPeak(size_t unused) {
+#ifdef __AVR__
+    return (char *)RAMEND - (heapEnd() + unused);
+#elif defined(ESP8266_HOST)
+    // Below the frame of paint() - frames of update()'s callers are not counted
+    return (stackBase != NULL) ? HOST_STACK_WINDOW - unused : 0;
+#else
+    return 0;
+#endif
+}
+
+
+/**
+ * @return Bytes between the heap and the stack now.
+ */
+size_t ESP8266_Memory::freeMemory() {
+#ifdef __AVR__
+    return (char *)SP - heapEnd();
+#elif defined(ESP8266_HOST)
+    char * sp = (char *)__builtin_frame_address(0);
+    return (stackBase != NULL && sp > windowStart()) ? sp - windowStart() : 0;
+#else
+    return 0;
+#endif
+}
+
+
+/**
+ * @return Bytes of the heap including freed blocks (the heap never shrinks below a used block).
+ */
+size_t ESP8266_Memory::heapUsed() {
+#ifdef __AVR__
+    return heapEnd() - &__heap_start;
+#elif defined(ESP8266_HOST)
+    // Blocks in use of the whole process, the harness included
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+
+/**
+ * @brief Walks the free list of malloc() - many small blocks mean fragmentation.
+ * @param blocks Number of free blocks (up to 255).
+ * @param largest Size of the largest free block.
+ * @return Bytes of the free blocks inside the heap.
+ */
+size_t ESP8266_Memory::heapFree(byte * blocks, size_t * largest) {
+    size_t total = 0;
+    *blocks = 0;
+    *largest = 0;
+#ifdef __AVR__
+    for (struct __freelist * block = __flp; block != NULL; block = block->nx) {
+        total += block->sz + sizeof(size_t);
+        if (block->sz > *largest)
+            *largest = block->sz;
+        if (*blocks < 255)
+            (*blocks)++;
+    }
+#elif defined(ESP8266_HOST)
+    // glibc does not tell the largest free block - the top of the heap is the usual candidate
+    struct mallinfo2 info = mallinfo2();
+    total = info.fordblks;
+    *blocks = (info.ordblks < 255) ? info.ordblks : 255;
+    *largest = info.keepcost;
+#endif
+    return total;
+}
@@ -0,0 +1,27 @@
+/*
+ * SRAM probes of AVR - free memory between heap and stack, heap usage and stack high-water mark
+ * measured by stack painting. The host build (ESP8266_HOST) measures a window of its stack and
+ * the heap of malloc(), other architectures report 0.
+ */
+#ifndef ESP8266_MEMORY_H
+#define ESP8266_MEMORY_H
+
+#include "Arduino.h"
+
+// Value of never used bytes of the stack
+#define STACK_CANARY 0xC5
+
+
+class ESP8266_Memory
+{
+public:
+    static void paint();
+    static size_t stackUnused();
+    static size_t stackPeak(size_t unused);
+    static size_t freeMemory();
+    static size_t heapUsed();
+    static size_t heapFree(byte * blocks, size_t * largest);
+};
+
+
+#endif
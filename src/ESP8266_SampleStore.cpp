@@ -0,0 +1,323 @@
+#include "ESP8266_SampleStore.h"
+
+
+#if ESP8266_TASKS
+const char PROGMEM_EXPORT_CSV[] PROGMEM = "HTTP/1.1 200 OK\r\nConnection: Closed\r\nContent-Type: text/csv\r\n\r\ntime,value\n";
+const char PROGMEM_EXPORT_BINARY[] PROGMEM = "HTTP/1.1 200 OK\r\nConnection: Closed\r\nContent-Type: application/octet-stream\r\n\r\n";
+const char PROGMEM_EXPORT_BAD_REQUEST[] PROGMEM = "HTTP/1.1 400 BAD REQUEST\r\nConnection: Closed\r\nContent-Length: 0\r\n\r\n";
+/**
+ * GET /history?from=-600&step=60 HTTP/1.1
+ *
+ * HTTP/1.1 200 OK\r\n
+ * Connection: Closed\r\n
+ * Content-Type: text/csv\r\n
+ * \r\n
+ * time,value\n
+ * 1200,215\n
+ * 1260,217\n
+ * ...
+ */
+#endif
+
+
+/**
+ * @param period Time between two appended samples (s) - times of samples are derived from it.
+ */
+ESP8266_SampleStore::ESP8266_SampleStore(unsigned int period) {
+    _period = (period > 0) ? period : 1;
+    _total = 0;
+    clear();
+}
+
+
+// Destructor
+ESP8266_SampleStore::~ESP8266_SampleStore() {}
+
+
+/**
+ * @brief Appends the sample, the oldest one is overwritten when the store is full.
+ * Call it every period - the time of the sample is the time of the call.
+ * @param value Value of the sample. With SAMPLE_DELTA_ENCODING a sample after a jump over 127
+ * is stored whole - one of SAMPLE_DELTA_ESCAPES, the store then starts at the oldest one kept.
+ */
+void ESP8266_SampleStore::append(int value) {
+#if SAMPLE_DELTA_ENCODING
+    if (_count == 0) {
+        _first = value;
+        _last = value;
+    }
+    if (_count == SAMPLE_STORE_CAPACITY) {
+        // The overwritten sample was the oldest one stored whole
+        if (_samples[_head] == SAMPLE_ESCAPE)
+            _escapeCount--;
+        // The next sample becomes the oldest one
+        _first = follow(_first, _total - _count + 1);
+    }
+    long delta = (long)value - _last;
+    if (delta > 127 || delta < -127) {
+        escape(value);
+        delta = SAMPLE_ESCAPE;
+    }
+    _last = value;
+    _samples[_head] = delta;
+#else
+    _samples[_head] = value;
+#endif
+    if (++_head == SAMPLE_STORE_CAPACITY)
+        _head = 0;
+    if (_count < SAMPLE_STORE_CAPACITY)
+        _count++;
+    _total++;
+    _newest = millis() / 1000;
+}
+
+
+/**
+ * @brief Drops all samples. Running exports end with the samples sent so far.
+ */
+void ESP8266_SampleStore::clear() {
+    _head = 0;
+    _count = 0;
+    _newest = 0;
+#if SAMPLE_DELTA_ENCODING
+    _first = 0;
+    _last = 0;
+    _escapeHead = 0;
+    _escapeCount = 0;
+#endif
+}
+
+
+/**
+ * @param index 0 - the oldest sample, size() - 1 - the newest one.
+ * @return Value of the sample (decoded from the oldest one with SAMPLE_DELTA_ENCODING), 0 when out of range.
+ */
+int ESP8266_SampleStore::get(unsigned int index) {
+    if (index >= _count)
+        return 0;
+    SampleCursor cursor;
+    seek(&cursor, _total - _count + index);
+    return read(&cursor);
+}
+
+
+#if ESP8266_TASKS
+/**
+ * @brief Registers GET route exporting the samples. Query parameters (all optional):
+ * from, to - time range (s since start of the board, negative - seconds before now),
+ * step - seconds per exported point (mean of its samples), format=bin - packed binary instead of CSV.
+ * @param path Path of the export, not copied (pass a string literal).
+ * @return false when MAX_ROUTES routes are registered already.
+ */
+bool ESP8266_SampleStore::registerExport(ESP8266_HTTP & server, const char * path, byte priority) {
+    if (!server.registerTask(GET, path, exportTask, priority))
+        return false;
+    server.getRoute(server.size())->setData(this);
+    return true;
+}
+
+
+/**
+ * @brief Resumable handler of the export - sends one TX_BUFFER of points per step,
+ * nothing but the cursor is kept between steps.
+ */
+byte ESP8266_SampleStore::exportTask(ESP8266_HTTP & server, HTTP_Task * task) {
+    SampleCursor * cursor = TASK_CONTEXT(task, SampleCursor);
+    ESP8266_SampleStore * store = (ESP8266_SampleStore *)task->route->getData();
+    TASK_BEGIN(task);
+    // The query is in the RX_BUFFER until the first yield only
+    if (!store->beginExport(task->route, cursor)) {
+        server.send_PROGMEM(PROGMEM_EXPORT_BAD_REQUEST);
+        server.send(task->channel);
+    }
+    else {
+        server.send_PROGMEM(cursor->binary ? PROGMEM_EXPORT_BINARY : PROGMEM_EXPORT_CSV);
+        if (server.send(task->channel) && !server.isHeadOnly()) {
+            while (cursor->next != cursor->end) {
+                TASK_YIELD(task);
+                if (!store->exportPart(server, cursor) || !server.send(task->channel))
+                    break;
+            }
+        }
+    }
+    server.closeConnection(task->channel);
+    TASK_END(task);
+}
+
+
+/**
+ * @brief Parses time parameter of the query.
+ * @return false when the parameter is present but it is not a number.
+ */
+static bool parseTime(Route * route, const char * name, unsigned long now, unsigned long * time) {
+    if (route->getParam(name) == NULL)
+        return true;
+    long value;
+    if (!route->getParamInt(name, &value))
+        return false;
+    if (value >= 0)
+        *time = value;
+    else
+        *time = ((unsigned long)-value < now) ? now + value : 0;
+    return true;
+}
+
+
+/**
+ * @brief Sets the cursor to the range of the query.
+ * @return false when the query is malformed.
+ */
+bool ESP8266_SampleStore::beginExport(Route * route, SampleCursor * cursor) {
+    unsigned long now = millis() / 1000;
+    unsigned long from = 0;
+    unsigned long to = _newest;
+    long step = _period;
+    if (!parseTime(route, "from", now, &from) || !parseTime(route, "to", now, &to))
+        return false;
+    if (route->getParam("step") != NULL && (!route->getParamInt("step", &step) || step <= 0))
+        return false;
+    const char * format = route->getParam("format");
+    cursor->binary = (format != NULL && strncmp(format, "bin", 3) == 0);
+    cursor->perPoint = (step / _period > 255) ? 255 : ((step < (long)_period) ? 1 : step / _period);
+
+    // Range as ages of samples (1 - the newest one)
+    unsigned long ageFrom = (from <= _newest) ? (_newest - from) / _period + 1 : 0;
+    unsigned long ageEnd = (to < _newest) ? (_newest - to + _period - 1) / _period : 0;
+    if (ageFrom > _count)
+        ageFrom = _count;
+    if (ageEnd > _count)
+        ageEnd = _count;
+    cursor->end = _total - ageEnd;
+    if (ageFrom <= ageEnd)
+        cursor->next = cursor->end; // empty
+    else
+        seek(cursor, _total - ageFrom);
+    return true;
+}
+
+
+/**
+ * @brief Appends points to the TX_BUFFER while they fit.
+ * @return false when there was nothing to append.
+ */
+bool ESP8266_SampleStore::exportPart(ESP8266_HTTP & server, SampleCursor * cursor) {
+    // The rest of the range was overwritten meanwhile
+    if ((unsigned int)(_total - cursor->end) >= _count)
+        cursor->next = cursor->end;
+
+    char point[16]; // "4294967,-32768\n"
+    size_t used = 0;
+    while (cursor->next != cursor->end && used + sizeof(point) < MAX_TX_BUFFER_SIZE) {
+        long sum = read(cursor);
+        unsigned long time = timeOf(cursor->next - 1);
+        byte n = 1;
+        for (; n < cursor->perPoint && cursor->next != cursor->end; n++)
+            sum += read(cursor);
+        int mean = sum / n;
+        if (cursor->binary) {
+            for (byte i = 0; i < 4; i++)
+                point[i] = (time >> (8 * i)) & 0xFF;
+            point[4] = mean & 0xFF;
+            point[5] = (mean >> 8) & 0xFF;
+            server.send(point, SAMPLE_POINT_SIZE);
+            used += SAMPLE_POINT_SIZE;
+        }
+        else {
+            snprintf(point, sizeof(point), "%lu,%d\n", time, mean);
+            server.send(point);
+            used += strlen(point);
+        }
+    }
+    return used > 0;
+}
+#endif
+
+
+// Index in _samples of the sample which is still in the store
+unsigned int ESP8266_SampleStore::position(unsigned int sequence) {
+    unsigned int age = _total - sequence;
+    return (_head >= age) ? _head - age : _head + SAMPLE_STORE_CAPACITY - age;
+}
+
+
+/**
+ * @brief Sets the cursor to the sample, differences are summed from the oldest one.
+ * @param sequence Sequence number of a sample which is in the store.
+ */
+void ESP8266_SampleStore::seek(SampleCursor * cursor, unsigned int sequence) {
+#if SAMPLE_DELTA_ENCODING
+    cursor->next = _total - _count;
+    cursor->value = _first;
+    while (cursor->next != sequence) {
+        cursor->next++;
+        cursor->value = follow(cursor->value, cursor->next);
+    }
+#else
+    cursor->next = sequence;
+#endif
+}
+
+
+/**
+ * @brief Reads the next sample of the cursor. The cursor moves to the oldest sample
+ * when its sample was overwritten meanwhile.
+ */
+int ESP8266_SampleStore::read(SampleCursor * cursor) {
+    if ((unsigned int)(_total - cursor->next) > _count)
+        seek(cursor, _total - _count);
+#if SAMPLE_DELTA_ENCODING
+    int value = cursor->value;
+    if (++cursor->next != _total)
+        cursor->value = follow(value, cursor->next);
+    return value;
+#else
+    return _samples[position(cursor->next++)];
+#endif
+}
+
+
+// Time of the sample (s since start of the board) - samples are appended every period
+unsigned long ESP8266_SampleStore::timeOf(unsigned int sequence) {
+    return _newest - (unsigned long)(unsigned int)(_total - 1 - sequence) * _period;
+}
+
+
+#if SAMPLE_DELTA_ENCODING
+/**
+ * @param value Value of the sample before.
+ * @param sequence Sequence number of a sample which is in the store.
+ * @return Value of the sample - the difference added or the whole value.
+ */
+int ESP8266_SampleStore::follow(int value, unsigned int sequence) {
+    int8_t delta = _samples[position(sequence)];
+    if (delta != SAMPLE_ESCAPE)
+        return value + delta;
+    for (byte i = 1; i <= _escapeCount; i++) {
+        SampleEscape * e = &_escapes[(_escapeHead >= i) ? _escapeHead - i : _escapeHead + SAMPLE_DELTA_ESCAPES - i];
+        if (e->sequence == sequence)
+            return e->value;
+    }
+    return value;
+}
+
+
+/**
+ * @brief Keeps the sample being appended whole. When all SAMPLE_DELTA_ESCAPES are used,
+ * the oldest one is given up and the samples before it are dropped - it becomes the oldest sample.
+ */
+void ESP8266_SampleStore::escape(int value) {
+    if (_escapeCount == SAMPLE_DELTA_ESCAPES) {
+        SampleEscape * oldest = &_escapes[_escapeHead];
+        _count = _total - oldest->sequence;
+        _first = oldest->value;
+        // Its difference is not read any more - the oldest sample is _first
+        _samples[position(oldest->sequence)] = 0;
+        _escapeCount--;
+    }
+    _escapes[_escapeHead].sequence = _total;
+    _escapes[_escapeHead].value = value;
+    if (++_escapeHead == SAMPLE_DELTA_ESCAPES)
+        _escapeHead = 0;
+    _escapeCount++;
+}
+#endif
@@ -0,0 +1,105 @@
+/*
+ * Fixed-memory history of samples taken at a fixed period, exported by a route of ESP8266_HTTP
+ * as CSV or packed binary in parts, while other clients are served.
+ */
+#ifndef ESP8266_SAMPLESTORE_H
+#define ESP8266_SAMPLESTORE_H
+
+#include "ESP8266_HTTP.h"
+#include <avr/pgmspace.h>
+
+#if SAMPLE_STORE_CAPACITY < 2 || SAMPLE_STORE_CAPACITY > 32767
+#error "SAMPLE_STORE_CAPACITY must be 2 - 32767"
+#endif
+
+#if SAMPLE_DELTA_ENCODING
+#if SAMPLE_DELTA_ESCAPES < 1 || SAMPLE_DELTA_ESCAPES > 255
+#error "SAMPLE_DELTA_ESCAPES must be 1 - 255"
+#endif
+
+// Difference which marks a sample stored whole (jump over 127)
+#define SAMPLE_ESCAPE -128
+
+struct SampleEscape {
+    unsigned int sequence;
+    int value;
+};
+#endif
+
+/**
+ * Point of binary export (application/octet-stream), little endian:
+ * [0 - 3] time of the first sample of the step (uint32, s since start of the board)
+ * [4 - 5] mean of the samples of the step (int16)
+ */
+#define SAMPLE_POINT_SIZE 6
+
+/**
+ * Position of a running export - sequence numbers of samples survive overwriting of the ring,
+ * so the export continues correctly when new samples are appended meanwhile.
+ */
+struct SampleCursor {
+    unsigned int next; // sequence number of the next exported sample
+    unsigned int end;  // sequence number after the last exported sample
+    int value;         // value of the next sample (decoded differences)
+    byte perPoint;     // samples per exported point (step)
+    bool binary;
+};
+
+#if ESP8266_TASKS
+// 8 bytes on AVR, 16 where int has 4 bytes (host build)
+static_assert(sizeof(SampleCursor) <= TASK_CONTEXT_SIZE, "ESP8266_SampleStore needs TASK_CONTEXT_SIZE of at least sizeof(SampleCursor)");
+#endif
+
+
+class ESP8266_SampleStore
+{
+public:
+    ESP8266_SampleStore(unsigned int period);
+    ~ESP8266_SampleStore();
+
+    void append(int value);
+    void clear();
+    int get(unsigned int index);
+
+    unsigned int size() { return _count; }
+    unsigned int capacity() { return SAMPLE_STORE_CAPACITY; }
+    unsigned int period() { return _period; }
+    unsigned long newest() { return _newest; }
+
+#if ESP8266_TASKS
+    bool registerExport(ESP8266_HTTP & server, const char * path, byte priority = PRIORITY_LOW);
+    static byte exportTask(ESP8266_HTTP & server, HTTP_Task * task);
+#endif
+private:
+    unsigned int position(unsigned int sequence);
+    void seek(SampleCursor * cursor, unsigned int sequence);
+    int read(SampleCursor * cursor);
+    unsigned long timeOf(unsigned int sequence);
+#if SAMPLE_DELTA_ENCODING
+    int follow(int value, unsigned int sequence);
+    void escape(int value);
+#endif
+#if ESP8266_TASKS
+    bool beginExport(Route * route, SampleCursor * cursor);
+    bool exportPart(ESP8266_HTTP & server, SampleCursor * cursor);
+#endif
+
+#if SAMPLE_DELTA_ENCODING
+    int8_t _samples[SAMPLE_STORE_CAPACITY]; // difference from the previous sample
+    int _first; // value of the oldest sample
+    int _last;  // value of the newest sample
+    SampleEscape _escapes[SAMPLE_DELTA_ESCAPES]; // samples stored whole, the oldest first
+    byte _escapeHead;  // where the next one is written
+    byte _escapeCount;
+#else
+    int _samples[SAMPLE_STORE_CAPACITY];
+#endif
+    unsigned int _head;  // where the next sample is written
+    unsigned int _count;
+    unsigned int _total; // sequence number of the next sample (wraps)
+    unsigned int _period; // s
+    unsigned long _newest; // time of the newest sample (s since start of the board)
+};
+
+
+#endif
@@ -0,0 +1,96 @@
+#include "ESP8266_Telemetry.h"
+
+
+/**
+ * @param wifi Running server (or plain ESP8266_WLAN) whose serial link is shared.
+ * @param host IP address of the receiver, not copied (pass a string literal).
+ * @param port UDP port of the receiver, not copied.
+ */
+ESP8266_Telemetry::ESP8266_Telemetry(ESP8266_WLAN & wifi, const char * host, const char * port)
+    : _wifi(wifi)
+{
+    _host = host;
+    _port = port;
+    _size = TELEMETRY_HEADER_SIZE;
+    _count = 0;
+    _start = 0;
+    _sequence = 0;
+    _dropped = 0;
+}
+
+
+// Destructor
+ESP8266_Telemetry::~ESP8266_Telemetry() {}
+
+
+/**
+ * @brief Opens the UDP link. Not required - flush() opens it when needed.
+ * @return true when the link is open.
+ */
+bool ESP8266_Telemetry::begin() {
+    return _wifi.isUDPOpen() || _wifi.openUDP(_host, _port);
+}
+
+
+/**
+ * @brief Appends one record to the datagram. Full datagram (TELEMETRY_MTU) is sent right away,
+ * the datagram is sent first when time of the record does not fit into 16 bits.
+ * @param sensor ID of the sensor.
+ * @param value Value of the sample.
+ * @return false when a datagram had to be sent and it failed (its records are dropped).
+ */
+bool ESP8266_Telemetry::record(byte sensor, int value) {
+    unsigned long now = millis();
+    bool success = true;
+    if (_count > 0 && now - _start > 0xFFFF)
+        success = flush();
+    if (_count == 0)
+        _start = now;
+    put(_size, now - _start, 2);
+    _datagram[_size + 2] = sensor;
+    put(_size + 3, (unsigned int)value, 2);
+    _size += TELEMETRY_RECORD_SIZE;
+    _count++;
+    if (_size + TELEMETRY_RECORD_SIZE > TELEMETRY_MTU)
+        success = flush() && success;
+    return success;
+}
+
+
+/**
+ * @brief Sends the datagram by one AT+CIPSEND (no acknowledgement, no retransmission).
+ * The sequence number advances even when sending fails, so the receiver sees the loss.
+ * @return true when ESP8266 sent the datagram (or it is empty).
+ */
+bool ESP8266_Telemetry::flush() {
+    if (_count == 0)
+        return true;
+    put(0, _sequence++, 2);
+    put(2, _start, 4);
+    _datagram[6] = _count;
+    bool success = begin() && _wifi.transmit('0' + TELEMETRY_LINK, _datagram, _size, false);
+    if (!success)
+        _dropped += _count;
+    _size = TELEMETRY_HEADER_SIZE;
+    _count = 0;
+    return success;
+}
+
+
+/**
+ * @brief Sends the datagram when its first record is older than TELEMETRY_FLUSH_INTERVAL.
+ * Call it every loop cycle next to the update() of the server.
+ */
+void ESP8266_Telemetry::update() {
+    if (_count > 0 && millis() - _start >= TELEMETRY_FLUSH_INTERVAL)
+        flush();
+}
+
+
+// Writes value in little endian
+void ESP8266_Telemetry::put(byte offset, unsigned long value, byte size) {
+    for (byte i = 0; i < size; i++) {
+        _datagram[offset + i] = value & 0xFF;
+        value >>= 8;
+    }
+}
@@ -0,0 +1,57 @@
+/*
+ * UDP telemetry - fixed-size binary records packed into datagrams, sent over the telemetry link of ESP8266_WLAN.
+ */
+#ifndef ESP8266_TELEMETRY_H
+#define ESP8266_TELEMETRY_H
+
+#include "ESP8266_WLAN.h"
+
+/**
+ * Datagram (little endian):
+ * [0 - 1] sequence number (uint16) - gaps tell lost datagrams
+ * [2 - 5] time of the first record (uint32, millis())
+ * [6]     number of records
+ * [7 - ]  records, TELEMETRY_RECORD_SIZE bytes each:
+ *         [0 - 1] time since the first record (uint16, ms)
+ *         [2]     sensor ID
+ *         [3 - 4] value (int16)
+ */
+#define TELEMETRY_HEADER_SIZE 7
+#define TELEMETRY_RECORD_SIZE 5
+
+#if TELEMETRY_MTU < TELEMETRY_HEADER_SIZE + TELEMETRY_RECORD_SIZE || TELEMETRY_MTU > 255
+#error "TELEMETRY_MTU must hold at least one record and at most 255 bytes"
+#endif
+
+
+class ESP8266_Telemetry
+{
+public:
+    ESP8266_Telemetry(ESP8266_WLAN & wifi, const char * host, const char * port);
+    ~ESP8266_Telemetry();
+
+    bool begin();
+    bool record(byte sensor, int value);
+    bool flush();
+    void update();
+
+    unsigned int sequence() { return _sequence; }
+    unsigned long dropped() { return _dropped; }
+private:
+    void put(byte offset, unsigned long value, byte size);
+
+    ESP8266_WLAN & _wifi;
+    // Not copied - expected to be string literals
+    const char * _host;
+    const char * _port;
+
+    char _datagram[TELEMETRY_MTU];
+    byte _size;
+    byte _count;
+    unsigned long _start; // time of the first record
+    unsigned int _sequence;
+    unsigned long _dropped; // records of datagrams which were not sent
+};
+
+
+#endif
@@ -12,6 +12,12 @@ const char PROGMEM_STAIP[] PROGMEM = "STAIP,\"";
 const char PROGMEM_STAMAC[] PROGMEM = "STAMAC,\"";
 const char PROGMEM_STATUS[] PROGMEM = "STATUS:";
 const char PROGMEM_WIFI_DISCONNECT[] PROGMEM = "WIFI DISCONNECT";
+const char PROGMEM_WIFI_CONNECTED[] PROGMEM = "WIFI CONNECTED";
+const char PROGMEM_WIFI_GOT_IP[] PROGMEM = "WIFI GOT IP";
+const char PROGMEM_CWMODE_CUR[] PROGMEM = "+CWMODE:";
+const char PROGMEM_CIPMUX_CUR[] PROGMEM = "+CIPMUX:";
+const char PROGMEM_CWJAP_CUR[] PROGMEM = "+CWJAP:\"";
+const char PROGMEM_CIPRECVDATA_R[] PROGMEM = "+CIPRECVDATA";
 
 // Requests
 const char PROGMEM_CIPSTATUS[] PROGMEM = "AT+CIPSTATUS";
@@ -21,38 +27,109 @@ const char PROGMEM_AT[] PROGMEM = "AT";
 const char PROGMEM_ATE1[] PROGMEM = "ATE1";
 const char PROGMEM_RST[] PROGMEM = "AT+RST";
 const char PROGMEM_GMR[] PROGMEM = "AT+GMR";
+#if ESP8266_SAVE_AP
+const char PROGMEM_CWJAP[] PROGMEM = "AT+CWJAP_DEF=\"";
+#else
 const char PROGMEM_CWJAP[] PROGMEM = "AT+CWJAP=\"";
+#endif
+const char PROGMEM_CWJAP_Q[] PROGMEM = "AT+CWJAP?";
+const char PROGMEM_CWMODE_Q[] PROGMEM = "AT+CWMODE?";
+const char PROGMEM_CIPMUX_Q[] PROGMEM = "AT+CIPMUX?";
+const char PROGMEM_CWAUTOCONN_1[] PROGMEM = "AT+CWAUTOCONN=1";
 const char PROGMEM_CWQAP[] PROGMEM = "AT+CWQAP";
 const char PROGMEM_CIFSR[] PROGMEM = "AT+CIFSR";
 const char PROGMEM_CIPSERVER_START[] PROGMEM = "AT+CIPSERVER=1,";
 const char PROGMEM_CIPSERVER_STOP[] PROGMEM = "AT+CIPSERVER=0";
+const char PROGMEM_CIPSERVERMAXCONN[] PROGMEM = "AT+CIPSERVERMAXCONN=";
+const char PROGMEM_CIPSTART_LINK[] PROGMEM = "AT+CIPSTART=";
+#define OUTBOUND_CHANNEL ((char)('0' + OUTBOUND_LINK))
+#define TELEMETRY_CHANNEL ((char)('0' + TELEMETRY_LINK))
 const char PROGMEM_CIPCLOSE[] PROGMEM = "AT+CIPCLOSE=";
 const char PROGMEM_CIPSEND[] PROGMEM = "AT+CIPSEND=";
 const char PROGMEM_IPD[] PROGMEM = "+IPD,";
+const char PROGMEM_CIPRECVMODE[] PROGMEM = "AT+CIPRECVMODE=";
+const char PROGMEM_CIPRECVDATA[] PROGMEM = "AT+CIPRECVDATA=";
+#if ESP8266_PASSTHROUGH
+const char PROGMEM_CIPMUX_0[] PROGMEM = "AT+CIPMUX=0";
+const char PROGMEM_CIPSTART[] PROGMEM = "AT+CIPSTART=\"TCP\",\"";
+const char PROGMEM_CIPMODE_0[] PROGMEM = "AT+CIPMODE=0";
+const char PROGMEM_CIPMODE_1[] PROGMEM = "AT+CIPMODE=1";
+const char PROGMEM_CIPSEND_T[] PROGMEM = "AT+CIPSEND";
+const char PROGMEM_CIPCLOSE_T[] PROGMEM = "AT+CIPCLOSE";
+const char PROGMEM_ESCAPE[] PROGMEM = "+++";
+#endif
+
+// AT+CIPRECVDATA returns at most 2048 bytes at once
+#define PULL_REST_SIZE 2048
+// Kept frame: channel, overflowed, 2 bytes of length, data and a spare byte for the terminator
+#define STASH_HEADER_SIZE 4
+
+#if ESP8266_METRICS
+#define METRICS_BEGIN() unsigned long metricsStart = micros(); _busyDepth++
+#define METRICS_END() recordBusy(metricsStart)
+#else
+#define METRICS_BEGIN()
+#define METRICS_END()
+#endif
 
 
 // Constructor
-ESP8266_WLAN::ESP8266_WLAN(byte RX_PIN, byte TX_PIN, byte RST_PIN):
+ESP8266_WLAN::ESP8266_WLAN(byte RX_PIN, byte TX_PIN, byte RST_PIN, long baud):
 SoftwareSerial::SoftwareSerial(RX_PIN, TX_PIN)
 {
-    SoftwareSerial::begin(9600);
+    SoftwareSerial::begin(baud);
 
+    // Keep ESP8266 running - its state may survive reset of Arduino (see warmStart())
     _RST_PIN = RST_PIN;
+    digitalWrite(_RST_PIN, HIGH);
     pinMode(_RST_PIN, OUTPUT);
-    digitalWrite(_RST_PIN, LOW); // Reset ESP8266
 
     _flags.initialized = false;
     _flags.connectedToAP = false;
+    _flags.gotIP = false;
     _flags.tcpServerRunning = false;
     _flags.sending = false;
     _flags.unexpectedEcho = false;
-
+    _flags.closed = false;
+    _flags.passThrough = false;
+    _flags.passiveMode = false;
+    _flags.linkOpen = false;
+    _flags.linkPending = false;
+    _flags.udpOpen = false;
+    _listener = NULL;
+    _stashAt = 0;
+    _stashSize = 0;
+    _ip[0] = '\0';
+    _mac[0] = '\0';
+
+    _pullIndex = 0;
+    _streamIndex = 0;
+    _streamTurn = 0;
+    _fairIndex = 0;
     for (byte i = 0; i < MAX_CONNECTIONS; i++) {
         _connections[i].channel = i + '0';
         _connections[i].connected = false;
+        _connections[i].dataPending = false;
+        _connections[i].raw = false;
+        _connections[i].receiving = false;
+        _connections[i].streamLeft = 0;
+        _connections[i].requests = 0;
+#if ESP8266_METRICS
+        _connections[i].requestStart = 0;
+#endif
     }
-    memset(BUFFER, '\0', MAX_BUFFER_SIZE);
-    CUR_BUFFER_SIZE = 0;
+    memset(RX_BUFFER, '\0', MAX_RX_BUFFER_SIZE);
+    CUR_RX_BUFFER_SIZE = 0;
+    memset(TX_BUFFER, '\0', MAX_TX_BUFFER_SIZE);
+    CUR_TX_BUFFER_SIZE = 0;
+#if ESP8266_SUPERVISOR
+    memset(&_health, 0, sizeof(_health));
+    _health.state = HEALTH_IDLE;
+#endif
+#if ESP8266_METRICS
+    _busyDepth = 0;
+    resetMetrics();
+#endif
 }
 
 
@@ -77,9 +154,18 @@ bool ESP8266_WLAN::isActive() {
 bool ESP8266_WLAN::init() {
     _flags.initialized = false;
     _flags.connectedToAP = false;
+    _flags.gotIP = false;
     _flags.tcpServerRunning = false;
     _flags.sending = false;
     _flags.unexpectedEcho = false;
+    _flags.closed = false;
+    _flags.passThrough = false;
+    _stashSize = 0;
+    _ip[0] = '\0';
+    releaseLinks();
+#if ESP8266_SUPERVISOR
+    _health.state = HEALTH_IDLE;
+#endif
 
     // Do a HW restart
     if (!hardRestart()) {
@@ -101,6 +187,87 @@ bool ESP8266_WLAN::init() {
     if (checkResponse() != 1)
         return false;
 
+    // Restore receive mode requested by setPassiveMode()
+    if (!applyReceiveMode())
+        return false;
+
+    _flags.initialized = true;
+    return true;
+}
+
+
+/**
+ * @brief Reuses configuration of ESP8266 which survived reset of Arduino.
+ * Instead of hard restart it probes ESP8266, queries its current state
+ * and applies only the missing configuration.
+ * @param ssid Access Point Identifier
+ * @param pass Passphrase
+ * @return true when ESP8266 is initialized and connected to Access Point,
+ * false when ESP8266 does not respond and init() is necessary.
+ */
+bool ESP8266_WLAN::warmStart(const char * ssid, const char * pass) {
+    strncpy(_ssid, ssid, sizeof(_ssid) - 1);
+    _ssid[sizeof(_ssid) - 1] = '\0';
+    strncpy(_pass, pass, sizeof(_pass) - 1);
+    _pass[sizeof(_pass) - 1] = '\0';
+    if (!reconfigure())
+        return false;
+
+    if (isConnectedToAP(_ssid)) {
+        _flags.connectedToAP = true;
+        _flags.gotIP = (queryStatus() != '5');
+        return true;
+    }
+    return connectToAP();
+}
+
+
+/**
+ * @brief Probes ESP8266 and applies only the missing configuration (without Access Point).
+ * Gives up at the first command which is not answered: WARM_START_TIMEOUT when ESP8266
+ * is dead, otherwise at most 2 x AT_TIMEOUT.
+ * @return true when ESP8266 is initialized.
+ */
+bool ESP8266_WLAN::reconfigure() {
+    _flags.initialized = false;
+    _flags.connectedToAP = false;
+    _flags.gotIP = false;
+    _flags.tcpServerRunning = false;
+    _flags.sending = false;
+    _flags.unexpectedEcho = false;
+    _flags.closed = false;
+    _flags.passThrough = false;
+    _stashSize = 0;
+    _ip[0] = '\0';
+    // Links did not survive - restore() after restart of ESP8266
+    releaseLinks();
+
+    // Probe - echo may be turned off, do not expect it
+    writeCommand(PROGMEM_AT);
+    if (checkResponse(WARM_START_TIMEOUT) != 1)
+        return false;
+
+    // Turn on echo
+    writeCommand(PROGMEM_ATE1);
+    if (checkResponse() != 1)
+        return false;
+
+    // Set Station mode (No SoftAP)
+    if (queryValue(PROGMEM_CWMODE_Q, PROGMEM_CWMODE_CUR) != '1') {
+        writeCommand(PROGMEM_CWMODE_1);
+        if (checkResponse() != 1)
+            return false;
+    }
+
+    // Allow multiple connections
+    if (queryValue(PROGMEM_CIPMUX_Q, PROGMEM_CIPMUX_CUR) != '1') {
+        writeCommand(PROGMEM_CIPMUX_1);
+        if (checkResponse() != 1)
+            return false;
+    }
+
+    if (!applyReceiveMode())
+        return false;
     _flags.initialized = true;
     return true;
 }
@@ -113,8 +280,10 @@ bool ESP8266_WLAN::init() {
  * @return true when successful.
  */
 bool ESP8266_WLAN::connectToAP(const char * ssid, const char * pass) {
-    strncpy(_ssid, ssid, sizeof(_ssid));
-    strncpy(_pass, pass, sizeof(_pass));
+    strncpy(_ssid, ssid, sizeof(_ssid) - 1);
+    _ssid[sizeof(_ssid) - 1] = '\0';
+    strncpy(_pass, pass, sizeof(_pass) - 1);
+    _pass[sizeof(_pass) - 1] = '\0';
     return connectToAP();
 }
 
@@ -124,16 +293,34 @@ bool ESP8266_WLAN::connectToAP(const char * ssid, const char * pass) {
  * @return true when successful.
  */
 bool ESP8266_WLAN::connectToAP() {
+    requestJoin();
+    if (checkResponse(JOIN_TIMEOUT) != 1)
+        return false;
+    joined();
+    return true;
+}
+
+
+// AT+CWJAP without waiting for its reply
+void ESP8266_WLAN::requestJoin() {
     writeCommand(PROGMEM_CWJAP, false);
     print(_ssid);
     print("\",\"");
     print(_pass);
     println("\"");
+}
 
-    if (checkResponse() != 1)
-        return false;
+
+// "OK" of AT+CWJAP came after "WIFI GOT IP"
+void ESP8266_WLAN::joined() {
     _flags.connectedToAP = true;
-    return true;
+    _flags.gotIP = true;
+
+#if ESP8266_SAVE_AP
+    // Rejoin by itself after restart of ESP8266
+    writeCommand(PROGMEM_CWAUTOCONN_1);
+    checkResponse();
+#endif
 }
 
 
@@ -146,57 +333,145 @@ bool ESP8266_WLAN::disconnectFromAP() {
     if (checkResponse() != 1)
         return false;
     _flags.connectedToAP = false;
+    _flags.gotIP = false;
+    _ip[0] = '\0';
     return true;
 }
 
 
 /**
- * @brief Performs an AT command to request static IPv4 address.
+ * @brief Returns cached IPv4 address. AT command is performed only when the address
+ * is not known yet (e. g. after "WIFI GOT IP").
  * @return IPv4 address of ESP8266.
  */
 char * ESP8266_WLAN::getIP() {
-    writeCommand(PROGMEM_CIFSR);
-    if (!readCommand(PROGMEM_CIFSR))
-        return "";
-    if (readData() != 1)
-        return "";
-
-    // Data are stored in BUFFER
-    const char * ps = strstr_P(BUFFER, PROGMEM_STAIP) + strlen_P(PROGMEM_STAIP);
-    const char * pe = strchr(ps, '"');
-    byte len = pe - ps;
-    memcpy(_ip, ps, len);
-    _ip[len] = '\0';
+    if (_ip[0] == '\0')
+        refreshAddresses();
     return _ip;
 }
 
 
 /**
- * @brief Performs an AT command to request MAC address.
+ * @brief Returns cached MAC address. AT command is performed only the first time.
  * @return MAC address of ESP8266 in string format: xx:xx:xx:xx:xx:xx
  */
-char* ESP8266_WLAN::getMAC() {
+char * ESP8266_WLAN::getMAC() {
+    if (_mac[0] == '\0')
+        refreshAddresses();
+    return _mac;
+}
+
+
+/**
+ * @brief Performs one "AT+CIFSR" AT command and caches both IPv4 and MAC address.
+ * @return true when successful.
+ */
+bool ESP8266_WLAN::refreshAddresses() {
     writeCommand(PROGMEM_CIFSR);
     if (!readCommand(PROGMEM_CIFSR))
-        return "";
-    if (readData() != 1)
-        return "";
-
-    // Data are stored in BUFFER
-    const char * ps = strstr_P(BUFFER, PROGMEM_STAMAC) + strlen_P(PROGMEM_STAMAC);
-    const char * pe = strchr(ps, '"');
-    byte len = pe - ps;
-    memcpy(_mac, ps, len);
-    _mac[len] = '\0';
-    return _mac;
+        return false;
+
+    // +CIFSR:STAIP,"192.168.1.10"
+    // +CIFSR:STAMAC,"5c:cf:7f:00:00:00"
+    // OK
+    char line[40];
+    byte code;
+    unsigned long start = millis();
+    do {
+        readLine(line, sizeof(line));
+        code = responseCode(line);
+        const char * prefix = PROGMEM_STAIP;
+        char * value = _ip;
+        byte size = sizeof(_ip);
+        const char * ps = strstr_P(line, PROGMEM_STAMAC);
+        if (ps != NULL) {
+            prefix = PROGMEM_STAMAC;
+            value = _mac;
+            size = sizeof(_mac);
+        }
+        else if ((ps = strstr_P(line, PROGMEM_STAIP)) == NULL) {
+            updateState(line);
+            continue;
+        }
+        ps += strlen_P(prefix);
+        const char * pe = strchr(ps, '"');
+        byte len = (pe != NULL && pe - ps < size) ? pe - ps : 0;
+        memcpy(value, ps, len);
+        value[len] = '\0';
+    } while (code == 0 && millis() - start < AT_TIMEOUT);
+    return (code == 1);
 }
 
 
 /**
- * @brief Checks whether the ESP8266 is connected to Access Point.
+ * @brief Checks whether the ESP8266 is connected to Access Point (cached state).
  */
 bool ESP8266_WLAN::isConnectedToAP() {
-    return (getStatus() != '5');
+    return _flags.gotIP;
+}
+
+
+/**
+ * @brief Checks whether the ESP8266 is connected to the given Access Point.
+ */
+bool ESP8266_WLAN::isConnectedToAP(const char * ssid) {
+    writeCommand(PROGMEM_CWJAP_Q);
+    if (!readCommand(PROGMEM_CWJAP_Q))
+        return false;
+
+    // +CWJAP:"ssid","bssid",channel,rssi or "No AP"
+    char value[sizeof(_ssid) + 2];
+    if (readValue(PROGMEM_CWJAP_CUR, value, sizeof(value)) != 1)
+        return false;
+    size_t len = strlen(ssid);
+    return (strncmp(value, ssid, len) == 0) && (value[len] == '"');
+}
+
+
+/**
+ * @brief Performs a query AT command (e. g. "AT+CIPMUX?") and extracts its value.
+ * @param cmd Query command saved in PROGMEM
+ * @param prefix Prefix of the value in the response saved in PROGMEM (e. g. "+CIPMUX:")
+ * @return First character of the value, '\0' when not found.
+ */
+char ESP8266_WLAN::queryValue(const char * cmd, const char * prefix) {
+    writeCommand(cmd);
+    if (!readCommand(cmd))
+        return '\0';
+
+    char value[2];
+    if (readValue(prefix, value, sizeof(value)) != 1)
+        return '\0';
+    return value[0];
+}
+
+
+/**
+ * @brief Reads response of AT command line by line until finds valid AT response.
+ * Unsolicited messages received in the meantime update the cached state.
+ * @param prefix Prefix of the value saved in PROGMEM (e. g. "STATUS:")
+ * @param value Buffer for the rest of the line which starts with prefix, empty when not found.
+ * @param len Size of value.
+ * @return 0 : Timeout, otherwise same as checkResponse()
+ */
+byte ESP8266_WLAN::readValue(const char * prefix, char * value, size_t len) {
+    char line[48];
+    size_t prefixLen = strlen_P(prefix);
+    byte code;
+    unsigned long start = millis();
+    value[0] = '\0';
+    do {
+        readLine(line, sizeof(line));
+        code = responseCode(line);
+        if (strncmp_P(line, prefix, prefixLen) == 0) {
+            strncpy(value, line + prefixLen, len - 1);
+            value[len - 1] = '\0';
+        }
+        else if (code == 0) {
+            updateState(line);
+        }
+    } while (code == 0 && millis() - start < AT_TIMEOUT);
+    return code;
 }
 
 
@@ -204,17 +479,32 @@ bool ESP8266_WLAN::isConnectedToAP() {
  * @return true when successfully created server
  */
 bool ESP8266_WLAN::createTCPServer(const char * port) {
-    strncpy(_port, port, sizeof(_port));
+    strncpy(_port, port, sizeof(_port) - 1);
+    _port[sizeof(_port) - 1] = '\0';
     return createTCPServer();
 }
 
 
 bool ESP8266_WLAN::createTCPServer() {
+    // Links above MAX_CONNECTIONS stay free for the outbound link (not supported by old firmware)
+    writeCommand(PROGMEM_CIPSERVERMAXCONN, false);
+    println(MAX_CONNECTIONS);
+    if (checkResponse() == 0)
+        return false;
     writeCommand(PROGMEM_CIPSERVER_START, false);
     println(_port);
     if (checkResponse() != 1)
         return false;
     _flags.tcpServerRunning = true;
+#if ESP8266_SUPERVISOR
+    if (_health.state == HEALTH_IDLE) {
+        // Server is up - start supervising
+        _health.state = HEALTH_OK;
+        _health.since = millis();
+        _health.lastActivity = _health.since;
+        _health.lostAP = _flags.gotIP ? 0 : _health.since | 1;
+    }
+#endif
     return true;
 }
 
@@ -226,6 +516,9 @@ bool ESP8266_WLAN::deleteTCPServer() {
     writeCommand(PROGMEM_CIPSERVER_STOP);
     if (checkResponse() == 1) {
         _flags.tcpServerRunning = false;
+#if ESP8266_SUPERVISOR
+        _health.state = HEALTH_IDLE;
+#endif
         return true;
     }
     else {
@@ -236,48 +529,293 @@ bool ESP8266_WLAN::deleteTCPServer() {
 
 
 /**
- * 0 : Unexpected echo - echo is stored in BUFFER
+ * @brief Switches between active and passive receive mode of TCP data (AT+CIPRECVMODE).
+ * In active mode ESP8266 pushes "+IPD" frames whenever it receives data and
+ * SoftwareSerial may overflow while Arduino is busy. In passive mode ESP8266 keeps
+ * the data and update() pulls only as much as fits into the RX_BUFFER.
+ * Requires AT firmware 1.5 or newer. The mode is applied again by init().
+ * @param enable true - passive mode; false - active mode (default)
+ * @return true when successful.
+ */
+bool ESP8266_WLAN::setPassiveMode(bool enable) {
+    _flags.passiveMode = enable;
+    return applyReceiveMode();
+}
+
+
+bool ESP8266_WLAN::applyReceiveMode() {
+    // Active mode is the default after restart of ESP8266
+    if (!_flags.passiveMode && !_flags.initialized)
+        return true;
+    writeCommand(PROGMEM_CIPRECVMODE, false);
+    println(_flags.passiveMode ? '1' : '0');
+    return (checkResponse() == 1);
+}
+
+
+/**
+ * @brief Returns status from the state cached from messages of ESP8266. No AT command is issued.
+ * 2 : Got IP (Connected to Access Point)
+ * 3 : Connected (At least one client is connected)
+ * 5 : No IP (Not connected to Access Point)
+ */
+char ESP8266_WLAN::getStatus() {
+    if (!_flags.gotIP)
+        return '5';
+    return anyClientConnected() ? '3' : '2';
+}
+
+
+/**
+ * @brief Performs "AT+CIPSTATUS" AT command and updates the cached state.
+ * 0 : Unexpected echo - handled by the next update()
  * 1 : Error
  * 2 : Got IP (Connected to Access Point)
  * 3 : Connected (At least one client is connected)
  * 4 : Disconnected (No one is connected)
  * 5 : No IP (Not connected to Access Point)
  */
-char ESP8266_WLAN::getStatus() {
+char ESP8266_WLAN::queryStatus() {
     writeCommand(PROGMEM_CIPSTATUS);
-    if (!readCommand(PROGMEM_CIPSTATUS)) {
-        _flags.unexpectedEcho = true;
+    if (!readCommand(PROGMEM_CIPSTATUS))
         return '0';
-    }
-    if (readData() != 1)
+
+    // STATUS:3
+    // +CIPSTATUS:0,"TCP","192.168.1.2",50512,80,1
+    // OK
+    char value[2];
+    if (readValue(PROGMEM_STATUS, value, sizeof(value)) != 1 || value[0] == '\0')
         return '1';
+    _flags.gotIP = (value[0] >= '2' && value[0] <= '4');
+    return value[0];
+}
+
 
-    // Data are stored in BUFFER
-    const char * p = strstr_P(BUFFER, PROGMEM_STATUS) + strlen_P(PROGMEM_STATUS);
-    return (*p);
+/**
+ * @return Number of channels with requests waiting for response (being served).
+ */
+byte ESP8266_WLAN::activeRequests() {
+    byte count = 0;
+    for (byte i = 0; i < MAX_CONNECTIONS; i++) {
+        if (_connections[i].requests > 0)
+            count++;
+    }
+    return count;
 }
 
 
-bool ESP8266_WLAN::closeConnection(char channel) {
-    writeCommand(PROGMEM_CIPCLOSE, false);
-    println(channel);
+/**
+ * @return Number of requests of the channel waiting for response.
+ * Requests are done when the connection is closed.
+ */
+byte ESP8266_WLAN::pendingRequests(char channel) {
+    byte index = channel - '0';
+    return (index < MAX_CONNECTIONS) ? _connections[index].requests : 0;
+}
 
-    // AT+CIPCLOSE=0
-    // 0,CLOSED
+
+/**
+ * @return true when a client is connected to the channel.
+ */
+bool ESP8266_WLAN::isConnected(char channel) {
+    byte index = channel - '0';
+    return (index < MAX_CONNECTIONS) && _connections[index].connected;
+}
+
+
+/**
+ * @brief Marks the request of the channel as served while its connection stays open
+ * (e. g. event stream). It no longer counts to activeRequests().
+ */
+void ESP8266_WLAN::finishRequest(char channel) {
+    recordRequestEnd(channel);
+    byte index = channel - '0';
+    if (index < MAX_CONNECTIONS) {
+        _connections[index].requests = 0;
+        _connections[index].receiving = false;
+    }
+}
+
+
+/**
+ * @brief Switches the link to raw mode: its data are neither screened nor counted as requests,
+ * update() passes them as they are (binary-safe, msg.length bytes in RX_BUFFER).
+ * Raw mode ends when the connection is closed.
+ */
+void ESP8266_WLAN::setRawLink(char channel, bool raw) {
+    byte index = channel - '0';
+    if (index < MAX_CONNECTIONS)
+        _connections[index].raw = raw;
+}
+
+
+bool ESP8266_WLAN::isRawLink(char channel) {
+    byte index = channel - '0';
+    if (index == OUTBOUND_LINK && _flags.linkOpen)
+        return _listener != NULL;
+    if (index == TELEMETRY_LINK && _flags.udpOpen)
+        return true;
+    return index < MAX_CONNECTIONS && _connections[index].raw;
+}
+
+
+/**
+ * @brief Opens outbound TCP connection on link OUTBOUND_LINK next to the running server.
+ * Received data are passed to the listener by update(), data are sent by transmit().
+ * @param host IP address or domain name of the peer.
+ * @param port Port of the peer.
+ * @param listener Receiver of data of the link.
+ * @return true when the connection is established.
+ */
+bool ESP8266_WLAN::openLink(const char * host, const char * port, LinkListener * listener) {
+    _listener = listener;
+    // "4,CONNECT" arrives before the reply of AT+CIPSTART
+    _flags.linkOpen = true;
+    _flags.linkOpen = startLink(OUTBOUND_CHANNEL, "TCP", host, port);
+    return _flags.linkOpen;
+}
+
+
+/**
+ * @brief Opens UDP "connection" on link TELEMETRY_LINK next to the running server.
+ * Datagrams are sent by transmit(), received data are discarded.
+ * @param host IP address of the receiver.
+ * @param port Port of the receiver.
+ * @return true when the link is open.
+ */
+bool ESP8266_WLAN::openUDP(const char * host, const char * port) {
+    // "3,CONNECT" arrives before the reply of AT+CIPSTART
+    _flags.udpOpen = true;
+    _flags.udpOpen = startLink(TELEMETRY_CHANNEL, "UDP", host, port);
+    return _flags.udpOpen;
+}
+
+
+bool ESP8266_WLAN::closeUDP() {
+    // "3,CLOSED" is still the telemetry link
+    bool success = closeConnection(TELEMETRY_CHANNEL);
+    _flags.udpOpen = false;
+    return success;
+}
+
+
+// AT+CIPSTART on a link not used by the server
+bool ESP8266_WLAN::startLink(char channel, const char * type, const char * host, const char * port) {
+    METRICS_BEGIN();
+    // AT+CIPSTART=4,"TCP","192.168.1.2",8080
+    // 4,CONNECT
     // OK
-    CUR_BUFFER_SIZE = readLine(BUFFER, MAX_BUFFER_SIZE);
-    if (strstr_P(BUFFER, PROGMEM_CIPCLOSE) == NULL) {
-        _flags.unexpectedEcho = true;
-        return false;
+    writeCommand(PROGMEM_CIPSTART_LINK, false);
+    print(channel);
+    print(",\"");
+    print(type);
+    print("\",\"");
+    print(host);
+    print("\",");
+    println(port);
+    bool success = (checkResponse() == 1);
+    if (!success) {
+        // e. g. "ALREADY CONNECTED" after reset of Arduino - start clean next time
+        closeConnection(channel);
     }
-    if (readData() != 1)
-        return false;
-    // TODO?
-    // sanitize BUFFER - temporary solution - better would be tell readData to not append \r\n
-    char * p = strstr_P(BUFFER, PROGMEM_CLOSED) + strlen_P(PROGMEM_CLOSED);
-    p[0] = '\0';
-    _flags.unexpectedEcho = true;
-    return true;
+    METRICS_END();
+    return success;
+}
+
+
+/**
+ * @brief Closes the outbound link. The listener is notified.
+ */
+bool ESP8266_WLAN::closeLink() {
+    bool success = closeConnection(OUTBOUND_CHANNEL);
+    dropLink();
+    return success;
+}
+
+
+// Forgets the state of the server link and notifies the subclass
+void ESP8266_WLAN::releaseLink(char channel) {
+    recordRequestEnd(channel);
+    byte index = channel - '0';
+    if (index < MAX_CONNECTIONS) {
+        _connections[index].connected = false;
+        _connections[index].dataPending = false;
+        _connections[index].raw = false;
+        _connections[index].receiving = false;
+        _connections[index].streamLeft = 0; // Nobody to send it to
+        _connections[index].requests = 0;
+    }
+    linkClosed(channel);
+}
+
+
+// Forgets all links - ESP8266 restarted or lost Access Point
+void ESP8266_WLAN::releaseLinks() {
+    for (byte i = 0; i < MAX_CONNECTIONS; i++)
+        releaseLink(_connections[i].channel);
+    dropLink();
+    _flags.udpOpen = false;
+}
+
+
+// Forgets the outbound link and notifies its listener
+void ESP8266_WLAN::dropLink() {
+    bool wasOpen = _flags.linkOpen;
+    _flags.linkOpen = false;
+    _flags.linkPending = false;
+    if (wasOpen && _listener != NULL)
+        _listener->linkClosed();
+}
+
+
+bool ESP8266_WLAN::closeConnection(char channel) {
+    METRICS_BEGIN();
+    recordRequestEnd(channel);
+    byte index = channel - '0';
+    if (index < MAX_CONNECTIONS) {
+        _connections[index].requests = 0;
+        _connections[index].receiving = false;
+    }
+
+    // The client may have closed the link already. Its "0,CLOSED" is then waiting and ESP8266
+    // may give the link ID to a new client before AT+CIPCLOSE arrives.
+    char line[24];
+    bool gone = false;
+    int c;
+    while ((c = peek()) >= '0' && c <= '9') {
+        readLine(line, sizeof(line));
+        gone |= (updateState(line) == 2 && line[0] == channel);
+    }
+
+    bool success = false;
+    if (!gone) {
+        writeCommand(PROGMEM_CIPCLOSE, false);
+        println(channel);
+
+        // AT+CIPCLOSE=0
+        // 0,CLOSED
+        // OK
+        // Request in RX_BUFFER stays untouched - the reply is parsed line by line.
+        // "1,CONNECT" or "+IPD,1,68" of other links may come before the echo.
+        bool echo;
+        unsigned long start = millis();
+        do {
+            readLine(line, sizeof(line));
+            echo = (strstr_P(line, PROGMEM_CIPCLOSE) != NULL);
+            if (!echo)
+                updateState(line);
+        } while (!echo && millis() - start < AT_TIMEOUT);
+        if (echo)
+            success = (checkResponse() == 1);
+        if (!success) {
+            // ERROR when the link is gone already - nothing to close, forget it anyway
+            releaseLink(channel);
+        }
+    }
+    // "0,CLOSED" was handled by checkResponse() - report it by the next update()
+    _flags.closed = index < MAX_CONNECTIONS;
+    METRICS_END();
+    return success;
 }
 
 
@@ -294,90 +832,169 @@ bool ESP8266_WLAN::anyClientConnected() {
     return false;
 }
 
+
+/**
+ * @brief Updates cached state when the line is an unsolicited message of ESP8266.
+ * @param line One line received from ESP8266.
+ * @return 0 - Not a status message; 1 - Client connected; 2 - Client disconnected; 4 - Access Point status changed
+ */
+byte ESP8266_WLAN::updateState(const char * line) {
+    const char * ipd = strstr_P(line, PROGMEM_IPD);
+    if (ipd != NULL && _flags.passiveMode && strchr(ipd, ':') == NULL) {
+        // Passive mode: "+IPD,<channel>,<len>" - data are waiting in ESP8266, update() pulls them.
+        // Noticed in replies of AT commands as well, otherwise the data would wait forever.
+        byte index = ipd[5] - '0';
+        if (index < MAX_CONNECTIONS)
+            _connections[index].dataPending = true;
+        else if (index == OUTBOUND_LINK && _flags.linkOpen)
+            _flags.linkPending = true;
+        return 0;
+    }
+    if (line[0] == OUTBOUND_CHANNEL && line[1] == ',' && (_flags.linkOpen || _flags.linkPending)) {
+        // Outbound link is not reported to the sketch
+        if (strcmp_P(line + 2, PROGMEM_CLOSED) == 0)
+            dropLink();
+        return 0;
+    }
+    if (line[0] == TELEMETRY_CHANNEL && line[1] == ',' && _flags.udpOpen) {
+        // Telemetry link is not reported to the sketch
+        if (strcmp_P(line + 2, PROGMEM_CLOSED) == 0)
+            _flags.udpOpen = false;
+        return 0;
+    }
+    if (line[0] != '\0' && line[1] == ',') {
+        byte index = line[0] - '0';
+        if (strcmp_P(line + 2, PROGMEM_CONNECT) == 0) {
+            // TODO: Close connection if channel is higher than MAX_CONNECTIONS
+            if (index < MAX_CONNECTIONS)
+                _connections[index].connected = true;
+            return 1;
+        }
+        if (strcmp_P(line + 2, PROGMEM_CLOSED) == 0) {
+            releaseLink(line[0]);
+            return 2;
+        }
+        return 0;
+    }
+    if (strcmp_P(line, PROGMEM_WIFI_CONNECTED) == 0) {
+        _flags.connectedToAP = true;
+        return 4;
+    }
+    if (strcmp_P(line, PROGMEM_WIFI_GOT_IP) == 0) {
+        _flags.gotIP = true;
+#if ESP8266_SUPERVISOR
+        _health.lostAP = 0;
+#endif
+        _ip[0] = '\0'; // IP address may have changed
+        return 4;
+    }
+    if (strcmp_P(line, PROGMEM_WIFI_DISCONNECT) == 0) {
+#if ESP8266_SUPERVISOR
+        if (_health.lostAP == 0)
+            _health.lostAP = millis() | 1; // 0 means joined
+#endif
+        _flags.connectedToAP = false;
+        _flags.gotIP = false;
+        _ip[0] = '\0';
+        // All clients are lost
+        releaseLinks();
+        return 4;
+    }
+    return 0;
+}
+
 /***************************************
  * ---------- SEND METHODS ----------- *
  ***************************************/
 /**
- * @brief Appends message to the BUFFER.
- * @param message Text string to be sent
+ * @brief Appends data to the TX_BUFFER. Data which do not fit are dropped.
+ * @param data Data to be appended.
+ * @param len Number of bytes.
+ * @param progmem true when data are saved in Flash (PROGMEM).
  */
-void ESP8266_WLAN::send(const char * message) {
+void ESP8266_WLAN::append(const char * data, size_t len, bool progmem) {
     // Set flag "sending" if first send command
     if (!_flags.sending) {
         _flags.sending = true;
-        CUR_BUFFER_SIZE = 0;
+        CUR_TX_BUFFER_SIZE = 0;
     }
 
-    // Copy contents of the message to the BUFFER
-    strcpy(&BUFFER[CUR_BUFFER_SIZE], message);
-    // Update CUR_BUFFER_SIZE
-    CUR_BUFFER_SIZE += strlen(message);
+    size_t room = MAX_TX_BUFFER_SIZE - 1 - CUR_TX_BUFFER_SIZE;
+    if (len > room)
+        len = room;
+    if (progmem)
+        memcpy_P(&TX_BUFFER[CUR_TX_BUFFER_SIZE], data, len);
+    else
+        memcpy(&TX_BUFFER[CUR_TX_BUFFER_SIZE], data, len);
+    CUR_TX_BUFFER_SIZE += len;
+    TX_BUFFER[CUR_TX_BUFFER_SIZE] = '\0';
+}
+
+
+/**
+ * @brief Appends message to the TX_BUFFER.
+ * @param message Text string to be sent
+ */
+void ESP8266_WLAN::send(const char * message) {
+    append(message, strlen(message), false);
+}
+
+
+/**
+ * @brief Appends binary data (may contain '\0') to the TX_BUFFER.
+ * @param data Data saved in RAM.
+ * @param len Number of bytes, cut to the free space of the TX_BUFFER.
+ */
+void ESP8266_WLAN::send(const char * data, size_t len) {
+    append(data, len, false);
 }
 
 
 void ESP8266_WLAN::send(String & message) {
-    send(message.c_str());
+    append(message.c_str(), message.length(), false);
 }
 
 
 /**
- * @brief Appends number as text string to the BUFFER.
+ * @brief Appends number as text string to the TX_BUFFER.
  * @param num Number to be sent
  */
 void ESP8266_WLAN::send(int num) {
-    // Set flag "sending" if first send command
-    if (!_flags.sending) {
-        _flags.sending = true;
-        CUR_BUFFER_SIZE = 0;
-    }
-
-    // Copy contents of the message to the BUFFER
-    sprintf(&BUFFER[CUR_BUFFER_SIZE], "%d", num);
-    // Update CUR_BUFFER_SIZE
-    CUR_BUFFER_SIZE += num;
+    char buf[7];
+    itoa(num, buf, 10);
+    append(buf, strlen(buf), false);
 }
 
 
+#if ESP8266_FLOAT
+/**
+ * @brief Appends number with 2 decimal places as text string to the TX_BUFFER.
+ * @param num Number to be sent
+ */
 void ESP8266_WLAN::send(float num) {
-    // Set flag "sending" if first send command
-    if (!_flags.sending) {
-        _flags.sending = true;
-        CUR_BUFFER_SIZE = 0;
-    }
-
-    // Copy contents of the message to the BUFFER
-    sprintf(&BUFFER[CUR_BUFFER_SIZE], "%.2f", num);
-    // Update CUR_BUFFER_SIZE
-    CUR_BUFFER_SIZE += (int)num + 2;
+    // printf of avr-libc does not format floats
+    char buf[48];
+    dtostrf(num, 1, 2, buf);
+    append(buf, strlen(buf), false);
 }
+#endif
 
 /**
- * @brief Appends message to the BUFFER. Use this method when text string is saved in Flash (PROGMEM).
+ * @brief Appends message to the TX_BUFFER. Use this method when text string is saved in Flash (PROGMEM).
  * @param message A pointer to text string saved in Flash (PROGMEM).
  */
 void ESP8266_WLAN::send_PROGMEM(const char * message) {
-    // Set flag "sending" if first send command
-    if (!_flags.sending) {
-        _flags.sending = true;
-        CUR_BUFFER_SIZE = 0;
-    }
-
-    // Copy contents of the message to the BUFFER
-    strcpy_P(&BUFFER[CUR_BUFFER_SIZE], message);
-    // Update CUR_BUFFER_SIZE
-    CUR_BUFFER_SIZE += strlen_P(message);
+    append(message, strlen_P(message), true);
 }
 
 
 /**
- * @brief Saves message to the BUFFER and appends CRLF at the end.
+ * @brief Appends message to the TX_BUFFER and appends CRLF at the end.
  * @param message Message to be sent
  */
 void ESP8266_WLAN::sendln(const char * message) {
     send(message);
-    BUFFER[CUR_BUFFER_SIZE++] = '\r';
-    BUFFER[CUR_BUFFER_SIZE++] = '\n';
-    BUFFER[CUR_BUFFER_SIZE] = '\0';
+    append("\r\n", 2, false);
 }
 
 
@@ -388,195 +1005,954 @@ void ESP8266_WLAN::sendln(String & message) {
 
 void ESP8266_WLAN::sendln(int num) {
     send(num);
-    BUFFER[CUR_BUFFER_SIZE++] = '\r';
-    BUFFER[CUR_BUFFER_SIZE++] = '\n';
-    BUFFER[CUR_BUFFER_SIZE] = '\0';
+    append("\r\n", 2, false);
 }
 
 
+#if ESP8266_FLOAT
 void ESP8266_WLAN::sendln(float num) {
     send(num);
-    BUFFER[CUR_BUFFER_SIZE++] = '\r';
-    BUFFER[CUR_BUFFER_SIZE++] = '\n';
-    BUFFER[CUR_BUFFER_SIZE] = '\0';
+    append("\r\n", 2, false);
 }
+#endif
 
 
 /**
- * Message is loaded from Flash (PROGMEM) and saved to the BUFFER and appends CRLF at the end.
+ * Message is loaded from Flash (PROGMEM) and appended to the TX_BUFFER with CRLF at the end.
  */
 void ESP8266_WLAN::sendln_PROGMEM(const char * message) {
     send_PROGMEM(message);
-    BUFFER[CUR_BUFFER_SIZE++] = '\r';
-    BUFFER[CUR_BUFFER_SIZE++] = '\n';
-    BUFFER[CUR_BUFFER_SIZE] = '\0';
+    append("\r\n", 2, false);
 }
 
 
 /**
- * @brief Sends message saved in the BUFFER.
+ * @brief Sends message saved in the TX_BUFFER.
  * @param channel Channel to which to sent.
  * @return true when success.
  */
 bool ESP8266_WLAN::send(char channel) {
+    recordBufferUsage();
+    // Nothing to send (e. g. body of a response to HEAD request)
+    bool success = (CUR_TX_BUFFER_SIZE == 0) || transmit(channel, TX_BUFFER, CUR_TX_BUFFER_SIZE, false);
+    _flags.sending = false;
+    return success;
+}
+
+
+/**
+ * @brief Sends data by "AT+CIPSEND" AT command.
+ * @param channel Channel to which to sent.
+ * @param data Data to be sent.
+ * @param len Number of bytes to be sent (max 2048).
+ * @param progmem true when data are saved in Flash (PROGMEM).
+ * @param prefix Bytes sent in front of data by the same AT+CIPSEND (e. g. frame header), saved in RAM.
+ * @param prefixLen Number of bytes of prefix.
+ * @return true when ESP8266 responds with "SEND OK".
+ */
+bool ESP8266_WLAN::transmit(char channel, const char * data, size_t len, bool progmem,
+        const char * prefix, byte prefixLen) {
+    METRICS_BEGIN();
+#if ESP8266_SUPERVISOR
+    // "OK" of AT+CIPSEND must not hide failed sends
+    byte failures = _health.failures;
+#endif
     writeCommand(PROGMEM_CIPSEND, false);
     print(channel);
     print(",");
-    println(CUR_BUFFER_SIZE);
-
-    if (checkResponse() == 1) {
-        print(BUFFER); // send message
+    println(len + prefixLen);
+
+    bool success = false;
+    byte code = checkResponse();
+    if (code == 1) {
+        // send message
+        if (prefixLen > 0)
+            write((const uint8_t *)prefix, prefixLen);
+        if (progmem) {
+            for (size_t i = 0; i < len; i++)
+                write(pgm_read_byte(data + i));
+        }
+        else {
+            write((const uint8_t *)data, len);
+        }
         if (checkResponse() == 4) {
-            _flags.sending = false;
-            return true;
+#if ESP8266_METRICS
+            _metrics.bytesSent += len + prefixLen;
+            _metrics.sendMicros += micros() - metricsStart;
+#endif
+            success = true;
         }
     }
-    _flags.sending = false;
-    return false;
+#if ESP8266_SUPERVISOR
+    _health.failures = failures;
+    // ERROR to AT+CIPSEND is "link is not valid" - the client is gone, ESP8266 works
+    if (code != 3)
+        recordFailure(!success);
+#endif
+    METRICS_END();
+    return success;
+}
+
+
+/**
+ * @brief Queues response saved in Flash (PROGMEM) which may be bigger than the TX_BUFFER.
+ * update() sends it in chunks of at most SEND_BUDGET bytes. Channels with queued responses
+ * take turns (round robin), higher priority class first, so a large response
+ * does not hold back small ones.
+ * @param channel Channel to which to sent.
+ * @param message A pointer to text string saved in Flash (PROGMEM).
+ * @param priority PRIORITY_HIGH, PRIORITY_NORMAL or PRIORITY_LOW.
+ * @param close Close the connection when the whole message is sent.
+ * @return false when the channel is not valid or another response is queued already.
+ */
+bool ESP8266_WLAN::stream_PROGMEM(char channel, const char * message, byte priority, bool close) {
+    byte index = channel - '0';
+    if (index >= MAX_CONNECTIONS || _connections[index].streamLeft > 0)
+        return false;
+    _connections[index].stream = message;
+    _connections[index].streamLeft = strlen_P(message);
+    _connections[index].priority = priority;
+    _connections[index].closeWhenSent = close;
+    return true;
+}
+
+
+/**
+ * @return true while a queued response is being sent to the channel.
+ */
+bool ESP8266_WLAN::isStreaming(char channel) {
+    byte index = channel - '0';
+    return (index < MAX_CONNECTIONS) && (_connections[index].streamLeft > 0);
+}
+
+
+/**
+ * @brief Sends one chunk of one queued response - the channel with the highest priority
+ * class which is next in turn. Every FAIR_TURN-th chunk goes to the next channel of its own
+ * round robin whatever its class, so a steady flow of small responses does not starve a download.
+ * @return true when a chunk was sent.
+ */
+bool ESP8266_WLAN::serveStreams() {
+    bool fair = (_streamTurn >= FAIR_TURN - 1);
+    byte from = fair ? _fairIndex : _streamIndex;
+    byte index = MAX_CONNECTIONS;
+    for (byte i = 0; i < MAX_CONNECTIONS; i++) {
+        byte candidate = (from + i) % MAX_CONNECTIONS;
+        if (_connections[candidate].streamLeft == 0)
+            continue;
+        if (index == MAX_CONNECTIONS || (!fair && _connections[candidate].priority < _connections[index].priority))
+            index = candidate;
+    }
+    if (index == MAX_CONNECTIONS)
+        return false;
+    if (fair)
+        _fairIndex = (index + 1) % MAX_CONNECTIONS;
+    else
+        _streamIndex = (index + 1) % MAX_CONNECTIONS;
+    _streamTurn = fair ? 0 : _streamTurn + 1;
+
+    WifiConnection * c = &_connections[index];
+    size_t len = (c->streamLeft < SEND_BUDGET) ? c->streamLeft : SEND_BUDGET;
+    if (!transmit(c->channel, c->stream, len, true)) {
+        // Client is gone or ESP8266 malfunctions - drop the response
+        c->streamLeft = 0;
+        closeConnection(c->channel);
+        return false;
+    }
+    c->stream += len;
+    c->streamLeft -= len;
+    if (c->streamLeft == 0 && c->closeWhenSent)
+        closeConnection(c->channel);
+    return true;
+}
+
+
+#if ESP8266_PASSTHROUGH
+/***************************************
+ * ---------- PASS-THROUGH ----------- *
+ ***************************************/
+/**
+ * @brief Stops the server and opens a connection to host in transparent transmission mode.
+ * Data written by passThrough() are then sent as they are, without AT+CIPSEND and SEND OK
+ * for every chunk. update() does nothing until endPassThrough().
+ * Connected clients, the outbound link and the telemetry socket are closed first (linkClosed()).
+ * @param host IP address or domain name of the host.
+ * @param port Port of the host.
+ * @return false when the session was not started - the server is restored.
+ */
+bool ESP8266_WLAN::beginPassThrough(const char * host, const char * port) {
+    if (_flags.passThrough)
+        return false;
+    // ESP8266 refuses single connection mode while any link is open
+    for (byte i = 0; i < MAX_CONNECTIONS; i++) {
+        if (_connections[i].connected)
+            closeConnection(_connections[i].channel);
+    }
+    if (_flags.linkOpen)
+        closeLink();
+    if (_flags.udpOpen)
+        closeUDP();
+    releaseLinks();
+    // Kept frames of the closed links
+    _stashSize = 0;
+    // Transparent mode requires single connection mode without server
+    if (_flags.tcpServerRunning && !deleteTCPServer())
+        return false;
+
+    bool success = false;
+    writeCommand(PROGMEM_CIPMUX_0);
+    if (checkResponse() == 1) {
+        writeCommand(PROGMEM_CIPSTART, false);
+        print(host);
+        print("\",");
+        println(port);
+        // CONNECT
+        // OK
+        if (checkResponse() == 1) {
+            writeCommand(PROGMEM_CIPMODE_1);
+            if (checkResponse() == 1) {
+                writeCommand(PROGMEM_CIPSEND_T);
+                // OK
+                // >
+                success = (checkResponse() == 1) && find((char *)">");
+            }
+        }
+    }
+    if (!success) {
+        restoreServer();
+        return false;
+    }
+    _flags.passThrough = true;
+    return true;
+}
+
+
+/**
+ * @brief Sends data in pass-through mode. ESP8266 packs them by itself.
+ * @return Number of bytes written, 0 when no session is running.
+ */
+size_t ESP8266_WLAN::passThrough(const char * data, size_t len) {
+    if (!_flags.passThrough)
+        return 0;
+#if ESP8266_METRICS
+    unsigned long start = micros();
+#endif
+    len = write((const uint8_t *)data, len);
+#if ESP8266_METRICS
+    _metrics.passThroughBytes += len;
+    _metrics.passThroughMicros += micros() - start;
+#endif
+    return len;
+}
+
+
+/**
+ * @brief Sends data saved in Flash (PROGMEM) in pass-through mode.
+ * @return Number of bytes written, 0 when no session is running.
+ */
+size_t ESP8266_WLAN::passThrough_PROGMEM(const char * data, size_t len) {
+    if (!_flags.passThrough)
+        return 0;
+#if ESP8266_METRICS
+    unsigned long start = micros();
+#endif
+    for (size_t i = 0; i < len; i++)
+        write(pgm_read_byte(data + i));
+#if ESP8266_METRICS
+    _metrics.passThroughBytes += len;
+    _metrics.passThroughMicros += micros() - start;
+#endif
+    return len;
+}
+
+
+/**
+ * @brief Leaves transparent transmission by "+++", closes the connection
+ * and restores multiple connections server. Blocks for more than 1 s - ESP8266 takes
+ * "+++" only after a pause and accepts AT commands 1 s after it, there is nothing to serve meanwhile.
+ * @return true when the server is running again.
+ */
+bool ESP8266_WLAN::endPassThrough() {
+    if (!_flags.passThrough)
+        return false;
+    // "+++" is recognized only as a separate packet
+    flush();
+    delay(50);
+    writeCommand(PROGMEM_ESCAPE, false);
+    // ESP8266 accepts AT commands 1 s later
+    delay(1000);
+    _flags.passThrough = false;
+    // Data received in the meantime
+    while (SoftwareSerial::available())
+        SoftwareSerial::read();
+    return restoreServer();
+}
+
+
+/**
+ * @brief Returns from single connection (transparent) mode to the server.
+ */
+bool ESP8266_WLAN::restoreServer() {
+    writeCommand(PROGMEM_CIPMODE_0);
+    checkResponse();
+    writeCommand(PROGMEM_CIPCLOSE_T);
+    checkResponse();
+    writeCommand(PROGMEM_CIPMUX_1);
+    if (checkResponse() != 1)
+        return false;
+    return applyReceiveMode() && createTCPServer();
 }
+#endif
 
 
 /**
+ * Reads one message of ESP8266 and runs one step of the health monitor.
  * 0 : Nothing happened
  * 1 : Client connected
  * 2 : Client disconnected
  * 3 : TCP message
- * 4 : Response to AT request (e. g. AT+CIPSTATUS, etc.)
+ * 4 : Status changed (e. g. WIFI DISCONNECT, WIFI GOT IP, ESP8266 restarted, recovered)
  */
 byte ESP8266_WLAN::update() {
+#if ESP8266_PASSTHROUGH
+    // Serial link carries raw data of the pass-through session
+    if (_flags.passThrough)
+        return 0;
+#endif
     // Resolve wifi message first
     if (msg.hasData) {
         msg.overflowed = false;
         msg.hasData = false;
         msg.channel = '\0';
         msg.message = NULL;
+        msg.length = 0;
+    }
+    if (_flags.closed) {
+        // Reply of closeConnection()
+        _flags.closed = false;
+        return 2;
+    }
+    if (_stashSize > 0 && !_flags.unexpectedEcho) {
+        // Frame which arrived in the middle of AT command - before anything else is read
+        METRICS_BEGIN();
+        bool accepted = takeStashedFrame();
+        METRICS_END();
+        return accepted ? 3 : 0;
     }
     if (SoftwareSerial::available() || _flags.unexpectedEcho) {
         // Get first line if no unexpectedEcho
         if (!_flags.unexpectedEcho)
-            CUR_BUFFER_SIZE = readLine(BUFFER, MAX_BUFFER_SIZE);
+            CUR_RX_BUFFER_SIZE = readIncoming();
 
-        if (CUR_BUFFER_SIZE == 0) {
+        if (CUR_RX_BUFFER_SIZE == 0) {
             // \r\n - definitelly not interesting => Treat as nothing happened
             return 0;
         }
-        if (strcmp_P(BUFFER + 2, PROGMEM_CONNECT) == 0) {
-            // Client connected
-            // TODO: Close connection if channel is higher than MAX_CONNECTIONS
-            byte channel = BUFFER[0] - '0';
-            _connections[channel].connected = true;
+#if ESP8266_SUPERVISOR
+        _health.lastActivity = millis();
+        if (strcmp_P(RX_BUFFER, PROGMEM_READY) == 0) {
             _flags.unexpectedEcho = false;
-            return 1;
+            if (_health.state == HEALTH_OK) {
+                // ESP8266 restarted by itself (e. g. brownout) - its configuration is lost
+                malfunction();
+                _health.deadline = millis();
+            }
+            else if (_health.state == HEALTH_RESETTING) {
+                // Reset issued by recover() is done
+                if (restore())
+                    return 4;
+            }
+            return 0;
         }
-        if (strcmp_P(BUFFER + 2, PROGMEM_CLOSED) == 0) {
-            // Client disconnected
-            byte channel = BUFFER[0] - '0';
-            _connections[channel].connected = false;
+        if (_health.state == HEALTH_JOINING && responseCode(RX_BUFFER) != 0) {
+            // Reply of AT+CWJAP issued by restore()
             _flags.unexpectedEcho = false;
-            return 2;
+            if (responseCode(RX_BUFFER) != 1) {
+                _health.attempts++;
+                malfunction();
+                return 0;
+            }
+            joined();
+            return resume() ? 4 : 0;
         }
-        if (strstr_P(BUFFER, PROGMEM_IPD) != NULL) {
+#endif
+        // Client connected, client disconnected or Access Point status changed
+        byte code = updateState(RX_BUFFER);
+        if (code != 0) {
+            _flags.unexpectedEcho = false;
+            return code;
+        }
+        if (strstr_P(RX_BUFFER, PROGMEM_IPD) != NULL) {
+            if (_flags.passiveMode && strchr(RX_BUFFER, ':') == NULL) {
+                // Passive mode notice, see updateState()
+                _flags.unexpectedEcho = false;
+                return 0;
+            }
             // TCP message
-            updateWifiMessage();
-            return 3;
+            METRICS_BEGIN();
+            bool accepted = updateWifiMessage();
+            METRICS_END();
+            return accepted ? 3 : 0;
         }
 
-        // ESP8266 may malfunctions
-        // TODO: Implement some kind of mechanism to recognize malfunction
-        /*if (diagnose()) {
-            _flags.unexpectedEcho = false;
-            return 4;
-        }*/
         _flags.unexpectedEcho = false;
+        return 0;
+    }
+#if ESP8266_SUPERVISOR
+    if (_health.state > HEALTH_OK)
+        return supervise() ? 4 : 0;
+#endif
+    if (_flags.passiveMode && _flags.linkPending) {
+        // Data of the outbound link
+        METRICS_BEGIN();
+        size_t len = pullData(OUTBOUND_CHANNEL);
+        _flags.linkPending = (len == MAX_RX_BUFFER_SIZE - 1);
+        if (len > 0 && _listener != NULL)
+            _listener->linkData(RX_BUFFER, len);
+        METRICS_END();
+        return 0;
     }
+    if (_flags.passiveMode) {
+        // RX_BUFFER is free - pull data waiting in ESP8266
+        METRICS_BEGIN();
+        bool pulled = pullWifiMessage();
+        METRICS_END();
+        if (pulled)
+            return 3;
+    }
+    // Nothing received - next chunk of queued responses
+    if (serveStreams())
+        return 0;
+#if ESP8266_SUPERVISOR
+    return supervise() ? 4 : 0;
+#else
     return 0;
+#endif
 }
 
 
 /**
- * @brief Gets incoming TCP message. Note that this function is blocking and buffer may overflow
- * @return 0 - no message, 1 - new message
+ * @brief Gets incoming TCP message. Note that this function is blocking.
+ * The message is screened by screenMessage() as soon as its first line is known, the rest
+ * of rejected message is discarded without being stored. Data which do not fit into
+ * the RX_BUFFER are discarded as well (msg.overflowed).
+ * @return false - message was rejected; true - new message
  */
-void ESP8266_WLAN::updateWifiMessage() {
-    // First line is already in BUFFER
+bool ESP8266_WLAN::updateWifiMessage() {
+    // First line is already in RX_BUFFER
     // Getting channel
-    char channel = BUFFER[5];
+    char channel = RX_BUFFER[5];
 
     // Getting size of message: msg_size
-    const char * startOfMessageSize = &BUFFER[7];
-    const char * startOfMessage = strchr(startOfMessageSize, ':') + 1;
+    char * startOfMessageSize = &RX_BUFFER[7];
+    char * startOfMessage = strchr(startOfMessageSize, ':') + 1;
     size_t len = startOfMessage - startOfMessageSize;
     char buf[len];
     memcpy(buf, startOfMessageSize, len - 1);
     buf[len - 1] = '\0';
     size_t msg_size = atoi(buf);
+    _flags.unexpectedEcho = false;
+
+    if (channel == TELEMETRY_CHANNEL && _flags.udpOpen) {
+        // Nothing is expected from the telemetry receiver
+        discard(msg_size);
+        return false;
+    }
+    if (isRawLink(channel)) {
+        // Binary data follow ":" - read them from the start of the RX_BUFFER
+        size_t room = MAX_RX_BUFFER_SIZE - 1;
+        size_t len = (msg_size < room) ? msg_size : room;
+        CUR_RX_BUFFER_SIZE = readBytes(RX_BUFFER, len);
+        RX_BUFFER[CUR_RX_BUFFER_SIZE] = '\0';
+        if (msg_size > len) {
+            discard(msg_size - len);
+            msg.overflowed = true;
+        }
+        if (channel == OUTBOUND_CHANNEL) {
+            // Not a message for the sketch
+            _listener->linkData(RX_BUFFER, CUR_RX_BUFFER_SIZE);
+            return false;
+        }
+        msg.hasData = true;
+        msg.channel = channel;
+        msg.message = RX_BUFFER;
+        msg.length = CUR_RX_BUFFER_SIZE;
+        return true;
+    }
 
-    // Whole message might not be in the BUFFER
+    // Whole message might not be in the RX_BUFFER
     size_t firstLineSize = strlen(startOfMessage) + 2; // +2 whitespaces \r\n
+    size_t rest = (msg_size > firstLineSize) ? msg_size - firstLineSize : 0;
+    recordRequestStart(channel, msg_size);
+
+    // Decide from the first line
+    byte reason = screenMessage(channel, startOfMessage);
+    if (reason != 0) {
+        discard(rest);
+        rejectMessage(channel, reason);
+        return false;
+    }
 
-// For now ignore overflow - assume that overflow is not possible
-    /*if (CUR_BUFFER_SIZE >= (MAX_BUFFER_SIZE - 1)) {
-        // Overflow
-        msg.overflowed = true;
-    }*/
-    //else if (firstLineSize == msg_size) {
-    if (firstLineSize == msg_size) {
-        // Whole message is already in the BUFFER 
+    if (rest > 0) {
+        // Only part of the message is in the RX_BUFFER
         // function readLine stops reading when \r (does not include \r into the message)
-        //msg.overflowed = false;
-        ;
+        RX_BUFFER[CUR_RX_BUFFER_SIZE++] = '\r';
+        RX_BUFFER[CUR_RX_BUFFER_SIZE++] = '\n';
+        // Read the rest of the message - as much as fits
+        size_t firstLineEnd = CUR_RX_BUFFER_SIZE;
+        size_t room = MAX_RX_BUFFER_SIZE - 1 - CUR_RX_BUFFER_SIZE;
+        size_t len = (rest < room) ? rest : room;
+        CUR_RX_BUFFER_SIZE += readBytes(&RX_BUFFER[CUR_RX_BUFFER_SIZE], len);
+        RX_BUFFER[CUR_RX_BUFFER_SIZE] = '\0';
+        if (rest > len) {
+            discardLines(channel, rest - len, firstLineEnd, RX_BUFFER[CUR_RX_BUFFER_SIZE - 1] == '\n');
+            msg.overflowed = true;
+        }
+    }
+    msg.hasData = true;
+    msg.channel = channel;
+    msg.message = startOfMessage;
+    msg.length = CUR_RX_BUFFER_SIZE - (startOfMessage - RX_BUFFER);
+    countRequest(channel);
+    return true;
+}
+
+
+/**
+ * @brief Active mode: keeps "+IPD" frame which arrived in the middle of AT command in the free
+ * part of the RX_BUFFER - after the request being handled and frames kept before. update() takes
+ * it by takeStashedFrame(). Data which do not fit are discarded without keepLine().
+ * Called by readLine() with "+IPD,<channel>,<msg_size>:" read, the data follow.
+ */
+void ESP8266_WLAN::stashFrame(char channel, size_t msg_size) {
+    if (channel == TELEMETRY_CHANNEL && _flags.udpOpen) {
+        discard(msg_size);
+        return;
+    }
+    size_t at = CUR_RX_BUFFER_SIZE + 1;
+    if (_stashSize > 0)
+        at = _stashAt + _stashSize;
+    else if (!msg.hasData && !_flags.unexpectedEcho)
+        at = 0;
+    if (at + STASH_HEADER_SIZE >= MAX_RX_BUFFER_SIZE) {
+        // No room at all - the frame is lost
+        discard(msg_size);
+        return;
+    }
+    char * record = RX_BUFFER + at;
+    size_t room = MAX_RX_BUFFER_SIZE - 1 - at - STASH_HEADER_SIZE;
+    size_t len = (msg_size < room) ? msg_size : room;
+    len = readBytes(record + STASH_HEADER_SIZE, len);
+    discard(msg_size - len);
+    record[0] = channel;
+    record[1] = (len < msg_size);
+    record[2] = len & 0xFF;
+    record[3] = len >> 8;
+    if (_stashSize == 0)
+        _stashAt = at;
+    _stashSize += STASH_HEADER_SIZE + len + 1;
+}
+
+
+/**
+ * @brief Active mode: takes the oldest frame kept by stashFrame(). Moves it to the start
+ * of the RX_BUFFER, the other kept frames follow it. Screens it like updateWifiMessage().
+ * @return false - message was rejected; true - new message
+ */
+bool ESP8266_WLAN::takeStashedFrame() {
+    char * record = RX_BUFFER + _stashAt;
+    char channel = record[0];
+    bool overflowed = record[1];
+    size_t len = (byte)record[2] | ((size_t)(byte)record[3] << 8);
+    memmove(RX_BUFFER, record + STASH_HEADER_SIZE, _stashSize - STASH_HEADER_SIZE);
+    _stashSize -= STASH_HEADER_SIZE + len + 1;
+    _stashAt = len + 1;
+    CUR_RX_BUFFER_SIZE = len;
+    RX_BUFFER[len] = '\0';
+
+    if (isRawLink(channel)) {
+        msg.overflowed = overflowed;
+        if (channel == OUTBOUND_CHANNEL) {
+            // Not a message for the sketch
+            _listener->linkData(RX_BUFFER, len);
+            return false;
+        }
     }
     else {
-        // Only part of the message is in the BUFFER
-        // function readLine stops reading when \r (does not include \r into the message)
-        BUFFER[CUR_BUFFER_SIZE++] = '\r';
-        BUFFER[CUR_BUFFER_SIZE++] = '\n';
-        // Read the rest of the message
-        CUR_BUFFER_SIZE += readBytes(&BUFFER[CUR_BUFFER_SIZE], msg_size - firstLineSize);
-        //msg.overflowed = false;
+        recordRequestStart(channel, len);
+        char * eol = (char *)memchr(RX_BUFFER, '\r', len);
+        if (eol == NULL && overflowed) {
+            // Not even the first line was kept - the client has to try again
+            closeConnection(channel);
+            return false;
+        }
+        // Decide from the first line
+        if (eol != NULL)
+            *eol = '\0';
+        byte reason = screenMessage(channel, RX_BUFFER);
+        if (eol != NULL)
+            *eol = '\r';
+        if (reason != 0) {
+            rejectMessage(channel, reason);
+            return false;
+        }
+        msg.overflowed = overflowed;
+        countRequest(channel);
     }
     msg.hasData = true;
     msg.channel = channel;
-    msg.message = startOfMessage;
+    msg.message = RX_BUFFER;
+    msg.length = len;
+    return true;
+}
 
-    _flags.unexpectedEcho = false;
-    return;
+/**
+ * @brief Passive mode: pulls data of one channel from ESP8266 (round robin).
+ * The message is screened by screenMessage() like in active mode. The rest of accepted message
+ * which does not fit into the RX_BUFFER is pulled right away and discarded (msg.overflowed),
+ * lines wanted by keepLine() replace the end of the RX_BUFFER.
+ * @return true when new message is in the RX_BUFFER.
+ */
+bool ESP8266_WLAN::pullWifiMessage() {
+    byte index = MAX_CONNECTIONS;
+    for (byte i = 0; i < MAX_CONNECTIONS; i++) {
+        byte candidate = (_pullIndex + i) % MAX_CONNECTIONS;
+        if (_connections[candidate].dataPending) {
+            index = candidate;
+            break;
+        }
+    }
+    if (index == MAX_CONNECTIONS)
+        return false;
+    _pullIndex = (index + 1) % MAX_CONNECTIONS;
+
+    char channel = _connections[index].channel;
+    _connections[index].dataPending = false;
+    if (_connections[index].receiving) {
+        // Late rest of the request being served (e. g. its last TCP segment) - not a new request
+        CUR_RX_BUFFER_SIZE = 0;
+        pullRest(channel, 0);
+        return false;
+    }
+    size_t room = MAX_RX_BUFFER_SIZE - 1;
+    CUR_RX_BUFFER_SIZE = pullData(channel);
+
+    // Data which did not fit stay in ESP8266
+    bool overflowed = (CUR_RX_BUFFER_SIZE == room);
+    if (CUR_RX_BUFFER_SIZE == 0)
+        return false;
+    msg.channel = channel;
+    msg.message = RX_BUFFER;
+    if (_connections[index].raw) {
+        _connections[index].dataPending |= overflowed;
+        msg.length = CUR_RX_BUFFER_SIZE;
+        msg.hasData = true;
+        return true;
+    }
+    recordRequestStart(channel, CUR_RX_BUFFER_SIZE);
+
+    // Decide from the first line
+    char * pCR = strchr(RX_BUFFER, '\r');
+    if (pCR != NULL)
+        pCR[0] = '\0';
+    byte reason = screenMessage(channel, RX_BUFFER);
+    if (pCR != NULL)
+        pCR[0] = '\r';
+    if (reason != 0) {
+        // The rest is dropped by ESP8266 with the link
+        _connections[index].dataPending |= overflowed;
+        rejectMessage(channel, reason);
+        return false;
+    }
+
+    if (overflowed) {
+        // Lines after the first one may be replaced by kept ones
+        size_t firstLineEnd = (pCR != NULL) ? pCR - RX_BUFFER + 2 : CUR_RX_BUFFER_SIZE;
+        if (firstLineEnd > CUR_RX_BUFFER_SIZE)
+            firstLineEnd = CUR_RX_BUFFER_SIZE;
+        pullRest(channel, firstLineEnd);
+        _connections[index].receiving = true;
+        msg.overflowed = true;
+    }
+    msg.length = CUR_RX_BUFFER_SIZE;
+    msg.hasData = true;
+    countRequest(channel);
+    return true;
 }
 
+
+/**
+ * @brief Passive mode: pulls data of the channel waiting in ESP8266 by AT+CIPRECVDATA.
+ * Requests at most as many bytes as fit into the RX_BUFFER, the rest stays in ESP8266.
+ * @return Number of bytes in the RX_BUFFER, 0 when there are no data (or error).
+ */
+size_t ESP8266_WLAN::pullData(char channel) {
+    size_t len;
+    if (!requestData(channel, MAX_RX_BUFFER_SIZE - 1, &len))
+        return 0;
+    len = readBytes(RX_BUFFER, len);
+    RX_BUFFER[len] = '\0';
+    checkResponse();
+    return len;
+}
+
+
+/**
+ * @brief Passive mode: pulls all data of the channel waiting in ESP8266 and throws them away
+ * like discardLines() does with the rest of "+IPD" frame in active mode.
+ * @param start Lines of the RX_BUFFER before this position are never replaced by kept ones.
+ */
+void ESP8266_WLAN::pullRest(char channel, size_t start) {
+    // Discarded data start in the middle of a line unless the RX_BUFFER ends by one
+    bool whole = (CUR_RX_BUFFER_SIZE > 0 && RX_BUFFER[CUR_RX_BUFFER_SIZE - 1] == '\n');
+    size_t len;
+    do {
+        if (!requestData(channel, PULL_REST_SIZE, &len))
+            return;
+        whole = discardLines(channel, len, start, whole);
+        checkResponse();
+    } while (len == PULL_REST_SIZE);
+}
+
+
+/**
+ * @brief Passive mode: requests data of the channel by AT+CIPRECVDATA and reads the reply
+ * up to the data. The caller reads len bytes of data and the final "OK" by checkResponse().
+ * @param size Maximum number of bytes.
+ * @param len Number of bytes which follow.
+ * @return false when there are no data (or error) - the reply was read whole.
+ */
+bool ESP8266_WLAN::requestData(char channel, size_t size, size_t * len) {
+    writeCommand(PROGMEM_CIPRECVDATA, false);
+    print(channel);
+    print(",");
+    println(size);
+
+    // AT+CIPRECVDATA=0,383
+    // +CIPRECVDATA,<len>:<data>
+    // OK
+    // The echo may come after messages of other links - it is skipped like them
+    char buf[24];
+    size_t prefixLen = strlen_P(PROGMEM_CIPRECVDATA_R);
+    size_t hdr = 0;
+    unsigned long start = millis();
+    while (1) {
+        if (millis() - start >= AT_TIMEOUT)
+            return false;
+        // Header of data ends by ":", other lines by \r
+        int c = 0;
+        hdr = 0;
+        while (hdr < sizeof(buf) - 1 && (c = timedRead()) >= 0 && c != '\r' && c != ':')
+            buf[hdr++] = c;
+        buf[hdr] = '\0';
+        if (c == ':' && strncmp_P(buf, PROGMEM_CIPRECVDATA_R, prefixLen) == 0)
+            break;
+        while (c != '\n' && c >= 0)
+            c = timedRead();
+        // No data (ERROR or OK alone) - do not wait any longer
+        if (responseCode(buf) != 0)
+            return false;
+        updateState(buf);
+    }
+    if (buf[hdr - 1] == 'A') {
+        // Newer firmware: +CIPRECVDATA:<len>,<data>
+        hdr = readBytesUntil(',', buf, sizeof(buf) - 1);
+        buf[hdr] = '\0';
+        *len = atoi(buf);
+    }
+    else {
+        *len = atoi(buf + prefixLen + 1);
+    }
+    if (*len > size)
+        *len = size;
+    return true;
+}
+
+
+void ESP8266_WLAN::countRequest(char channel) {
+    byte index = channel - '0';
+    if (index < MAX_CONNECTIONS && _connections[index].requests < 255)
+        _connections[index].requests++;
+}
+
+
 // Returns pointer to msg
 WifiMessage * ESP8266_WLAN::getWifiMessage() {
     return &msg;
 }
 
 
+#if ESP8266_SUPERVISOR
+/***************************************
+ * ---------- HEALTH MONITOR --------- *
+ ***************************************/
 /**
- * Looks for any messages which would idicate ESP8266 malfunctions. 
- * Workst case Arduino resets.
- * @return true - No issues; false - Issues recognized but cleared
+ * @return Time in ms since the server is running without malfunction, 0 when it is not running.
  */
-bool ESP8266_WLAN::diagnose() {
-    if (strcpy_P(BUFFER, PROGMEM_WIFI_DISCONNECT) == 0) {
-        if (!restart()) {
-            // restart() failed => Reset Arduino
-            asm("  jmp 0");
-        }
+unsigned long ESP8266_WLAN::uptime() {
+    if (_health.state != HEALTH_OK)
+        return 0;
+    return millis() - _health.since;
+}
+
+
+/**
+ * @brief One non-blocking step of the health monitor, called by update().
+ * Detects malfunction and performs at most one recovery step when its time has come.
+ * @return true when the server was recovered.
+ */
+bool ESP8266_WLAN::supervise() {
+    unsigned long now = millis();
+    switch (_health.state) {
+        case HEALTH_OK:
+            if (_health.failures >= MAX_AT_FAILURES) {
+                malfunction();
+            }
+            else if (!_flags.gotIP && _health.lostAP != 0 && now - _health.lostAP >= RECONNECT_GRACE) {
+                // ESP8266 did not rejoin Access Point by itself
+                malfunction();
+            }
+#if HEALTH_PROBE_INTERVAL > 0
+            else if (!_flags.sending && now - _health.lastActivity >= HEALTH_PROBE_INTERVAL) {
+                _health.lastActivity = now;
+                writeCommand(PROGMEM_AT);
+                // Healthy ESP8266 answers within milliseconds. "+IPD" of a client which sends
+                // meanwhile is kept by readLine() for the next update().
+                checkResponse(HEALTH_PROBE_TIMEOUT);
+            }
+#endif
+            return false;
+        case HEALTH_RECOVERING:
+            if ((long)(now - _health.deadline) >= 0)
+                recover();
+            return (_health.state == HEALTH_OK);
+        case HEALTH_JOINING:
+            // update() handles the reply of AT+CWJAP
+            if ((long)(now - _health.deadline) >= 0) {
+                _health.attempts++;
+                malfunction();
+            }
+            return false;
+        case HEALTH_RESETTING:
+            if (_health.resetPinLow && now - _health.lastActivity >= 500) {
+                // End of hard reset pulse
+                digitalWrite(_RST_PIN, HIGH);
+                _health.resetPinLow = false;
+                _health.lastActivity = now;
+            }
+            else if (now - _health.lastActivity >= READY_TIMEOUT) {
+                // No "ready" from ESP8266
+                _health.attempts++;
+                malfunction();
+            }
+            return false;
+        case HEALTH_IDLE:
+        default:
+            return false;
+    }
+}
+
+
+/**
+ * @brief Schedules next recovery attempt with exponential backoff.
+ */
+void ESP8266_WLAN::malfunction() {
+    byte shift = (_health.attempts < 6) ? _health.attempts : 6;
+    _health.state = HEALTH_RECOVERING;
+    _health.failures = 0;
+    _health.deadline = millis() + ((unsigned long)RECOVERY_BACKOFF << shift);
+}
+
+
+/**
+ * @brief Performs one recovery attempt. Each kind of attempt is tried MAX_RESET_ATTEMPTS times:
+ * restoring configuration (rejoining Access Point, TCP server), then soft reset, then hard reset.
+ * Resets do not wait for "ready" - update() waits for it.
+ */
+void ESP8266_WLAN::recover() {
+    byte level = _health.attempts / MAX_RESET_ATTEMPTS;
+    _health.lastActivity = millis();
+    _flags.sending = false;
+
+    if (level == 0) {
+        restore();
+        return;
+    }
+
+    _health.state = HEALTH_RESETTING;
+    if (level == 1) {
+        // "OK" is ignored by update(), no "ready" within READY_TIMEOUT is a failed attempt
+        writeCommand(PROGMEM_RST);
+        return;
+    }
+    digitalWrite(_RST_PIN, LOW);
+    _health.resetPinLow = true;
+}
+
+
+/**
+ * @brief Restores configuration of ESP8266 and TCP server. Joining Access Point does not block -
+ * update() finishes the recovery by resume() when AT+CWJAP is answered.
+ * @return true when the server runs again.
+ */
+bool ESP8266_WLAN::restore() {
+    _health.state = HEALTH_RECOVERING;
+    if (!reconfigure()) {
+        _health.attempts++;
+        malfunction();
         return false;
     }
-    // Terrible function - it gets stuck in checkResponse() setTimeout is valid only for Stream::ReadBytes()
-    setTimeout(10000); // 10 seconds
-    if (checkResponse() == 5) {
-        // "ready" message detected
-        if (!restart()) {
-            // restart() failed => Reset Arduino
-            asm("  jmp 0");
+    if (isConnectedToAP(_ssid)) {
+        char status = queryStatus();
+        if (status == '0' || status == '1') {
+            _health.attempts++;
+            malfunction();
+            return false;
         }
+        _flags.connectedToAP = true;
+        _flags.gotIP = (status != '5');
+        return resume();
+    }
+    requestJoin();
+    _health.state = HEALTH_JOINING;
+    _health.deadline = millis() + JOIN_TIMEOUT;
+    return false;
+}
+
+
+/**
+ * @brief Starts the TCP server again - the last step of the recovery.
+ * @return true when the server runs again.
+ */
+bool ESP8266_WLAN::resume() {
+    if (!createTCPServer()) {
+        _health.attempts++;
+        malfunction();
         return false;
     }
-    setTimeout(1000);
+    _health.state = HEALTH_OK;
+    _health.attempts = 0;
+    _health.failures = 0;
+    _health.recoveries++;
+    _health.since = millis();
+    _health.lastActivity = _health.since;
+    _health.lostAP = _flags.gotIP ? 0 : _health.since | 1;
     return true;
 }
 
 
+/**
+ * @brief Counts consecutive AT timeouts and failed sends.
+ */
+void ESP8266_WLAN::recordFailure(bool failed) {
+    if (!failed)
+        _health.failures = 0;
+    else if (_health.failures < 255)
+        _health.failures++;
+}
+#endif
+
+
 /**
  * @brief Executes init(), connectToAP() and createTCPServer() in the right order.
  * @return true when successful.
@@ -592,6 +1968,8 @@ bool ESP8266_WLAN::restart() {
  */
 bool ESP8266_WLAN::softRestart() {
     writeCommand(PROGMEM_RST);
+    if (checkResponse() != 1)
+        return false;
     return (checkResponse() == 5);
 }
 
@@ -614,8 +1992,9 @@ byte ESP8266_WLAN::readData() {
 
 
 /**
- * Reads Data to BUFFER until finds valid AT response.
- * 0 : Buffer overflowed
+ * Reads Data to RX_BUFFER until finds valid AT response.
+ * Overwrites the request being handled - AT commands of the library parse responses line by line.
+ * 0 : Buffer overflowed or timeout
  * 1 : "OK"
  * 2 : "FAIL"
  * 3 : "ERROR"
@@ -623,42 +2002,45 @@ byte ESP8266_WLAN::readData() {
  * 5 : "ready"
  */
 byte ESP8266_WLAN::readData(size_t origin) {
-    CUR_BUFFER_SIZE = origin;
+    CUR_RX_BUFFER_SIZE = origin;
     byte code = 0;
-    // First line - Save Data to the start of the BUFFER
-    byte DATA_SIZE = readLine(BUFFER + CUR_BUFFER_SIZE, MAX_BUFFER_SIZE);
+    // First line - Save Data to the start of the RX_BUFFER
+    byte DATA_SIZE = readLine(RX_BUFFER + CUR_RX_BUFFER_SIZE, MAX_RX_BUFFER_SIZE);
+    unsigned long start = millis();
 
     while (1) {
-        if ((CUR_BUFFER_SIZE + DATA_SIZE + 2) > MAX_BUFFER_SIZE)
+        if ((CUR_RX_BUFFER_SIZE + DATA_SIZE + 2) > MAX_RX_BUFFER_SIZE)
             return 0;
-        if (strcmp_P(BUFFER + CUR_BUFFER_SIZE, PROGMEM_OK) == 0) {
+        if (millis() - start >= AT_TIMEOUT)
+            return 0;
+        if (strcmp_P(RX_BUFFER + CUR_RX_BUFFER_SIZE, PROGMEM_OK) == 0) {
             code = 1;
             break;
         }
-        if (strcmp_P(BUFFER + CUR_BUFFER_SIZE, PROGMEM_FAIL) == 0) {
+        if (strcmp_P(RX_BUFFER + CUR_RX_BUFFER_SIZE, PROGMEM_FAIL) == 0) {
             code = 2;
             break;
         }
-        if (strcmp_P(BUFFER + CUR_BUFFER_SIZE, PROGMEM_ERROR) == 0) {
+        if (strcmp_P(RX_BUFFER + CUR_RX_BUFFER_SIZE, PROGMEM_ERROR) == 0) {
             code = 3;
             break;
         }
-        if (strcmp_P(BUFFER + CUR_BUFFER_SIZE, PROGMEM_SEND_OK) == 0) {
+        if (strcmp_P(RX_BUFFER + CUR_RX_BUFFER_SIZE, PROGMEM_SEND_OK) == 0) {
             code = 4;
             break;
         }
-        if (strcmp_P(BUFFER + CUR_BUFFER_SIZE, PROGMEM_READY) == 0) {
+        if (strcmp_P(RX_BUFFER + CUR_RX_BUFFER_SIZE, PROGMEM_READY) == 0) {
             code = 5;
             break;
         }
         // Message is not finished - add new line
-        CUR_BUFFER_SIZE += DATA_SIZE;
-        BUFFER[CUR_BUFFER_SIZE++] = '\r';
-        BUFFER[CUR_BUFFER_SIZE++] = '\n';
+        CUR_RX_BUFFER_SIZE += DATA_SIZE;
+        RX_BUFFER[CUR_RX_BUFFER_SIZE++] = '\r';
+        RX_BUFFER[CUR_RX_BUFFER_SIZE++] = '\n';
         // Read next line - Note that buffer may overflow - Stops reading mid line when no more space
-        DATA_SIZE = readLine(BUFFER + CUR_BUFFER_SIZE, MAX_BUFFER_SIZE - CUR_BUFFER_SIZE);
+        DATA_SIZE = readLine(RX_BUFFER + CUR_RX_BUFFER_SIZE, MAX_RX_BUFFER_SIZE - CUR_RX_BUFFER_SIZE);
     }
-    BUFFER[CUR_BUFFER_SIZE - DATA_SIZE + 2] = '\0';
+    RX_BUFFER[CUR_RX_BUFFER_SIZE - DATA_SIZE + 2] = '\0';
     return code;
 }
 
@@ -672,22 +2054,63 @@ byte ESP8266_WLAN::readData(size_t origin) {
  * 5 : "ready"
  */
 byte ESP8266_WLAN::checkResponse() {
+    return checkResponse(AT_TIMEOUT);
+}
+
+
+/**
+ * Like checkResponse() but with custom timeout.
+ * @param timeout Maximum waiting time in ms
+ * @return 0 : Timeout, otherwise same as checkResponse()
+ */
+byte ESP8266_WLAN::checkResponse(unsigned long timeout) {
     char buf[20];
     size_t len = 20;
-    while (1) {
+    unsigned long start = millis();
+    while (millis() - start < timeout) {
+        if (!SoftwareSerial::available())
+            continue;
         readLine(buf, len);
-
-        if (strcmp_P(buf, PROGMEM_OK) == 0)
-            return 1;
-        if (strcmp_P(buf, PROGMEM_FAIL) == 0)
-            return 2;
-        if (strcmp_P(buf, PROGMEM_ERROR) == 0)
-            return 3;
-        if (strcmp_P(buf, PROGMEM_SEND_OK) == 0)
-            return 4;
-        if (strcmp_P(buf, PROGMEM_READY) == 0)
-            return 5;
+        updateState(buf);
+#if ESP8266_SUPERVISOR
+        _health.lastActivity = millis();
+#endif
+
+        byte code = responseCode(buf);
+#if ESP8266_SUPERVISOR
+        if (code == 1 || code == 4)
+            recordFailure(false);
+        if (code == 5 && _health.state == HEALTH_OK) {
+            // ESP8266 restarted by itself in the middle of AT command
+            malfunction();
+            _health.deadline = millis();
+        }
+#endif
+        if (code != 0)
+            return code;
     }
+#if ESP8266_SUPERVISOR
+    recordFailure(true);
+#endif
+    return 0;
+}
+
+
+/**
+ * @param line One line received from ESP8266.
+ * @return 0 when the line is not a valid AT response, otherwise same as checkResponse()
+ */
+byte ESP8266_WLAN::responseCode(const char * line) {
+    if (strcmp_P(line, PROGMEM_OK) == 0)
+        return 1;
+    if (strcmp_P(line, PROGMEM_FAIL) == 0)
+        return 2;
+    if (strcmp_P(line, PROGMEM_ERROR) == 0)
+        return 3;
+    if (strcmp_P(line, PROGMEM_SEND_OK) == 0)
+        return 4;
+    if (strcmp_P(line, PROGMEM_READY) == 0)
+        return 5;
     return 0;
 }
 
@@ -715,28 +2138,309 @@ void ESP8266_WLAN::writeCommand(const char * cmd, bool eol) {
  * @return true when expected command found otherwise false
  */
 bool ESP8266_WLAN::readCommand(const char * cmd, bool progmem) {
+    // While a request is being handled its data in RX_BUFFER must stay valid
+    char line[48];
+    bool keep = !msg.hasData && _stashSize == 0;
+    char * buf = keep ? RX_BUFFER : line;
+    size_t len = keep ? MAX_RX_BUFFER_SIZE : sizeof(line);
+    size_t size;
+    bool found = false;
+    unsigned long start = millis();
     do {
-        CUR_BUFFER_SIZE = readLine(BUFFER, MAX_BUFFER_SIZE);
-    } while (CUR_BUFFER_SIZE == 0);
-    if (progmem) {
-        return (strcmp_P(BUFFER, cmd) == 0);
-    }
-    else {
-        return (strcmp(BUFFER, cmd) == 0);
+        if (keep && _stashSize > 0) {
+            // Frame kept by readLine() took the RX_BUFFER
+            keep = false;
+            buf = line;
+            len = sizeof(line);
+        }
+        size = readLine(buf, len);
+        if (size == 0)
+            continue;
+        found = progmem ? (strcmp_P(buf, cmd) == 0) : (strcmp(buf, cmd) == 0);
+        if (found || !_flags.passiveMode)
+            break;
+        // Passive mode: no data arrive unsolicited, only notices like "1,CONNECT" or "+IPD,1,68"
+        updateState(buf);
+        size = 0;
+    } while (millis() - start < AT_TIMEOUT);
+    if (!found) {
+        if (keep && _stashSize == 0) {
+            // Handled by the next update()
+            CUR_RX_BUFFER_SIZE = size;
+            _flags.unexpectedEcho = true;
+        }
+        else {
+            updateState(line);
+        }
     }
+    return found;
 }
 
 
 /**
  * @brief Reads from serial stream to buf until Carriage Return found.
+ * Active mode: "+IPD" frame which arrives in the middle of AT command is kept by stashFrame()
+ * for the next update(), the line is then empty.
  * @param buf Buffer to which the data will be put.
  * @param len Maximum size of the buffer.
  * @return Number of bytes saved in the buffer.
  */
 size_t ESP8266_WLAN::readLine(char * buf, size_t len) {
     // One line may end by <\r><\r><\n> or <\r><\n>
-    size_t b = readBytesUntil('\r', buf, len - 1);
+    size_t b = 0;
+    int c = 0;
+    while (b < len - 1 && (c = timedRead()) >= 0 && c != '\r') {
+        buf[b++] = c;
+        // +IPD,<channel>,<len>:
+        if (c == ':' && b > 7 && strncmp_P(buf, PROGMEM_IPD, 5) == 0) {
+            buf[b] = '\0';
+            char channel = buf[5];
+            size_t msg_size = atoi(buf + 7);
+            buf[0] = '\0';
+            stashFrame(channel, msg_size);
+            return 0;
+        }
+    }
     buf[b] = '\0';
-    while (read() != '\n'); // Discard rest of the line
+    // Discard rest of the line
+    while (c != '\n' && c >= 0)
+        c = timedRead();
+    return b;
+}
+
+
+/**
+ * @brief Reads one line of ESP8266 to the RX_BUFFER like readLine(). Data of "+IPD" frame
+ * of a raw link are left unread after ":" - they are binary, possibly with \r.
+ * @return Number of bytes saved in the RX_BUFFER.
+ */
+size_t ESP8266_WLAN::readIncoming() {
+    size_t b = 0;
+    int c = 0;
+    while (b < MAX_RX_BUFFER_SIZE - 1 && (c = timedRead()) >= 0 && c != '\r') {
+        RX_BUFFER[b++] = c;
+        // +IPD,<channel>,<len>:
+        if (c == ':' && b > 7 && strncmp_P(RX_BUFFER, PROGMEM_IPD, 5) == 0 && isRawLink(RX_BUFFER[5])) {
+            RX_BUFFER[b] = '\0';
+            return b;
+        }
+    }
+    RX_BUFFER[b] = '\0';
+    // Discard rest of the line
+    while (c != '\n' && c >= 0)
+        c = timedRead();
     return b;
 }
+
+
+/**
+ * @brief Reads and throws away len bytes of the message which did not fit into the RX_BUFFER.
+ * Lines wanted by keepLine() (e. g. a header sent late) replace the end of the RX_BUFFER.
+ * @param start Lines before this position of the RX_BUFFER are never replaced.
+ * @param whole true when the data start at the beginning of a line.
+ * @return true when the data end by a whole line.
+ */
+bool ESP8266_WLAN::discardLines(char channel, size_t len, size_t start, bool whole) {
+    char line[48];
+    byte n = 0;
+    while (len > 0) {
+        int c = timedRead();
+        if (c < 0)
+            return false;
+        len--;
+        if (c != '\n') {
+            if (n < sizeof(line) - 1)
+                line[n++] = c;
+            else
+                whole = false;
+            continue;
+        }
+        if (n > 0 && line[n - 1] == '\r')
+            n--;
+        line[n] = '\0';
+        if (whole && n > 0 && keepLine(channel, line)) {
+            // Cut the RX_BUFFER after a whole line so that the kept one fits
+            size_t end = MAX_RX_BUFFER_SIZE - 1 - n - 2;
+            if (end > CUR_RX_BUFFER_SIZE)
+                end = CUR_RX_BUFFER_SIZE;
+            while (end > start && RX_BUFFER[end - 1] != '\n')
+                end--;
+            if (end > start) {
+                memcpy(&RX_BUFFER[end], line, n);
+                memcpy(&RX_BUFFER[end + n], "\r\n", 3);
+                CUR_RX_BUFFER_SIZE = end + n + 2;
+            }
+        }
+        n = 0;
+        whole = true;
+    }
+    return whole && n == 0;
+}
+
+
+/**
+ * @brief Reads and throws away len bytes from serial stream.
+ */
+void ESP8266_WLAN::discard(size_t len) {
+    while (len > 0 && timedRead() >= 0)
+        len--;
+}
+
+
+/***************************************
+ * ------------- METRICS ------------- *
+ ***************************************/
+#if ESP8266_METRICS
+/**
+ * @return Pointer to performance counters collected since the last resetMetrics().
+ */
+Metrics * ESP8266_WLAN::getMetrics() {
+    return &_metrics;
+}
+
+
+// Clears all performance counters
+void ESP8266_WLAN::resetMetrics() {
+    memset(&_metrics, 0, sizeof(_metrics));
+    _metrics.minLatency = (unsigned long)-1;
+    _metrics.since = millis();
+}
+
+
+/**
+ * @return Number of requests per minute since the last resetMetrics().
+ */
+unsigned long ESP8266_WLAN::requestsPerMinute() {
+    unsigned long elapsed = millis() - _metrics.since;
+    if (elapsed == 0)
+        return 0;
+    return (_metrics.requests * 60000UL) / elapsed;
+}
+
+
+/**
+ * @brief Estimates latency percentile from the latency histogram.
+ * @param percentile Value 1 - 100 (e. g. 50 for median, 99 for tail latency).
+ * @return Upper bound of the latency in milliseconds, 0 when nothing was measured.
+ */
+unsigned long ESP8266_WLAN::latencyPercentile(byte percentile) {
+    unsigned long total = 0;
+    for (byte i = 0; i < LATENCY_BUCKETS; i++)
+        total += _metrics.latency[i];
+    if (total == 0)
+        return 0;
+
+    unsigned long rank = (total * percentile + 99) / 100;
+    unsigned long count = 0;
+    for (byte i = 0; i < LATENCY_BUCKETS; i++) {
+        count += _metrics.latency[i];
+        if (count >= rank)
+            return 1UL << i;
+    }
+    return 1UL << (LATENCY_BUCKETS - 1);
+}
+
+
+/**
+ * @return Average time in microseconds the library was busy per request.
+ */
+unsigned long ESP8266_WLAN::busyMicrosPerRequest() {
+    if (_metrics.requests == 0)
+        return 0;
+    return _metrics.busyMicros / _metrics.requests;
+}
+
+
+/**
+ * @return Throughput of responses sent by AT+CIPSEND including its overhead (bytes/s).
+ */
+unsigned long ESP8266_WLAN::sendBytesPerSecond() {
+    return bytesPerSecond(_metrics.bytesSent, _metrics.sendMicros);
+}
+
+
+#if ESP8266_PASSTHROUGH
+/**
+ * @return Throughput of data sent in pass-through mode (bytes/s).
+ */
+unsigned long ESP8266_WLAN::passThroughBytesPerSecond() {
+    return bytesPerSecond(_metrics.passThroughBytes, _metrics.passThroughMicros);
+}
+#endif
+
+
+unsigned long ESP8266_WLAN::bytesPerSecond(unsigned long bytes, unsigned long us) {
+    unsigned long ms = us / 1000;
+    if (ms == 0)
+        return 0;
+    // Without overflow of bytes * 1000
+    return (bytes / ms) * 1000 + (bytes % ms) * 1000 / ms;
+}
+
+
+void ESP8266_WLAN::recordBusy(unsigned long start) {
+    // Sections nest (e. g. rejected request answered inside update()) - only the outermost counts
+    if (--_busyDepth == 0)
+        _metrics.busyMicros += micros() - start;
+}
+#endif
+
+
+void ESP8266_WLAN::recordBufferUsage() {
+#if ESP8266_METRICS
+    if (CUR_RX_BUFFER_SIZE > _metrics.peakRxBufferSize)
+        _metrics.peakRxBufferSize = CUR_RX_BUFFER_SIZE;
+    if (_flags.sending && CUR_TX_BUFFER_SIZE > _metrics.peakTxBufferSize)
+        _metrics.peakTxBufferSize = CUR_TX_BUFFER_SIZE;
+#endif
+}
+
+
+/**
+ * @brief Starts latency measurement of the request on the channel.
+ * @param size Size of the received data.
+ */
+void ESP8266_WLAN::recordRequestStart(char channel, size_t size) {
+#if ESP8266_METRICS
+    byte index = channel - '0';
+    if (index < MAX_CONNECTIONS && _connections[index].requestStart == 0) {
+        _connections[index].requestStart = micros() | 1; // 0 means idle
+        _metrics.requests++;
+    }
+    _metrics.bytesReceived += size;
+    recordBufferUsage();
+#else
+    (void)channel;
+    (void)size;
+#endif
+}
+
+
+/**
+ * @brief Finishes latency measurement of the request on the channel.
+ */
+void ESP8266_WLAN::recordRequestEnd(char channel) {
+#if ESP8266_METRICS
+    byte index = channel - '0';
+    if (index >= MAX_CONNECTIONS || _connections[index].requestStart == 0)
+        return;
+
+    unsigned long latency = micros() - _connections[index].requestStart;
+    _connections[index].requestStart = 0;
+
+    if (latency < _metrics.minLatency)
+        _metrics.minLatency = latency;
+    if (latency > _metrics.maxLatency)
+        _metrics.maxLatency = latency;
+
+    // Bucket i holds latencies lower than 2^i ms
+    unsigned long ms = latency / 1000;
+    byte bucket = 0;
+    while (bucket < LATENCY_BUCKETS - 1 && ms >= (1UL << bucket))
+        bucket++;
+    if (_metrics.latency[bucket] < 0xFFFF)
+        _metrics.latency[bucket]++;
+#else
+    (void)channel;
+#endif
+}
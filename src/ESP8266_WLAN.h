@@ -10,10 +10,7 @@
 #include "Arduino.h"
 #include <SoftwareSerial.h>
 #include <avr/pgmspace.h>
-
-#define MAX_BUFFER_SIZE 512
-#define MAX_CONNECTIONS 3
-#define MAX_RESET_ATTEMPTS 3
+#include "ESP8266_Config.h"
 
 typedef unsigned char byte;
 
@@ -25,77 +22,245 @@ public:
         this->hasData = false;
         this->channel = '-';
         this->message = NULL;
+        this->length = 0;
     };
     bool overflowed:1;
     bool hasData:1;
     char channel;
     char * message;
+    size_t length; // data of raw links are binary - may contain '\0'
 };
 
+// Priority classes of queued responses - lower value is served first
+// Typed - a plain 0 would be ambiguous with a handler in Router::registerRoute()
+#define PRIORITY_HIGH   ((byte)0)
+#define PRIORITY_NORMAL ((byte)1)
+#define PRIORITY_LOW    ((byte)2)
+
 struct WifiConnection {
 public:
     char channel;
     bool connected:1;
+    bool dataPending:1;
+    bool closeWhenSent:1;
+    bool raw:1; // received data are passed as they are (e. g. WebSocket frames)
+    bool receiving:1; // passive mode: rest of the overflowed request being served may still arrive
+    byte priority;
+    byte requests; // received requests waiting for response
+    // Queued response saved in PROGMEM
+    const char * stream;
+    size_t streamLeft;
+#if ESP8266_METRICS
+    unsigned long requestStart;
+#endif
+};
+
+#if ESP8266_SUPERVISOR
+enum HealthState { HEALTH_IDLE, HEALTH_OK, HEALTH_RECOVERING, HEALTH_RESETTING, HEALTH_JOINING };
+
+/**
+ * State of the background health monitor.
+ * Recovery escalates from restoring the configuration (rejoining Access Point, TCP server)
+ * to soft reset and hard reset, MAX_RESET_ATTEMPTS attempts each.
+ */
+struct Health {
+    HealthState state;
+    byte attempts;         // failed recovery attempts since the last malfunction
+    byte failures;         // consecutive AT timeouts and failed sends
+    bool resetPinLow:1;
+    unsigned int recoveries;
+    unsigned long since;        // serving since (ms)
+    unsigned long lastActivity; // last byte received from ESP8266 (ms)
+    unsigned long lostAP;       // "WIFI DISCONNECT" received at (ms), 0 while joined
+    unsigned long deadline;     // next recovery step at, end of joining (ms)
+};
+#endif
+
+#if ESP8266_METRICS
+#define LATENCY_BUCKETS 16
+
+/**
+ * Performance counters of the request path.
+ * Latency of a request is measured from "+IPD" to closing of its channel.
+ * Busy time is the time spent inside the library serving requests.
+ */
+struct Metrics {
+    unsigned long since;
+    unsigned long requests;
+    unsigned long bytesReceived;
+    unsigned long bytesSent;
+    unsigned long busyMicros;
+    unsigned long sendMicros;        // spent by sending responses (AT+CIPSEND)
+    unsigned long passThroughBytes;
+    unsigned long passThroughMicros; // spent by sending in pass-through mode
+    unsigned long minLatency;
+    unsigned long maxLatency;
+    size_t peakRxBufferSize;
+    size_t peakTxBufferSize;
+    // latency[i] counts requests served in less than 2^i ms
+    unsigned int latency[LATENCY_BUCKETS];
+};
+#endif
+
+/**
+ * Receiver of data of the outbound connection (see ESP8266_WLAN::openLink()).
+ */
+class LinkListener {
+public:
+    /**
+     * @brief Called by update() with data received over the outbound link.
+     * Data are not terminated, valid until the next update().
+     */
+    virtual void linkData(char * data, size_t len) = 0;
+    /**
+     * @brief Called when the outbound link is closed (by the peer, by closeLink() or lost).
+     */
+    virtual void linkClosed() = 0;
 };
 
 struct Flags {
     bool initialized:1,
          connectedToAP:1,
+         gotIP:1,
          tcpServerRunning:1,
          sending:1,
-         unexpectedEcho:1;
+         unexpectedEcho:1,
+         closed:1,
+         passiveMode:1,
+         passThrough:1,
+         linkOpen:1,
+         linkPending:1,
+         udpOpen:1;
 };
 
 class ESP8266_WLAN : public SoftwareSerial
 {
 public:
-    ESP8266_WLAN(byte RX_PIN, byte TX_PIN, byte RST_PIN);
+    ESP8266_WLAN(byte RX_PIN, byte TX_PIN, byte RST_PIN, long baud = 9600);
     ~ESP8266_WLAN();
 
     bool isActive();
     bool init();
+    bool warmStart(const char * ssid, const char * pass);
 
     bool connectToAP(const char * ssid, const char * pass);
     bool disconnectFromAP();
 
     char * getIP();
     char * getMAC();
+    bool refreshAddresses();
     char getStatus();
+    char queryStatus();
+    bool isConnected(char channel);
+    byte activeRequests();
+    byte pendingRequests(char channel);
     bool closeConnection(char channel);
 
     bool createTCPServer(const char * port);
     bool deleteTCPServer();
 
+    bool openLink(const char * host, const char * port, LinkListener * listener);
+    bool isLinkOpen() { return _flags.linkOpen; }
+    bool closeLink();
+    bool openUDP(const char * host, const char * port);
+    bool isUDPOpen() { return _flags.udpOpen; }
+    bool closeUDP();
+    bool transmit(char channel, const char * data, size_t len, bool progmem,
+            const char * prefix = NULL, byte prefixLen = 0);
+
+    bool setPassiveMode(bool enable);
+
     void send(const char * message);
+    void send(const char * data, size_t len);
     void send(String& message);
     void send(int num);
+#if ESP8266_FLOAT
     void send(float num);
+#endif
     void send_PROGMEM(const char * message);
 
     void sendln(const char * message);
     void sendln(String& message);
     void sendln(int num);
+#if ESP8266_FLOAT
     void sendln(float num);
+#endif
     void sendln_PROGMEM(const char * message);
 
     bool send(char channel);
 
+    bool stream_PROGMEM(char channel, const char * message, byte priority = PRIORITY_NORMAL, bool close = true);
+    bool isStreaming(char channel);
+
+#if ESP8266_PASSTHROUGH
+    bool beginPassThrough(const char * host, const char * port);
+    size_t passThrough(const char * data, size_t len);
+    size_t passThrough_PROGMEM(const char * data, size_t len);
+    bool endPassThrough();
+    bool isPassThrough() { return _flags.passThrough; }
+#endif
+
     byte update();
     WifiMessage * getWifiMessage();
 
     byte readData();
     byte readData(size_t origin);
     byte checkResponse();
+    byte checkResponse(unsigned long timeout);
 
     void writeCommand(const char * cmd, bool eol = true);
     bool readCommand(const char * cmd, bool progmem = true);
 
     size_t readLine(char * buf, size_t len);
+    void discard(size_t len);
+
+#if ESP8266_SUPERVISOR
+    Health * getHealth() { return &_health; }
+    unsigned long uptime();
+#endif
 
-    char BUFFER[MAX_BUFFER_SIZE];
-    size_t CUR_BUFFER_SIZE;
+#if ESP8266_METRICS
+    Metrics * getMetrics();
+    void resetMetrics();
+    unsigned long requestsPerMinute();
+    unsigned long latencyPercentile(byte percentile);
+    unsigned long busyMicrosPerRequest();
+    unsigned long sendBytesPerSecond();
+#if ESP8266_PASSTHROUGH
+    unsigned long passThroughBytesPerSecond();
+#endif
+#endif
+
+    // Received request - valid until the next update()
+    char RX_BUFFER[MAX_RX_BUFFER_SIZE];
+    size_t CUR_RX_BUFFER_SIZE;
+    // Response being composed by send() methods
+    char TX_BUFFER[MAX_TX_BUFFER_SIZE];
+    size_t CUR_TX_BUFFER_SIZE;
 protected:
     WifiMessage msg;
+
+    /**
+     * @brief Decides about incoming message as soon as its first line is received.
+     * @return 0 - accept; otherwise reason of rejection passed to rejectMessage()
+     */
+    virtual byte screenMessage(char /* channel */, const char * /* line */) { return 0; }
+    /**
+     * @brief Called when the rest of rejected message was discarded.
+     */
+    virtual void rejectMessage(char /* channel */, byte /* reason */) {}
+    /**
+     * @brief Called when the connection of the channel is closed (by client, by server or lost).
+     */
+    virtual void linkClosed(char /* channel */) {}
+    /**
+     * @brief Called for every line of accepted message which did not fit into the RX_BUFFER.
+     * @return true - the line replaces the end of the RX_BUFFER; false - it is discarded
+     */
+    virtual bool keepLine(char /* channel */, const char * /* line */) { return false; }
+    void finishRequest(char channel);
+    void setRawLink(char channel, bool raw);
+    bool isRawLink(char channel);
 private:
     byte _RST_PIN;
 
@@ -107,19 +272,73 @@ private:
     char _port[6];
 
     bool connectToAP();
+    void requestJoin();
+    void joined();
+    bool reconfigure();
     bool isConnectedToAP();
+    bool isConnectedToAP(const char * ssid);
+    char queryValue(const char * cmd, const char * prefix);
+    byte readValue(const char * prefix, char * value, size_t len);
+    byte responseCode(const char * line);
     char _ssid[16];
     char _pass[16];
 
     bool anyClientConnected();
+    byte updateState(const char * line);
 
-    bool diagnose();
+#if ESP8266_SUPERVISOR
+    Health _health;
+    bool supervise();
+    void malfunction();
+    void recover();
+    bool restore();
+    bool resume();
+    void recordFailure(bool failed);
+#endif
     bool restart();
     bool softRestart();
     bool hardRestart();
 
-    void updateWifiMessage();
+    void append(const char * data, size_t len, bool progmem);
+    bool serveStreams();
+    byte _streamIndex;
+    byte _streamTurn; // chunks sent since the last fair turn
+    byte _fairIndex;  // round robin of fair turns
+#if ESP8266_PASSTHROUGH
+    bool restoreServer();
+#endif
+
+    size_t readIncoming();
+    bool discardLines(char channel, size_t len, size_t start, bool whole);
+    bool updateWifiMessage();
+    void stashFrame(char channel, size_t msg_size);
+    bool takeStashedFrame();
+    // Active mode: frames which arrived in the middle of AT commands, kept in the RX_BUFFER
+    size_t _stashAt;
+    size_t _stashSize;
+    bool pullWifiMessage();
+    size_t pullData(char channel);
+    void pullRest(char channel, size_t start);
+    bool requestData(char channel, size_t size, size_t * len);
+    void dropLink();
+    void releaseLink(char channel);
+    void releaseLinks();
+    bool startLink(char channel, const char * type, const char * host, const char * port);
+    LinkListener * _listener;
+    void countRequest(char channel);
+    bool applyReceiveMode();
     WifiConnection _connections[MAX_CONNECTIONS];
+    byte _pullIndex;
+
+#if ESP8266_METRICS
+    Metrics _metrics;
+    byte _busyDepth; // nesting of busy sections
+    void recordBusy(unsigned long start);
+    static unsigned long bytesPerSecond(unsigned long bytes, unsigned long us);
+#endif
+    void recordBufferUsage();
+    void recordRequestStart(char channel, size_t size);
+    void recordRequestEnd(char channel);
 };
 
 